@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include "devices/ide.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A block device. */
 struct block
@@ -21,8 +22,12 @@ struct block
     unsigned long long write_cnt;       /* Number of sectors written. */
   };
 
-/* List of all block devices. */
+/* List of all block devices.  Devices are registered, under
+   all_blocks_lock held for writing, but never removed, so
+   block_first() and block_next() may walk the list without the
+   lock. */
 static struct list all_blocks = LIST_INITIALIZER (all_blocks);
+static struct rwlock all_blocks_lock = RWLOCK_INITIALIZER (all_blocks_lock);
 
 /* The block block assigned to each Pintos role. */
 static struct block *block_by_role[BLOCK_ROLE_CNT];
@@ -86,17 +91,23 @@ block_next (struct block *block)
 struct block *
 block_get_by_name (const char *name)
 {
+  struct block *found = NULL;
   struct list_elem *e;
 
+  rwlock_acquire_read (&all_blocks_lock);
   for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
        e = list_next (e))
     {
       struct block *block = list_entry (e, struct block, list_elem);
       if (!strcmp (name, block->name))
-        return block;
+        {
+          found = block;
+          break;
+        }
     }
+  rwlock_release_read (&all_blocks_lock);
 
-  return NULL;
+  return found;
 }
 
 /* Verifies that SECTOR is a valid offset within BLOCK.
@@ -192,7 +203,6 @@ block_register (const char *name, enum block_type type,
   if (block == NULL)
     PANIC ("Failed to allocate memory for block device descriptor");
 
-  list_push_back (&all_blocks, &block->list_elem);
   strlcpy (block->name, name, sizeof block->name);
   block->type = type;
   block->size = size;
@@ -200,6 +210,9 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  rwlock_acquire_write (&all_blocks_lock);
+  list_push_back (&all_blocks, &block->list_elem);
+  rwlock_release_write (&all_blocks_lock);
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -123,7 +123,7 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
+      lock_init (&c->lock, c->name);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
  
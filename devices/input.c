@@ -1,16 +1,47 @@
 #include "devices/input.h"
 #include <debug.h>
-#include "devices/intq.h"
+#include <ring.h>
 #include "devices/serial.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
 
-/* Stores keys from the keyboard and serial port. */
-static struct intq buffer;
+/* Size of the input buffer, in keys.  Must be a power of 2. */
+#define INPUT_BUFSIZE 256
+
+/* Stores keys from the keyboard and serial port.  The producers
+   are interrupt handlers, which do not nest, so the buffer has a
+   single producer.  Readers take keys with interrupts off, which
+   keeps them to one consumer at a time. */
+static struct ring buffer;
+static uint8_t buffer_data[INPUT_BUFSIZE];
+
+/* Readers waiting for keys.  Every reader that sleeps bumps
+   sleeper_cnt and waits on keys_ready, and input_put() wakes all
+   of them. */
+static struct semaphore keys_ready;
+static int sleeper_cnt;
 
 /* Initializes the input buffer. */
 void
 input_init (void) 
 {
-  intq_init (&buffer);
+  ring_init (&buffer, buffer_data, 1, INPUT_BUFSIZE);
+  sema_init (&keys_ready, 0);
+}
+
+/* Adds the CNT keys in KEYS to the input buffer.
+   Interrupts must be off and the buffer must have room for
+   them. */
+void
+input_put (const uint8_t *keys, size_t cnt) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (cnt <= input_space ());
+
+  ring_enqueue (&buffer, keys, cnt);
+  for (; sleeper_cnt > 0; sleeper_cnt--)
+    sema_up (&keys_ready);
+  serial_notify ();
 }
 
 /* Adds a key to the input buffer.
@@ -18,11 +49,30 @@ input_init (void)
 void
 input_putc (uint8_t key) 
 {
-  ASSERT (intr_get_level () == INTR_OFF);
-  ASSERT (!intq_full (&buffer));
+  input_put (&key, 1);
+}
+
+/* Retrieves up to SIZE keys from the input buffer into BUF and
+   returns the number retrieved, which is at least 1.
+   If the buffer is empty, waits for a key to be pressed. */
+size_t
+input_read (uint8_t *buf, size_t size) 
+{
+  enum intr_level old_level;
+  size_t cnt;
 
-  intq_putc (&buffer, key);
+  ASSERT (size > 0);
+
+  old_level = intr_disable ();
+  while ((cnt = ring_dequeue (&buffer, buf, size)) == 0)
+    {
+      sleeper_cnt++;
+      sema_down (&keys_ready);
+    }
   serial_notify ();
+  intr_set_level (old_level);
+
+  return cnt;
 }
 
 /* Retrieves a key from the input buffer.
@@ -30,23 +80,26 @@ input_putc (uint8_t key)
 uint8_t
 input_getc (void) 
 {
-  enum intr_level old_level;
   uint8_t key;
 
-  old_level = intr_disable ();
-  key = intq_getc (&buffer);
-  serial_notify ();
-  intr_set_level (old_level);
-  
+  input_read (&key, 1);
   return key;
 }
 
+/* Returns the number of keys the input buffer has room for.
+   Interrupts must be off. */
+size_t
+input_space (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  return ring_space (&buffer);
+}
+
 /* Returns true if the input buffer is full,
    false otherwise.
    Interrupts must be off. */
 bool
 input_full (void) 
 {
-  ASSERT (intr_get_level () == INTR_OFF);
-  return intq_full (&buffer);
+  return input_space () == 0;
 }
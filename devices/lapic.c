@@ -0,0 +1,224 @@
+#include "devices/lapic.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+
+/* Local APIC.
+
+   Every CPU has a local APIC, through which it receives
+   interrupts from its own timer and interprocessor interrupts
+   (IPIs) from the other CPUs, and sends IPIs.  Its registers
+   appear at the same physical address on every CPU, each CPU
+   seeing its own.  See [IA32-v3a] chapter 10 "Advanced
+   Programmable Interrupt Controller (APIC)".
+
+   The device interrupts still come from the 8259A PICs, which
+   are wired to the boot CPU's LINT0 pin ("virtual wire mode"),
+   so the boot CPU keeps the PIT for its timer and only the
+   other CPUs run the local APIC timer. */
+
+/* Register offsets.  See [IA32-v3a] 10.4.1 "The Local APIC Block
+   Diagram". */
+#define LAPIC_ID        0x020   /* Local APIC ID. */
+#define LAPIC_TPR       0x080   /* Task priority. */
+#define LAPIC_EOI       0x0b0   /* End of interrupt. */
+#define LAPIC_SVR       0x0f0   /* Spurious interrupt vector. */
+#define LAPIC_ESR       0x280   /* Error status. */
+#define LAPIC_ICR_LO    0x300   /* Interrupt command, low half. */
+#define LAPIC_ICR_HI    0x310   /* Interrupt command, high half. */
+#define LAPIC_LVT_TIMER 0x320   /* Local vector table: timer. */
+#define LAPIC_LVT_LINT0 0x350   /* Local vector table: LINT0 pin. */
+#define LAPIC_LVT_LINT1 0x360   /* Local vector table: LINT1 pin. */
+#define LAPIC_LVT_ERROR 0x370   /* Local vector table: errors. */
+#define LAPIC_TIMER_INIT 0x380  /* Timer initial count. */
+#define LAPIC_TIMER_CUR 0x390   /* Timer current count. */
+#define LAPIC_TIMER_DIV 0x3e0   /* Timer divide configuration. */
+
+/* Register bits. */
+#define SVR_ENABLE      0x100   /* APIC software enable. */
+#define LVT_NMI         0x400   /* Deliver as NMI. */
+#define LVT_EXTINT      0x700   /* Deliver from the PIC. */
+#define LVT_MASKED      0x10000 /* Masked. */
+#define LVT_PERIODIC    0x20000 /* Periodic timer. */
+#define ICR_INIT        0x500   /* INIT IPI. */
+#define ICR_STARTUP     0x600   /* Startup IPI. */
+#define ICR_PENDING     0x1000  /* Delivery still pending. */
+#define ICR_ASSERT      0x4000  /* Assert level. */
+#define ICR_LEVEL       0x8000  /* Level triggered. */
+#define TIMER_DIV_16    0x3     /* Timer counts at bus clock / 16. */
+
+/* Mapped registers, or a null pointer before lapic_init(). */
+static volatile uint32_t *lapic;
+
+/* Timer counts per timer tick.
+   Initialized by lapic_init(). */
+static uint32_t timer_count;
+
+static intr_handler_func lapic_timer_interrupt;
+
+/* Returns the value of register REG. */
+static inline uint32_t
+lapic_read (int reg)
+{
+  return lapic[reg / sizeof *lapic];
+}
+
+/* Writes VALUE to register REG. */
+static inline void
+lapic_write (int reg, uint32_t value)
+{
+  lapic[reg / sizeof *lapic] = value;
+
+  /* Read something back, to wait for the write to finish. */
+  (void) lapic[LAPIC_ID / sizeof *lapic];
+}
+
+/* Maps the local APIC registers at physical address PADDR into
+   the kernel's page tables, at the same virtual address, sets up
+   the boot CPU's local APIC, and measures the local APIC timer
+   against the TSC.  Must be called after timer_calibrate(). */
+void
+lapic_init (uintptr_t paddr)
+{
+  uint32_t *pt;
+  uint64_t end;
+
+  ASSERT (pg_ofs ((void *) paddr) == 0);
+  ASSERT ((void *) paddr >= ptov (init_ram_pages * PGSIZE));
+
+  /* The registers are well above the kernel's mapping of RAM.
+     Map them uncached.  User page directories copy the kernel's
+     page directory entries when they are created, so this must
+     happen before any process starts. */
+  if (init_page_dir[pd_no ((void *) paddr)] == 0)
+    {
+      pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+      init_page_dir[pd_no ((void *) paddr)] = pde_create (pt);
+    }
+  else
+    pt = pde_get_pt (init_page_dir[pd_no ((void *) paddr)]);
+  pt[pt_no ((void *) paddr)] = paddr | PTE_P | PTE_W | PTE_PCD | PTE_PWT;
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)) : "memory");
+  lapic = (volatile uint32_t *) paddr;
+
+  /* Enable the local APIC, leaving the PIC on LINT0. */
+  lapic_write (LAPIC_SVR, SVR_ENABLE | LAPIC_SPURIOUS_VEC);
+  lapic_write (LAPIC_LVT_LINT0, LVT_EXTINT);
+  lapic_write (LAPIC_LVT_LINT1, LVT_NMI);
+  lapic_write (LAPIC_LVT_ERROR, LVT_MASKED);
+  lapic_write (LAPIC_TPR, 0);
+
+  /* Count down from the top for one tick's worth of TSC cycles. */
+  lapic_write (LAPIC_LVT_TIMER, LVT_MASKED);
+  lapic_write (LAPIC_TIMER_DIV, TIMER_DIV_16);
+  lapic_write (LAPIC_TIMER_INIT, UINT32_MAX);
+  end = rdtsc () + timer_tsc_freq () / TIMER_FREQ;
+  while (rdtsc () < end)
+    continue;
+  timer_count = UINT32_MAX - lapic_read (LAPIC_TIMER_CUR);
+  lapic_write (LAPIC_TIMER_INIT, 0);
+  printf ("Local APIC timer: %'"PRIu32" counts per tick.\n", timer_count);
+
+  intr_register_ext (LAPIC_TIMER_VEC, lapic_timer_interrupt, "APIC Timer");
+}
+
+/* Sets up the local APIC of an application processor, the one
+   we are running on, and starts its timer. */
+void
+lapic_init_ap (void)
+{
+  ASSERT (lapic != NULL);
+
+  lapic_write (LAPIC_SVR, SVR_ENABLE | LAPIC_SPURIOUS_VEC);
+  lapic_write (LAPIC_LVT_LINT0, LVT_MASKED);
+  lapic_write (LAPIC_LVT_LINT1, LVT_MASKED);
+  lapic_write (LAPIC_LVT_ERROR, LVT_MASKED);
+  lapic_write (LAPIC_ESR, 0);
+  lapic_write (LAPIC_ESR, 0);
+  lapic_write (LAPIC_TPR, 0);
+
+  lapic_write (LAPIC_TIMER_DIV, TIMER_DIV_16);
+  lapic_write (LAPIC_LVT_TIMER, LVT_PERIODIC | LAPIC_TIMER_VEC);
+  lapic_write (LAPIC_TIMER_INIT, timer_count);
+}
+
+/* Returns the local APIC ID of the CPU we are running on. */
+uint8_t
+lapic_id (void)
+{
+  ASSERT (lapic != NULL);
+
+  return lapic_read (LAPIC_ID) >> 24;
+}
+
+/* Acknowledges the interrupt being handled. */
+void
+lapic_eoi (void)
+{
+  lapic_write (LAPIC_EOI, 0);
+}
+
+/* Sends interrupt command ICR_LO to the CPU whose local APIC ID
+   is ID and waits until it has been delivered. */
+static void
+send_icr (uint8_t id, uint32_t icr_lo)
+{
+  enum intr_level old_level = intr_disable ();
+
+  lapic_write (LAPIC_ICR_HI, (uint32_t) id << 24);
+  lapic_write (LAPIC_ICR_LO, icr_lo);
+  while (lapic_read (LAPIC_ICR_LO) & ICR_PENDING)
+    continue;
+
+  intr_set_level (old_level);
+}
+
+/* Sends an IPI with vector VEC to the CPU whose local APIC ID is
+   ID. */
+void
+lapic_send_ipi (uint8_t id, uint8_t vec)
+{
+  ASSERT (lapic != NULL);
+
+  send_icr (id, ICR_ASSERT | vec);
+}
+
+/* Starts the application processor whose local APIC ID is ID
+   executing real-mode code at START_PADDR, which must be
+   page-aligned and below 1 MB, with the INIT-SIPI-SIPI sequence
+   of [MP] B.4 "Application Processor Startup". */
+void
+lapic_start_ap (uint8_t id, uintptr_t start_paddr)
+{
+  int i;
+
+  ASSERT (lapic != NULL);
+  ASSERT (start_paddr % PGSIZE == 0 && start_paddr < 0x100000);
+
+  send_icr (id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+  timer_udelay (200);
+  send_icr (id, ICR_INIT | ICR_LEVEL);
+  timer_mdelay (10);
+
+  for (i = 0; i < 2; i++)
+    {
+      send_icr (id, ICR_STARTUP | (start_paddr >> 12));
+      timer_udelay (200);
+    }
+}
+
+/* Local APIC timer interrupt handler, on the application
+   processors. */
+static void
+lapic_timer_interrupt (struct intr_frame *args UNUSED)
+{
+  thread_tick (timer_ticks ());
+}
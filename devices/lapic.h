@@ -0,0 +1,21 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Interrupt vectors raised by the local APIC.  The interrupt
+   core treats 0xf0...0xff as external interrupts, like the PICs'
+   0x20...0x2f, but acknowledges them to the local APIC. */
+#define LAPIC_TIMER_VEC 0xf0            /* Local timer. */
+#define LAPIC_RESCHED_VEC 0xf1          /* Reschedule IPI. */
+#define LAPIC_SPURIOUS_VEC 0xff         /* Spurious interrupt. */
+
+void lapic_init (uintptr_t paddr);
+void lapic_init_ap (void);
+uint8_t lapic_id (void);
+void lapic_eoi (void);
+void lapic_send_ipi (uint8_t lapic_id, uint8_t vec);
+void lapic_start_ap (uint8_t lapic_id, uintptr_t start_paddr);
+
+#endif /* devices/lapic.h */
@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -81,3 +78,40 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Starts channel 0 counting down COUNT cycles of the PIT clock,
+   once, in mode 0 ("interrupt on terminal count"): the channel's
+   output, and with it interrupt line 0, rises when the count
+   reaches 0 and stays high until the channel is programmed again.
+   Meanwhile the counter keeps counting down, wrapping around to
+   65535.  A COUNT of 0 counts 65536 cycles.  Interrupts must be
+   off. */
+void
+pit_start_oneshot (uint16_t count)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  outb (PIT_PORT_CONTROL, 0x30);
+  outb (PIT_PORT_COUNTER (0), count);
+  outb (PIT_PORT_COUNTER (0), count >> 8);
+}
+
+/* Returns channel 0's current count, and sets *EXPIRED to true
+   if the channel's output is high, which for a one-shot count
+   means that it has reached 0, false otherwise.  Uses the 8254's
+   read-back command, which latches the status and the count at
+   the same instant.  Interrupts must be off. */
+uint16_t
+pit_read_count (bool *expired)
+{
+  uint8_t status, low, high;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  outb (PIT_PORT_CONTROL, 0xc2);
+  status = inb (PIT_PORT_COUNTER (0));
+  low = inb (PIT_PORT_COUNTER (0));
+  high = inb (PIT_PORT_COUNTER (0));
+  *expired = (status & 0x80) != 0;
+  return low | (high << 8);
+}
@@ -1,7 +1,7 @@
 #include "devices/serial.h"
 #include <debug.h>
+#include <ring.h>
 #include "devices/input.h"
-#include "devices/intq.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
@@ -37,6 +37,13 @@
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
 
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* FIFOs enabled. */
+
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable FIFOs. */
+#define FCR_CLEAR 0x06          /* Clear both FIFOs. */
+
 /* Line Control Register bits. */
 #define LCR_N81 0x03            /* No parity, 8 data bits, 1 stop bit. */
 #define LCR_DLAB 0x80           /* Divisor Latch Access Bit (DLAB). */
@@ -51,8 +58,31 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
-static struct intq txq;
+/* Size of the transmit FIFO of a 16550A. */
+#define UART_FIFO_SIZE 16
+
+/* Size of the transmit queue, in bytes.  Must be a power of 2. */
+#define TXQ_SIZE 1024
+
+/* Data to be transmitted.  Any thread or interrupt handler may
+   print, so the queue has multiple producers.  Its consumers,
+   the interrupt handler and threads that have to make room by
+   polling, run with interrupts off. */
+static struct ring txq;
+static uint8_t txq_data[TXQ_SIZE];
+
+/* Threads waiting for room in txq.  Every writer that sleeps
+   bumps writer_cnt and waits on txq_room, and the interrupt
+   handler wakes all of them once it has sent something. */
+static struct semaphore txq_room;
+static int writer_cnt;
+
+/* Bytes the UART accepts at once when its transmitter is empty:
+   UART_FIFO_SIZE if it has FIFOs, otherwise 1. */
+static size_t xmit_batch;
+
+/* Value last written to the Interrupt Enable Register. */
+static uint8_t ier;
 
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
@@ -68,10 +98,13 @@ init_poll (void)
 {
   ASSERT (mode == UNINIT);
   outb (IER_REG, 0);                    /* Turn off all interrupts. */
-  outb (FCR_REG, 0);                    /* Disable FIFO. */
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR); /* Enable FIFOs. */
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
-  intq_init (&txq);
+  xmit_batch = (inb (IIR_REG) & IIR_FIFO) == IIR_FIFO ? UART_FIFO_SIZE : 1;
+  ring_init (&txq, txq_data, 1, TXQ_SIZE);
+  sema_init (&txq_room, 0);
+  ier = 0;
   mode = POLL;
 } 
 
@@ -94,49 +127,76 @@ serial_init_queue (void)
   intr_set_level (old_level);
 }
 
-/* Sends BYTE to the serial port. */
+/* Sends the SIZE bytes in BUF to the serial port. */
 void
-serial_putc (uint8_t byte) 
+serial_write (const void *buf_, size_t size) 
 {
+  const uint8_t *buf = buf_;
   enum intr_level old_level = intr_disable ();
 
   if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+         use dumb polling to transmit the bytes. */
       if (mode == UNINIT)
         init_poll ();
-      putc_poll (byte); 
+      while (size-- > 0)
+        putc_poll (*buf++);
     }
   else 
     {
-      /* Otherwise, queue a byte and update the interrupt enable
-         register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
+      /* Otherwise, queue as much as fits, and wait for room for
+         the rest.  The interrupt handler sends the queue a FIFO
+         at a time, so the interrupt enable register only needs
+         updating when the queue was empty. */
+      for (;;)
         {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
+          size_t cnt = ring_enqueue_mp (&txq, buf, size);
+          buf += cnt;
+          size -= cnt;
+          write_ier ();
+          if (size == 0)
+            break;
+
+          if (old_level == INTR_OFF)
+            {
+              /* Interrupts are off and the transmit queue is
+                 full.  If we wanted to wait for the queue to
+                 empty, we'd have to reenable interrupts.
+                 That's impolite, so we'll send a character via
+                 polling instead. */
+              uint8_t byte;
+              ring_dequeue (&txq, &byte, 1);
+              putc_poll (byte);
+            }
+          else
+            {
+              writer_cnt++;
+              sema_down (&txq_room);
+            }
         }
-
-      intq_putc (&txq, byte); 
-      write_ier ();
     }
   
   intr_set_level (old_level);
 }
 
+/* Sends BYTE to the serial port. */
+void
+serial_putc (uint8_t byte) 
+{
+  serial_write (&byte, 1);
+}
+
 /* Flushes anything in the serial buffer out the port in polling
    mode. */
 void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
-  while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+  uint8_t byte;
+
+  while (ring_dequeue (&txq, &byte, 1) > 0)
+    putc_poll (byte);
   intr_set_level (old_level);
 }
 
@@ -172,25 +232,29 @@ set_serial (int bps)
   outb (LCR_REG, LCR_N81);
 }
 
-/* Update interrupt enable register. */
+/* Update interrupt enable register, if it needs to change. */
 static void
 write_ier (void) 
 {
-  uint8_t ier = 0;
+  uint8_t new_ier = 0;
 
   ASSERT (intr_get_level () == INTR_OFF);
 
   /* Enable transmit interrupt if we have any characters to
      transmit. */
-  if (!intq_empty (&txq))
-    ier |= IER_XMIT;
+  if (!ring_empty (&txq))
+    new_ier |= IER_XMIT;
 
   /* Enable receive interrupt if we have room to store any
      characters we receive. */
   if (!input_full ())
-    ier |= IER_RECV;
+    new_ier |= IER_RECV;
   
-  outb (IER_REG, ier);
+  if (new_ier != ier)
+    {
+      ier = new_ier;
+      outb (IER_REG, ier);
+    }
 }
 
 /* Polls the serial port until it's ready,
@@ -209,19 +273,40 @@ putc_poll (uint8_t byte)
 static void
 serial_interrupt (struct intr_frame *f UNUSED) 
 {
+  uint8_t batch[UART_FIFO_SIZE];
+  size_t cnt, i;
+
   /* Inquire about interrupt in UART.  Without this, we can
      occasionally miss an interrupt running under QEMU. */
   inb (IIR_REG);
 
-  /* As long as we have room to receive a byte, and the hardware
-     has a byte for us, receive a byte.  */
-  while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
-    input_putc (inb (RBR_REG));
+  /* As long as we have room to receive bytes, and the hardware
+     has bytes for us, receive them, a batch at a time.  */
+  for (;;)
+    {
+      size_t room = input_space ();
+
+      cnt = 0;
+      while (cnt < room && cnt < sizeof batch
+             && (inb (LSR_REG) & LSR_DR) != 0)
+        batch[cnt++] = inb (RBR_REG);
+      if (cnt == 0)
+        break;
+      input_put (batch, cnt);
+    }
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* If the hardware is ready to accept bytes for transmission,
+     fill its FIFO from the queue, and wake any writers waiting
+     for the room that makes. */
+  if ((inb (LSR_REG) & LSR_THRE) != 0)
+    {
+      cnt = ring_dequeue (&txq, batch, xmit_batch);
+      for (i = 0; i < cnt; i++)
+        outb (THR_REG, batch[i]);
+      if (cnt > 0)
+        for (; writer_cnt > 0; writer_cnt--)
+          sema_up (&txq_room);
+    }
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
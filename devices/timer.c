@@ -7,6 +7,8 @@
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/tsc.h"
+#include "threads/workqueue.h"
   
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -17,9 +19,58 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Number of timer ticks since OS booted. */
+/* Number of timer ticks since OS booted.  In one-shot mode,
+   only up to date as of the last timer interrupt; use
+   timer_ticks() instead. */
 static int64_t ticks;
 
+/* Number of timer interrupts since OS booted. */
+static int64_t interrupt_cnt;
+
+/* One-shot mode.
+
+   Once calibration is done, the PIT stops interrupting at a fixed
+   rate and instead runs in one-shot mode, programmed at each
+   interrupt for the next point at which anything has to happen:
+   the next tick, or the wakeup of a thread in a high-resolution
+   sleep (see timer_usleep()) if that comes first, even partway
+   through a tick.
+
+   If timer_tickless is true (the -tickless option), ticks
+   themselves are skipped unless something needs them: the next
+   tick is only programmed if a thread's time slice may have to
+   end, because another thread is ready; otherwise the earliest
+   wakeup of a sleeping thread is.  While the CPU is idle, or one
+   thread has it to itself, the timer interrupts only as often as
+   the PIT's 16-bit counter forces it to, every ONESHOT_MAX_TICKS
+   ticks.
+
+   Time is kept as PIT cycles since boot.  A tick is PIT_TICK
+   cycles, as in periodic mode, and between interrupts
+   timer_ticks() reads how far the running count has gone, so
+   ticks stay exact. */
+bool timer_tickless;
+
+/* PIT cycles per tick, and the most ticks one count can cover. */
+#define PIT_TICK ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+#define ONESHOT_MAX_TICKS (UINT16_MAX / PIT_TICK)
+
+/* Ticks over which to measure the TSC. */
+#define TSC_CALIBRATE_TICKS 10
+
+static bool oneshot;            /* In one-shot mode? */
+static int64_t oneshot_start;   /* PIT cycle at which the count started. */
+static unsigned oneshot_cnt;    /* PIT cycles counted. */
+static int64_t oneshot_deadline;        /* PIT cycle at which it ends. */
+
+static int64_t oneshot_now (void);
+static void oneshot_arm (int64_t deadline);
+static int64_t tsc_to_pit (uint64_t tsc);
+
+/* Number of TSC cycles per timer tick.
+   Initialized by timer_calibrate(). */
+static uint64_t tsc_per_tick;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
@@ -29,6 +80,7 @@ static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static void calibrate_tsc (void);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
@@ -39,7 +91,9 @@ timer_init (void)
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates loops_per_tick, used to implement brief delays,
+   and tsc_per_tick, used for high-resolution sleeps, and then
+   switches the timer to one-shot mode. */
 void
 timer_calibrate (void) 
 {
@@ -64,6 +118,8 @@ timer_calibrate (void)
       loops_per_tick |= test_bit;
 
   printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+  calibrate_tsc ();
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -71,11 +127,68 @@ int64_t
 timer_ticks (void) 
 {
   enum intr_level old_level = intr_disable ();
-  int64_t t = ticks;
+  int64_t t = oneshot ? oneshot_now () / PIT_TICK : ticks;
   intr_set_level (old_level);
   return t;
 }
 
+/* Returns the number of timer interrupts since the OS booted. */
+int64_t
+timer_interrupts (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  int64_t cnt = interrupt_cnt;
+  intr_set_level (old_level);
+  return cnt;
+}
+
+/* Returns the number of TSC cycles per second. */
+uint64_t
+timer_tsc_freq (void) 
+{
+  return tsc_per_tick * TIMER_FREQ;
+}
+
+/* Makes sure that the timer interrupts no later than at timer
+   tick TICK, or at the next tick if TICK has passed.  Interrupts
+   must be off. */
+void
+timer_wake_by (int64_t tick) 
+{
+  int64_t now;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Nothing to do before one-shot mode, when the timer
+     interrupts at every tick, or if it will interrupt by the end
+     of the current tick anyway. */
+  if (!oneshot || oneshot_deadline <= (ticks + 1) * PIT_TICK
+      || tick * PIT_TICK >= oneshot_deadline)
+    return;
+
+  now = oneshot_now () / PIT_TICK;
+  if (tick <= now)
+    tick = now + 1;
+  if (tick * PIT_TICK < oneshot_deadline)
+    oneshot_arm (tick * PIT_TICK);
+}
+
+/* Makes sure that the timer interrupts no later than when the
+   TSC reaches TSC.  Interrupts must be off. */
+void
+timer_wake_at_tsc (uint64_t tsc) 
+{
+  int64_t deadline;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!oneshot)
+    return;
+  deadline = tsc_to_pit (tsc);
+  if (deadline < oneshot_deadline)
+    oneshot_arm (deadline);
+}
+
 /* Returns the number of timer ticks elapsed since THEN, which
    should be a value once returned by timer_ticks(). */
 int64_t
@@ -99,7 +212,12 @@ timer_sleep (int64_t ticks)
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
-   turned on. */
+   turned on.
+
+   This and the other real-time sleeps below block the calling
+   thread until the TSC says the time is up, and the timer
+   interrupts then to wake it, to within a few microseconds, even
+   if that is partway through a tick. */
 void
 timer_msleep (int64_t ms) 
 {
@@ -165,19 +283,153 @@ timer_ndelay (int64_t ns)
 void
 timer_print_stats (void) 
 {
-  printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  printf ("Timer: %"PRId64" ticks, %"PRId64" interrupts\n",
+          timer_ticks (), timer_interrupts ());
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
-  ticks++;
-  thread_tick ();
+  int64_t elapsed = 1;
+  int64_t tick;
+
+  interrupt_cnt++;
+  if (oneshot)
+    {
+      int64_t now = oneshot_now () / PIT_TICK;
+      elapsed = now - ticks;
+      ticks = now;
+    }
+  else
+    ticks++;
+
+  for (tick = ticks - elapsed + 1; tick <= ticks; tick++)
+    thread_tick (tick);
 
   if (get_next_tick_to_wakeup() <= ticks) {
     thread_wakeup(ticks);
   }
+  if (workqueue_next_tick () <= ticks)
+    workqueue_timer (ticks);
+
+  if (oneshot)
+    {
+      uint64_t tsc = thread_wakeup_tsc (rdtsc ());
+      int64_t deadline;
+
+      /* Program the next interrupt. */
+      tick = (!timer_tickless || thread_tick_needed ()
+              ? ticks + 1 : get_next_tick_to_wakeup ());
+      if (workqueue_next_tick () < tick)
+        tick = workqueue_next_tick ();
+      deadline = (tick < ticks + ONESHOT_MAX_TICKS + 1
+                  ? tick * PIT_TICK : INT64_MAX);
+      if (tsc != UINT64_MAX && tsc_to_pit (tsc) < deadline)
+        deadline = tsc_to_pit (tsc);
+      oneshot_arm (deadline);
+    }
+}
+
+/* Switches the timer to one-shot mode.  Interrupts must be off. */
+static void
+start_oneshot (void)
+{
+  bool expired;
+  uint16_t count;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* In periodic mode, the count runs down from PIT_TICK to 1
+     in each tick. */
+  count = pit_read_count (&expired);
+  oneshot_start = ticks * PIT_TICK + (PIT_TICK - count);
+  oneshot_deadline = (ticks + 1) * PIT_TICK;
+  oneshot_cnt = oneshot_deadline - oneshot_start;
+  pit_start_oneshot (oneshot_cnt);
+  oneshot = true;
+}
+
+/* Returns the number of PIT cycles since boot, in one-shot mode.
+   Interrupts must be off. */
+static int64_t
+oneshot_now (void)
+{
+  bool expired;
+  uint16_t count = pit_read_count (&expired);
+
+  /* Once the count has expired, the counter wraps around and
+     keeps going, which tells us how far past the end we are. */
+  return oneshot_start + (expired
+                          ? oneshot_cnt + (uint16_t) (0x10000 - count)
+                          : oneshot_cnt - count);
+}
+
+/* Programs the PIT to interrupt at PIT cycle DEADLINE, or as
+   close to it as it can: no earlier than the next cycle and no
+   later than the 16-bit counter allows.  Interrupts must be
+   off. */
+static void
+oneshot_arm (int64_t deadline)
+{
+  int64_t now = oneshot_now ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (deadline <= now)
+    deadline = now + 1;
+  else if (deadline > now + UINT16_MAX)
+    deadline = now + UINT16_MAX;
+
+  oneshot_start = now;
+  oneshot_cnt = deadline - now;
+  oneshot_deadline = deadline;
+  pit_start_oneshot (oneshot_cnt);
+}
+
+/* Returns the PIT cycle at which the TSC will reach TSC, rounded
+   up, in one-shot mode.  Interrupts must be off. */
+static int64_t
+tsc_to_pit (uint64_t tsc)
+{
+  uint64_t now = rdtsc ();
+  uint64_t delta;
+
+  if (tsc <= now)
+    return oneshot_now ();
+
+  /* No count covers more than a tick or so; don't overflow. */
+  delta = tsc - now;
+  if (delta > tsc_per_tick * ONESHOT_MAX_TICKS * 2)
+    delta = tsc_per_tick * ONESHOT_MAX_TICKS * 2;
+  return oneshot_now () + DIV_ROUND_UP (delta * PIT_TICK, tsc_per_tick);
+}
+
+/* Measures tsc_per_tick against the periodic tick, then switches
+   the timer to one-shot mode. */
+static void
+calibrate_tsc (void) 
+{
+  enum intr_level old_level;
+  int64_t start;
+  uint64_t tsc;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  /* Count TSC cycles over TSC_CALIBRATE_TICKS whole ticks. */
+  start = ticks;
+  while (ticks == start)
+    barrier ();
+  start = ticks;
+  tsc = rdtsc ();
+  while (ticks < start + TSC_CALIBRATE_TICKS)
+    barrier ();
+  tsc_per_tick = (rdtsc () - tsc) / TSC_CALIBRATE_TICKS;
+  printf ("TSC runs at %'"PRIu64" Hz.\n", timer_tsc_freq ());
+
+  old_level = intr_disable ();
+  start_oneshot ();
+  intr_set_level (old_level);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -226,7 +478,18 @@ real_time_sleep (int64_t num, int32_t denom)
   int64_t ticks = num * TIMER_FREQ / denom;
 
   ASSERT (intr_get_level () == INTR_ON);
-  if (ticks > 0)
+  if (oneshot)
+    {
+      /* Block until the TSC has advanced by NUM/DENOM seconds'
+         worth.  Scale the numerator and denominator down by 1000
+         to avoid the possibility of overflow. */
+      int64_t tsc_per_ms = timer_tsc_freq () / 1000;
+
+      ASSERT (denom % 1000 == 0);
+      if (num > 0)
+        thread_sleep_tsc (rdtsc () + num * tsc_per_ms / (denom / 1000));
+    }
+  else if (ticks > 0)
     {
       /* We're waiting for at least one full timer tick.  Use
          timer_sleep() because it will yield the CPU to other
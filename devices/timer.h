@@ -4,14 +4,23 @@
 #include <round.h>
 #include <stdint.h>
 
-/* Number of timer interrupts per second. */
+#include <stdbool.h>
+
+/* Number of timer ticks per second. */
 #define TIMER_FREQ 100
 
+/* Take timer interrupts only when needed? */
+extern bool timer_tickless;
+
 void timer_init (void);
 void timer_calibrate (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
+int64_t timer_interrupts (void);
+uint64_t timer_tsc_freq (void);
+void timer_wake_by (int64_t tick);
+void timer_wake_at_tsc (uint64_t tsc);
 
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
@@ -5,7 +5,10 @@
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -54,14 +57,23 @@ byte_to_sector (const struct inode *inode, off_t pos)
 }
 
 /* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
+   returns the same `struct inode'.  Looking an inode up in the
+   list takes open_inodes_lock for reading, adding or removing
+   one takes it for writing.  Disk I/O is never done with the
+   lock held. */
 static struct list open_inodes;
+static struct rwlock open_inodes_lock;
+
+/* Cache of `struct inode's. */
+static struct kmem_cache inode_cache;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  rwlock_init (&open_inodes_lock);
+  kmem_cache_init (&inode_cache, "inode", sizeof (struct inode), NULL, NULL);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -105,39 +117,62 @@ inode_create (block_sector_t sector, off_t length)
   return success;
 }
 
-/* Reads an inode from SECTOR
-   and returns a `struct inode' that contains it.
-   Returns a null pointer if memory allocation fails. */
-struct inode *
-inode_open (block_sector_t sector)
+/* Returns the open inode for SECTOR, reopened, or a null pointer
+   if there is none.  open_inodes_lock must be held. */
+static struct inode *
+lookup_open_inode (block_sector_t sector)
 {
   struct list_elem *e;
-  struct inode *inode;
 
-  /* Check whether this inode is already open. */
   for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
        e = list_next (e)) 
     {
-      inode = list_entry (e, struct inode, elem);
+      struct inode *inode = list_entry (e, struct inode, elem);
       if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+        return inode_reopen (inode);
     }
+  return NULL;
+}
+
+/* Reads an inode from SECTOR
+   and returns a `struct inode' that contains it.
+   Returns a null pointer if memory allocation fails. */
+struct inode *
+inode_open (block_sector_t sector)
+{
+  struct inode *inode, *open;
+
+  /* Check whether this inode is already open. */
+  rwlock_acquire_read (&open_inodes_lock);
+  inode = lookup_open_inode (sector);
+  rwlock_release_read (&open_inodes_lock);
+  if (inode != NULL)
+    return inode;
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (&inode_cache);
   if (inode == NULL)
     return NULL;
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
   block_read (fs_device, inode->sector, &inode->data);
+
+  /* Check again, since another thread may have opened it while
+     we were reading, and if so, use its copy instead. */
+  rwlock_acquire_write (&open_inodes_lock);
+  open = lookup_open_inode (sector);
+  if (open == NULL)
+    list_push_front (&open_inodes, &inode->elem);
+  rwlock_release_write (&open_inodes_lock);
+  if (open != NULL)
+    {
+      kmem_cache_free (&inode_cache, inode);
+      inode = open;
+    }
   return inode;
 }
 
@@ -146,7 +181,13 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      /* Several readers of open_inodes may reopen an inode at
+         once, so the increment must be atomic. */
+      enum intr_level old_level = intr_disable ();
+      inode->open_cnt++;
+      intr_set_level (old_level);
+    }
   return inode;
 }
 
@@ -163,16 +204,37 @@ inode_get_inumber (const struct inode *inode)
 void
 inode_close (struct inode *inode) 
 {
+  enum intr_level old_level;
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
+  /* Drop a reference that is not the last one without touching
+     open_inodes. */
+  old_level = intr_disable ();
+  last = inode->open_cnt == 1;
+  if (!last)
+    inode->open_cnt--;
+  intr_set_level (old_level);
+  if (!last)
+    return;
+
+  /* The last reference may be taken again through open_inodes
+     until the inode is removed from it, so decrement it with
+     lookups excluded. */
+  rwlock_acquire_write (&open_inodes_lock);
+  old_level = intr_disable ();
+  last = --inode->open_cnt == 0;
+  intr_set_level (old_level);
+  if (last)
+    list_remove (&inode->elem);
+  rwlock_release_write (&open_inodes_lock);
+
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
@@ -181,7 +243,7 @@ inode_close (struct inode *inode)
                             bytes_to_sectors (inode->data.length)); 
         }
 
-      free (inode); 
+      kmem_cache_free (&inode_cache, inode); 
     }
 }
 
@@ -22,6 +22,23 @@ typedef unsigned long elem_type;
 /* Number of bits in an element. */
 #define ELEM_BITS (sizeof (elem_type) * CHAR_BIT)
 
+/* Single-instruction read-modify-writes of an element, which are
+   atomic on a uniprocessor machine.  They need i386 assembly;
+   elsewhere, as when utils/palloc-replay builds this file for a
+   single-threaded host program, plain C will do. */
+#ifdef __i386__
+#define ELEM_OR(ELEM, MASK) \
+        asm ("orl %1, %0" : "=m" (ELEM) : "r" (MASK) : "cc")
+#define ELEM_AND(ELEM, MASK) \
+        asm ("andl %1, %0" : "=m" (ELEM) : "r" (MASK) : "cc")
+#define ELEM_XOR(ELEM, MASK) \
+        asm ("xorl %1, %0" : "=m" (ELEM) : "r" (MASK) : "cc")
+#else
+#define ELEM_OR(ELEM, MASK) ((ELEM) |= (MASK))
+#define ELEM_AND(ELEM, MASK) ((ELEM) &= (MASK))
+#define ELEM_XOR(ELEM, MASK) ((ELEM) ^= (MASK))
+#endif
+
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
    simulates an array of bits. */
@@ -71,6 +88,137 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns an elem_type in which the bits from BIT_IDX % ELEM_BITS
+   up to the top of the element are turned on. */
+static inline elem_type
+high_mask (size_t bit_idx)
+{
+  return (elem_type) -1 << (bit_idx % ELEM_BITS);
+}
+
+/* Returns an elem_type in which the bits below BIT_IDX %
+   ELEM_BITS are turned on, or all bits if BIT_IDX is a multiple
+   of ELEM_BITS. */
+static inline elem_type
+low_mask (size_t bit_idx)
+{
+  int bits = bit_idx % ELEM_BITS;
+  return bits ? ((elem_type) 1 << bits) - 1 : (elem_type) -1;
+}
+
+/* Returns the number of bits that are set in X.
+
+   We can't use __builtin_popcount() because, without hardware
+   POPCNT, GCC turns it into a call into libgcc, which the kernel
+   doesn't link against.  So count the bits in parallel inside
+   the register instead. */
+static inline unsigned
+popcount (elem_type x)
+{
+  x = x - ((x >> 1) & (elem_type) 0x5555555555555555ULL);
+  x = (x & (elem_type) 0x3333333333333333ULL)
+      + ((x >> 2) & (elem_type) 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & (elem_type) 0x0f0f0f0f0f0f0f0fULL;
+  return (x * (elem_type) 0x0101010101010101ULL)
+         >> (ELEM_BITS - CHAR_BIT);
+}
+
+/* Returns the index of the least significant set bit in X,
+   which must be nonzero.  This compiles into a single BSF
+   instruction; see [IA32-v2a] "BSF". */
+static inline unsigned
+ctz (elem_type x)
+{
+  ASSERT (x != 0);
+  return __builtin_ctzl (x);
+}
+
+/* Returns the index of the most significant set bit in X, which
+   must be nonzero.  This compiles into a single BSR instruction;
+   see [IA32-v2a] "BSR". */
+static inline unsigned
+msb (elem_type x)
+{
+  ASSERT (x != 0);
+  return ELEM_BITS - 1 - __builtin_clzl (x);
+}
+
+/* Returns the element of B that contains bit BIT_IDX, with every
+   bit inverted if VALUE is false, so that bits equal to VALUE
+   read as 1 either way. */
+static inline elem_type
+elem_value (const struct bitmap *b, size_t bit_idx, bool value)
+{
+  elem_type e = b->bits[elem_idx (bit_idx)];
+  return value ? e : ~e;
+}
+
+/* Returns the index of the first bit at or after START in B that
+   is set to VALUE, or the size of B if there is none.
+
+   Works a whole element at a time: elements holding no VALUE bit
+   are skipped with a single comparison, and the first matching
+   bit within an element is found with count-trailing-zeros. */
+static size_t
+find_bit (const struct bitmap *b, size_t start, bool value)
+{
+  size_t idx, last;
+  elem_type e;
+
+  if (start >= b->bit_cnt)
+    return b->bit_cnt;
+
+  idx = elem_idx (start);
+  last = elem_cnt (b->bit_cnt) - 1;
+  e = elem_value (b, start, value) & high_mask (start);
+  while (e == 0)
+    {
+      if (++idx > last)
+        return b->bit_cnt;
+      e = value ? b->bits[idx] : ~b->bits[idx];
+    }
+
+  start = idx * ELEM_BITS + ctz (e);
+  return start < b->bit_cnt ? start : b->bit_cnt;
+}
+
+/* Returns the index of the bit just after the last bit before
+   END in B that is set to VALUE, or 0 if there is none.  This is
+   find_bit() running backward. */
+static size_t
+find_bit_back (const struct bitmap *b, size_t end, bool value)
+{
+  size_t idx;
+  elem_type e;
+
+  ASSERT (end <= b->bit_cnt);
+  if (end == 0)
+    return 0;
+
+  idx = elem_idx (end);
+  e = end % ELEM_BITS ? elem_value (b, end, value) & low_mask (end) : 0;
+  while (e == 0)
+    {
+      if (idx-- == 0)
+        return 0;
+      e = value ? b->bits[idx] : ~b->bits[idx];
+    }
+  return idx * ELEM_BITS + msb (e) + 1;
+}
+
+/* Sets or clears, according to VALUE, the bits of the element of
+   B at index IDX that are turned on in MASK.  Like bitmap_mark()
+   and bitmap_reset(), this is a single read-modify-write
+   instruction, so it is atomic on a uniprocessor machine. */
+static inline void
+elem_set (struct bitmap *b, size_t idx, elem_type mask, bool value)
+{
+  if (value)
+    ELEM_OR (b->bits[idx], mask);
+  else
+    ELEM_AND (b->bits[idx], ~mask);
+}
 
 /* Creation and destruction. */
 
@@ -86,6 +234,7 @@ bitmap_create (size_t bit_cnt)
     {
       b->bit_cnt = bit_cnt;
       b->bits = malloc (byte_cnt (bit_cnt));
+      b->last_idx = 0;
       if (b->bits != NULL || bit_cnt == 0)
         {
           bitmap_set_all (b, false);
@@ -121,7 +270,7 @@ struct bitmap* bitmap_modify_idx(struct bitmap *b,size_t idx){
 }
 //jjeong
 /* return the lastest allocated page index */
-struct bitmap* bitmap_lastest_idx(struct bitmap *b){
+size_t bitmap_lastest_idx(struct bitmap *b){
 	return b->last_idx;
 }
 //jjeong
@@ -132,231 +281,46 @@ struct bitmap* bitmap_lastest_idx(struct bitmap *b){
  * 2. if there is not enough pages,
  *   scan again starting from index 0
  * 3. if there is not enough pages either,
- *  return the page index 0.  
+ *  return BITMAP_ERROR.
  * */
-size_t bitmap_scan_NF(struct bitmap *b, size_t start, size_t cnt, bool value){
- ASSERT (start <= b->bit_cnt);
- ASSERT (start + cnt <= b->bit_cnt);
- ASSERT (b != NULL);
- 
- size_t page_idx =0;
-
-	start = bitmap_lastest_idx(b); 
-	if(start+cnt <= b->bit_cnt)
-		page_idx = bitmap_scan(b, start, cnt, false);
-	if(page_idx==BITMAP_ERROR || start + cnt > b->bit_cnt){
-		page_idx = bitmap_scan(b, 0, cnt, false);
-		if(page_idx==BITMAP_ERROR)
-			page_idx =0;
-	}
-	return page_idx;
-}
-//jjeong
-/* find index for bestfit
- * 1. find every space that can be allocated
- * 2. select the smallest splace among those spaces
- * */
-size_t bitmap_scan_BF(struct bitmap *b, size_t start, size_t cnt, bool value){
+size_t bitmap_scan_NF(struct bitmap *b, size_t start UNUSED, size_t cnt, bool value){
+  size_t page_idx = BITMAP_ERROR;
 
   ASSERT (b != NULL);
-  ASSERT (start <= b->bit_cnt);
-  ASSERT (start + cnt <= b->bit_cnt);
-
-  size_t idx=start,page_idx=start;
-  size_t min=b->bit_cnt;
-  size_t last = b->bit_cnt - cnt;
-  size_t len =0 ;
-  for(; start<=last ; start=page_idx+len){
-	/* find page index whether there is enough space for page allocation*/
-  	page_idx = bitmap_scan(b,start,cnt,value);
-       if(page_idx != BITMAP_ERROR){
-	        len =0 ;
-		/*if there is enough space check its length(len)*/
-       		for(size_t i =0 ; page_idx+i<b->bit_cnt ;i++){
-			if(bitmap_test(b,page_idx+i)==value)
-				len ++;
-			else
-				break;
-		}	
-		/*if its length(len) is smaller than stored length (min)
-		 * change the stored length to current length (len) and 
-		 * change the page index (idx) in to len's index (page_idx) */
-       		if(min>len){
-			min = len;
-			idx = page_idx;
-		}
-         }else 	return idx;
- 
-     }
-  return idx;
-}
-
-//jjeong
- #define BUDDY_INDEX 10  /* this index is for page 1,2,4,8,16 ... 512 */
- #define USED_INDEX 32	/* this index is for  USED_SIZE is 16 and for represent 512 page we need 32 of this */
- #define USED_SIZE 16	/* the total page unusage is represented with bits this size is 16 */
-  struct buddy_info{ uint16_t used_bud[USED_INDEX]; };
-  struct buddy_info bud[BUDDY_INDEX];
-//jjeong 
-/* initialize the the buddy structure*/
-void buddy_info_init(){
-	for(size_t i=0; i<BUDDY_INDEX;i++){
-		for(size_t j=0; j<USED_INDEX;j++)
-			bud[i].used_bud[j]=0;
-	}
-	/* If no page is allocated, the size of 
-	 * the buddy is 512 because the memory is not cut.
-	 * Save this index */
-	bud[BUDDY_INDEX-1].used_bud[0]=1;
-}
-//jjeong
-/* check if there is any bud for allocation 
- * ex) if this is for bud[2] :
- *  This function is for checking whether there is any 
- *  unused buddy that is size 4 .
- * */
-bool buddy_empty(struct buddy_info bud){
-	
-	for(size_t j=0; j<USED_INDEX;j++){
-		if(bud.used_bud[j]!=0)
-			return false;
-	}
-
-	return true;
-}
-//jjeong
-/* Find the smallest page index for buddy
- * ex) if this is for bud[2] :
- *  This function is for find the smallest unused page index.
- *  So, if there is unused buddy which size is 4, its page index 
- *  would be set 1 in bud[2] - If there page index 0 and 8
- *   can be used, bud[2].used_bud[0] will be 00000000100000001
- *   in this situation 0 is smallest unused page index 
- *   and we have to return 0.  
- * */
-size_t find_first_buddy_idx(struct buddy_info* bud){
-
-	for(size_t i =0; i<USED_INDEX;i++){
-		if(bud->used_bud[i]!=0){
-		size_t tmp = bud->used_bud[i];
-		for(size_t j=0 ; j<USED_SIZE;j++){
-			size_t remainder = tmp%2;
-			if(remainder){
-			   bud->used_bud[i] -= 1<<j;
-			   tmp= (i*USED_SIZE+j); 
-			   return tmp;
-			}
-			 tmp = tmp/2;
-		 }
-		}
-	
-	}	
-	return 0;
-}
-//jjeong
-/*This finction is recursive function
- * and this is for finding the page index
- *  which has size size ^bud_idx 
- * */
-size_t find_buddy_idx(size_t bud_idx){
-	
-	if(bud_idx==BUDDY_INDEX)
-		return NULL;
 
-	/* If there is no unused buddy make the buddy 
-	 * by dividing 2^(i+1)
-	 * */
-	if(buddy_empty(bud[bud_idx])){
-		size_t idx;
-		idx =find_buddy_idx(bud_idx+1);
-		bud[bud_idx].used_bud[idx/USED_SIZE]=1<<(idx%USED_SIZE);
-		idx = idx + (1<<bud_idx);
-		bud[bud_idx].used_bud[idx/USED_SIZE]+=1<<(idx%USED_SIZE);	
-	}
-
-		return find_first_buddy_idx(&bud[bud_idx]); 
+  start = b->last_idx;
+  if (start + cnt <= b->bit_cnt)
+    page_idx = bitmap_scan (b, start, cnt, value);
+  if (page_idx == BITMAP_ERROR)
+    page_idx = bitmap_scan (b, 0, cnt, value);
+  return page_idx;
 }
-
 //jjeong
-/* find the value idx which is 
- * 2^idx >=cnt>2^(idx-1)
- * and call function to find page index
- * for size 2^idx
+/* find index for bestfit
+ * 1. walk every run of VALUE bits, one run per step
+ * 2. select the smallest run that still holds CNT bits;
+ *    an exact fit can't be beaten, so stop there
+ * returns BITMAP_ERROR if no run is long enough.
  * */
-size_t bitmap_scan_BUDDY(struct bitmap *b, size_t start, size_t cnt, bool value){
+size_t bitmap_scan_BF(struct bitmap *b, size_t start, size_t cnt, bool value){
+  size_t idx = BITMAP_ERROR;
+  size_t min = SIZE_MAX;
+  size_t page_idx, len;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
-  ASSERT (start + cnt <= b->bit_cnt);
-  size_t page_idx=start,idx;
-    for(idx=0; idx<BUDDY_INDEX;idx++){
-    	if(cnt<=(1<<idx))
-		break;
-    }
-	page_idx = find_buddy_idx(idx);
-  return page_idx;
-}
 
-//jjeong
-/* This function is recursive function 
- * 1. If some pages got freed update with size 2^i
- * the buddy structure(bud[i]) 
- * 2. and find its buddy
- * 3. and if its buddy is unused (set to 1) either
- * merge it and update buddy structure(bud[i+1])
- * 4. recursively repeat this procedure until its buddy is used 
- * */
-void merge_bud(size_t page_idx, size_t page_cnt){
-	size_t g_idx;
-	size_t bud_idx;
-	
-	if(page_cnt == BUDDY_INDEX)
-		return NULL;
-	bud[page_cnt].used_bud[page_idx/USED_SIZE] += 1<<(page_idx%USED_SIZE);
-	g_idx=page_idx /(1<<page_cnt);	
-
-	if(g_idx%2){
-		bud_idx=page_idx -(1<<page_cnt);
-		size_t tmp = bud[page_cnt].used_bud[bud_idx/USED_SIZE];
-
-		if(tmp&(1<<(bud_idx%USED_SIZE))){
-			bud[page_cnt].used_bud[page_idx/USED_SIZE] -= 1<<(page_idx%USED_SIZE);
-			bud[page_cnt].used_bud[bud_idx/USED_SIZE] -= 1<<(bud_idx%USED_SIZE);
-
-			return merge_bud(bud_idx ,page_cnt+1);
-		}
-		else
-			return NULL;
-	}
-	else{
-		bud_idx=page_idx + (1<<page_cnt);
-		size_t tmp = bud[page_cnt].used_bud[bud_idx/USED_SIZE];
-		if(tmp&(1<<(bud_idx%USED_SIZE))){
-			bud[page_cnt].used_bud[page_idx/USED_SIZE] -= 1<<(page_idx%USED_SIZE);
-			bud[page_cnt].used_bud[bud_idx/USED_SIZE] -= 1<<(bud_idx%USED_SIZE);
-
-			return merge_bud(page_idx,page_cnt+1);
-		}
-		else
-			return NULL;
-	}
-}
-//jjeong
-/* find the value which is
- * 2^idx>= page_cnt > 2^(idx-1)
- * and call the function for merge the buddy
- * if it is necessary.
- * */
-void
-bitmap_merge_buddy (size_t page_idx, size_t page_cnt){
-	size_t idx;
-    	for(idx=0; idx<BUDDY_INDEX;idx++){
-    		if(page_cnt<=(1<<idx))
-			break;
-   	 }
-	
-	merge_bud(page_idx, idx);
-	return NULL;
+  for (page_idx = bitmap_next_run (b, start, value, &len);
+       page_idx != BITMAP_ERROR;
+       page_idx = bitmap_next_run (b, page_idx + len, value, &len))
+    if (len >= cnt && len < min)
+      {
+        min = len;
+        idx = page_idx;
+        if (len == cnt)
+          break;
+      }
+  return idx;
 }
 
 /* Returns the number of bytes required to accomodate a bitmap
@@ -412,7 +376,7 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
   /* This is equivalent to `b->bits[idx] |= mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
-  asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  ELEM_OR (b->bits[idx], mask);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -425,7 +389,7 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
   /* This is equivalent to `b->bits[idx] &= ~mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
-  asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  ELEM_AND (b->bits[idx], ~mask);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -440,7 +404,7 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
   /* This is equivalent to `b->bits[idx] ^= mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
-  asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  ELEM_XOR (b->bits[idx], mask);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -467,14 +431,27 @@ bitmap_set_all (struct bitmap *b, bool value)
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t end, idx, last;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  if (cnt == 0)
+    return;
+
+  end = start + cnt;
+  idx = elem_idx (start);
+  last = elem_idx (end - 1);
+  if (idx == last)
+    elem_set (b, idx, high_mask (start) & low_mask (end), value);
+  else 
+    {
+      elem_set (b, idx, high_mask (start), value);
+      while (++idx < last)
+        elem_set (b, idx, (elem_type) -1, value);
+      elem_set (b, last, low_mask (end), value);
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -482,16 +459,26 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end, idx, last, value_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  if (cnt == 0)
+    return 0;
+
+  end = start + cnt;
+  idx = elem_idx (start);
+  last = elem_idx (end - 1);
+  if (idx == last)
+    return popcount (elem_value (b, start, value)
+                     & high_mask (start) & low_mask (end));
+
+  value_cnt = popcount (elem_value (b, start, value) & high_mask (start));
+  while (++idx < last)
+    value_cnt += popcount (value ? b->bits[idx] : ~b->bits[idx]);
+  value_cnt += popcount (elem_value (b, end - 1, value) & low_mask (end));
   return value_cnt;
 }
 
@@ -500,16 +487,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return cnt > 0 && find_bit (b, start, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -541,24 +523,80 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+
+   Rather than testing CNT bits at every candidate position, this
+   hops from run to run: it finds the next VALUE bit, measures the
+   run that starts there, and if the run is too short resumes
+   after its end.  Both steps go a whole element at a time. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+      while (i <= last)
+        {
+          size_t end;
+
+          i = find_bit (b, i, value);
+          if (i > last)
+            break;
+          end = find_bit (b, i, !value);
+          if (end - i >= cnt)
+            return i;
+          i = end;
+        }
     }
   return BITMAP_ERROR;
 }
 
+/* Finds the first run of consecutive bits in B at or after START
+   that are all set to VALUE and returns the index of its first
+   bit, storing the run's length into *CNT.  The run extends as
+   far as it goes, so it is always followed by a !VALUE bit or by
+   the end of B.
+   If there is no VALUE bit at or after START, returns
+   BITMAP_ERROR and stores 0 into *CNT. */
+size_t
+bitmap_next_run (const struct bitmap *b, size_t start, bool value,
+                 size_t *cnt)
+{
+  size_t end;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (cnt != NULL);
+
+  start = find_bit (b, start, value);
+  if (start >= b->bit_cnt)
+    {
+      *cnt = 0;
+      return BITMAP_ERROR;
+    }
+  end = find_bit (b, start, !value);
+  *cnt = end - start;
+  return start;
+}
+
+/* Returns the index of the first bit of the run of equal bits in
+   B that contains bit IDX, that is, how far back from IDX the
+   bits keep the value of bit IDX. */
+size_t
+bitmap_run_start (const struct bitmap *b, size_t idx)
+{
+  ASSERT (b != NULL);
+  ASSERT (idx < b->bit_cnt);
+
+  return find_bit_back (b, idx, !bitmap_test (b, idx));
+}
+
 /* Finds the first group of CNT consecutive bits in B at or after
    START that are all set to VALUE, flips them all to !VALUE,
    and returns the index of the first bit in the group.
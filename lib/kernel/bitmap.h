@@ -33,17 +33,17 @@ bool bitmap_none (const struct bitmap *, size_t start, size_t cnt);
 bool bitmap_all (const struct bitmap *, size_t start, size_t cnt);
 //jjeong
 struct bitmap* bitmap_modify_idx(struct bitmap *b,size_t idx);
-struct bitmap* bitmap_lastest_idx(struct bitmap *b);
+size_t bitmap_lastest_idx(struct bitmap *b);
 size_t bitmap_scan_NF(struct bitmap *b, size_t start, size_t cnt, bool value);
 size_t bitmap_scan_BF(struct bitmap *b, size_t start, size_t cnt, bool value);
-size_t bitmap_scan_BUDDY(struct bitmap *b, size_t start, size_t cnt, bool value);
-void buddy_info_init();
-void bitmap_merge_buddy (size_t page_idx, size_t page_cnt);
 	
 /* Finding set or unset bits. */
 #define BITMAP_ERROR SIZE_MAX
 size_t bitmap_scan (const struct bitmap *, size_t start, size_t cnt, bool);
 size_t bitmap_scan_and_flip (struct bitmap *, size_t start, size_t cnt, bool);
+size_t bitmap_next_run (const struct bitmap *, size_t start, bool,
+                        size_t *cnt);
+size_t bitmap_run_start (const struct bitmap *, size_t idx);
 
 /* File input and output. */
 #ifdef FILESYS
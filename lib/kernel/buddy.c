@@ -0,0 +1,289 @@
+#include "buddy.h"
+#include <debug.h>
+#include <limits.h>
+#include <round.h>
+#include <stdio.h>
+
+/* Number of orders we can represent.  An order-K block holds
+   2**K pages, so this covers any PAGE_CNT that fits in a
+   size_t. */
+#define BUDDY_ORDERS (sizeof (size_t) * CHAR_BIT)
+
+/* Null link in a free list. */
+#define BLOCK_NONE SIZE_MAX
+
+/* What a page is, as far as the buddy allocator knows. */
+enum page_state
+  {
+    PAGE_INNER,         /* Not the first page of any block. */
+    PAGE_FREE,          /* First page of a free block. */
+    PAGE_USED           /* First page of an allocated block. */
+  };
+
+/* Per-page state.  Only the first page of a block uses it. */
+struct buddy_page
+  {
+    size_t prev;        /* Previous free block of the same order. */
+    size_t next;        /* Next free block of the same order. */
+    uint8_t order;      /* Order of the block. */
+    uint8_t state;      /* An enum page_state. */
+  };
+
+/* Buddy allocator. */
+struct buddy
+  {
+    size_t page_cnt;                    /* Number of pages managed. */
+    unsigned max_order;                 /* Largest order that fits. */
+    size_t free_orders;                 /* Bit K set if free[K] nonempty. */
+    size_t free[BUDDY_ORDERS];          /* Free block lists, by order. */
+    struct buddy_page *pages;           /* Per-page state. */
+  };
+
+/* Returns the smallest order whose blocks hold CNT pages. */
+static unsigned
+order_for (size_t cnt)
+{
+  unsigned order = 0;
+  while (((size_t) 1 << order) < cnt)
+    order++;
+  return order;
+}
+
+/* Returns the order of the largest block that can start at page
+   IDX without running past page END. */
+static unsigned
+order_at (size_t idx, size_t end)
+{
+  unsigned order = 0;
+  while (order + 1 < BUDDY_ORDERS
+         && idx % ((size_t) 1 << (order + 1)) == 0
+         && ((size_t) 1 << (order + 1)) <= end - idx)
+    order++;
+  return order;
+}
+
+/* Adds the block of the given ORDER at IDX to B's free list for
+   that order. */
+static void
+push_free (struct buddy *b, size_t idx, unsigned order)
+{
+  struct buddy_page *p = &b->pages[idx];
+
+  p->order = order;
+  p->state = PAGE_FREE;
+  p->prev = BLOCK_NONE;
+  p->next = b->free[order];
+  if (p->next != BLOCK_NONE)
+    b->pages[p->next].prev = idx;
+  b->free[order] = idx;
+  b->free_orders |= (size_t) 1 << order;
+}
+
+/* Removes the free block at IDX from B's free list for its
+   order. */
+static void
+unlink_free (struct buddy *b, size_t idx)
+{
+  struct buddy_page *p = &b->pages[idx];
+
+  ASSERT (p->state == PAGE_FREE);
+  if (p->prev != BLOCK_NONE)
+    b->pages[p->prev].next = p->next;
+  else
+    b->free[p->order] = p->next;
+  if (p->next != BLOCK_NONE)
+    b->pages[p->next].prev = p->prev;
+  if (b->free[p->order] == BLOCK_NONE)
+    b->free_orders &= ~((size_t) 1 << p->order);
+  p->state = PAGE_INNER;
+}
+
+/* Frees the block of the given ORDER at IDX, merging it with its
+   buddy for as long as the buddy is free too.  The buddy of the
+   order-K block at IDX is the one at IDX ^ 2**K. */
+static void
+free_block (struct buddy *b, size_t idx, unsigned order)
+{
+  while (order < b->max_order)
+    {
+      size_t size = (size_t) 1 << order;
+      size_t buddy = idx ^ size;
+
+      if (buddy + size > b->page_cnt
+          || b->pages[buddy].state != PAGE_FREE
+          || b->pages[buddy].order != order)
+        break;
+
+      unlink_free (b, buddy);
+      b->pages[idx].state = PAGE_INNER;
+      idx &= ~size;
+      order++;
+    }
+  push_free (b, idx, order);
+}
+
+/* Returns the number of bytes needed for a buddy allocator over
+   PAGE_CNT pages (for use with buddy_create_in_buf()). */
+size_t
+buddy_buf_size (size_t page_cnt)
+{
+  return ROUND_UP (sizeof (struct buddy), sizeof (size_t))
+         + page_cnt * sizeof (struct buddy_page);
+}
+
+/* Creates and returns a buddy allocator for PAGE_CNT pages, all
+   free, in the BYTE_CNT bytes of storage preallocated at BLOCK.
+   BYTE_CNT must be at least buddy_buf_size(PAGE_CNT). */
+struct buddy *
+buddy_create_in_buf (size_t page_cnt, void *block, size_t byte_cnt UNUSED)
+{
+  struct buddy *b = block;
+
+  ASSERT (byte_cnt >= buddy_buf_size (page_cnt));
+
+  b->page_cnt = page_cnt;
+  b->max_order = page_cnt > 0 ? order_at (0, page_cnt) : 0;
+  b->pages = (struct buddy_page *)
+    ((uint8_t *) block + ROUND_UP (sizeof *b, sizeof (size_t)));
+  buddy_reset (b);
+  return b;
+}
+
+/* Makes every page in B free again, forgetting all allocated
+   blocks. */
+void
+buddy_reset (struct buddy *b)
+{
+  size_t i;
+
+  ASSERT (b != NULL);
+
+  b->free_orders = 0;
+  for (i = 0; i < BUDDY_ORDERS; i++)
+    b->free[i] = BLOCK_NONE;
+  for (i = 0; i < b->page_cnt; i++)
+    b->pages[i].state = PAGE_INNER;
+  buddy_free_range (b, 0, b->page_cnt);
+}
+
+/* Allocates a block of at least CNT pages from B and returns the
+   index of its first page, or BUDDY_ERROR if no block is large
+   enough.  The block holds buddy_round(CNT) pages.
+
+   The smallest free block that fits is split in half again and
+   again, freeing the upper halves, until it is just big
+   enough. */
+size_t
+buddy_alloc (struct buddy *b, size_t cnt)
+{
+  unsigned want, order;
+  size_t candidates, idx;
+
+  ASSERT (b != NULL);
+
+  if (cnt == 0 || cnt > b->page_cnt)
+    return BUDDY_ERROR;
+  want = order_for (cnt);
+  candidates = b->free_orders & ~(((size_t) 1 << want) - 1);
+  if (candidates == 0)
+    return BUDDY_ERROR;
+
+  order = __builtin_ctzl (candidates);
+  idx = b->free[order];
+  unlink_free (b, idx);
+  while (order > want)
+    {
+      order--;
+      push_free (b, idx + ((size_t) 1 << order), order);
+    }
+
+  b->pages[idx].order = order;
+  b->pages[idx].state = PAGE_USED;
+  return idx;
+}
+
+/* Frees the block that buddy_alloc() returned as IDX and returns
+   the number of pages in it. */
+size_t
+buddy_free (struct buddy *b, size_t idx)
+{
+  unsigned order;
+
+  ASSERT (b != NULL);
+  ASSERT (idx < b->page_cnt);
+  ASSERT (b->pages[idx].state == PAGE_USED);
+
+  order = b->pages[idx].order;
+  free_block (b, idx, order);
+  return (size_t) 1 << order;
+}
+
+/* Frees the CNT pages starting at START in B, which need not be
+   a block returned by buddy_alloc() but must not be free
+   already.  The range is cut into the largest aligned blocks
+   that it holds, each of which is merged with its buddies. */
+void
+buddy_free_range (struct buddy *b, size_t start, size_t cnt)
+{
+  size_t end = start + cnt;
+
+  ASSERT (b != NULL);
+  ASSERT (end <= b->page_cnt);
+
+  while (start < end)
+    {
+      unsigned order = order_at (start, end);
+      free_block (b, start, order);
+      start += (size_t) 1 << order;
+    }
+}
+
+/* Returns the number of pages managed by B. */
+size_t
+buddy_size (const struct buddy *b)
+{
+  return b->page_cnt;
+}
+
+/* Returns the number of pages in the block that buddy_alloc()
+   would use to satisfy a request for CNT pages. */
+size_t
+buddy_round (size_t cnt)
+{
+  return (size_t) 1 << order_for (cnt);
+}
+
+/* Returns the number of pages in the largest free block in B, or
+   0 if there are none. */
+size_t
+buddy_largest (const struct buddy *b)
+{
+  unsigned order;
+
+  if (b->free_orders == 0)
+    return 0;
+  for (order = b->max_order; (b->free_orders & ((size_t) 1 << order)) == 0;
+       order--)
+    continue;
+  return (size_t) 1 << order;
+}
+
+/* Prints the number of free blocks of each order in B. */
+void
+buddy_dump (const struct buddy *b)
+{
+  unsigned order;
+
+  printf ("========== buddy dump start ==========\n");
+  for (order = 0; order <= b->max_order; order++)
+    {
+      size_t cnt = 0;
+      size_t idx;
+
+      for (idx = b->free[order]; idx != BLOCK_NONE; idx = b->pages[idx].next)
+        cnt++;
+      printf ("order %2u (%5zu pages): %zu free\n",
+              order, (size_t) 1 << order, cnt);
+    }
+  printf ("========== buddy dump end ==========\n");
+}
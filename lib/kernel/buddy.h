@@ -0,0 +1,37 @@
+#ifndef __LIB_KERNEL_BUDDY_H
+#define __LIB_KERNEL_BUDDY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Binary buddy allocator.
+
+   Manages the indexes 0 through PAGE_CNT - 1 of some array of
+   pages, for any PAGE_CNT.  Requests are rounded up to a power
+   of two, 2**ORDER pages, and served from a block of that size
+   aligned on a multiple of its size.  A free block whose
+   "buddy", the other half of the block of the next order up, is
+   also free is merged with it, so the free blocks always stay as
+   large as possible. */
+
+/* Creation. */
+size_t buddy_buf_size (size_t page_cnt);
+struct buddy *buddy_create_in_buf (size_t page_cnt, void *, size_t byte_cnt);
+void buddy_reset (struct buddy *);
+
+/* Allocation. */
+#define BUDDY_ERROR SIZE_MAX
+size_t buddy_alloc (struct buddy *, size_t cnt);
+size_t buddy_free (struct buddy *, size_t idx);
+void buddy_free_range (struct buddy *, size_t start, size_t cnt);
+
+/* Queries. */
+size_t buddy_size (const struct buddy *);
+size_t buddy_round (size_t cnt);
+size_t buddy_largest (const struct buddy *);
+
+/* Debugging. */
+void buddy_dump (const struct buddy *);
+
+#endif /* lib/kernel/buddy.h */
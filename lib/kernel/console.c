@@ -63,7 +63,7 @@ static int64_t write_cnt;
 void
 console_init (void) 
 {
-  lock_init (&console_lock);
+  lock_init (&console_lock, "console");
   use_console_lock = true;
 }
 
@@ -148,13 +148,16 @@ puts (const char *s)
   return 0;
 }
 
-/* Writes the N characters in BUFFER to the console. */
+/* Writes the N characters in BUFFER to the console.  The serial
+   port gets them all in one batch. */
 void
 putbuf (const char *buffer, size_t n) 
 {
   acquire_console ();
+  write_cnt += n;
+  serial_write (buffer, n);
   while (n-- > 0)
-    putchar_have_lock (*buffer++);
+    vga_putc (*buffer++);
   release_console ();
 }
 
@@ -0,0 +1,180 @@
+#include "heap.h"
+#include "../debug.h"
+
+/* A pairing heap is a tree in which no child is less than its
+   parent.  Each node's children are a doubly linked sibling list
+   headed by its `child' member; the leftmost child's `prev'
+   points back to the parent, and the root's `prev' is null.
+
+   Inserting melds the new element with the root.  Popping the
+   root melds its children in two passes, first in pairs from left
+   to right and then those pairs from right to left, which is what
+   gives the logarithmic amortized bound. */
+
+/* Melds the trees rooted at A and B, neither of which may have
+   siblings or a parent, and returns the root of the result. */
+static struct heap_elem *
+meld (struct heap *heap, struct heap_elem *a, struct heap_elem *b) 
+{
+  ASSERT (a->next == NULL && a->prev == NULL);
+  ASSERT (b->next == NULL && b->prev == NULL);
+
+  if (heap->less (b, a, heap->aux))
+    {
+      struct heap_elem *t = a;
+      a = b;
+      b = t;
+    }
+
+  /* Make B the leftmost child of A. */
+  b->next = a->child;
+  if (b->next != NULL)
+    b->next->prev = b;
+  b->prev = a;
+  a->child = b;
+  return a;
+}
+
+/* Melds FIRST and all of its siblings to its right into a single
+   tree and returns its root, or a null pointer if FIRST is
+   null. */
+static struct heap_elem *
+meld_siblings (struct heap *heap, struct heap_elem *first) 
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *root = NULL;
+
+  /* First pass: meld left to right in pairs, stacking each result
+     on PAIRS through its `next' member. */
+  while (first != NULL) 
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+
+      first = b != NULL ? b->next : NULL;
+      a->next = a->prev = NULL;
+      if (b != NULL) 
+        {
+          b->next = b->prev = NULL;
+          a = meld (heap, a, b);
+        }
+      a->next = pairs;
+      pairs = a;
+    }
+
+  /* Second pass: meld the pairs right to left. */
+  while (pairs != NULL) 
+    {
+      struct heap_elem *a = pairs;
+
+      pairs = a->next;
+      a->next = NULL;
+      root = root != NULL ? meld (heap, root, a) : a;
+    }
+  return root;
+}
+
+/* Initializes HEAP as an empty heap ordered by LESS given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *heap, heap_less_func *less, void *aux) 
+{
+  ASSERT (heap != NULL);
+  ASSERT (less != NULL);
+
+  heap->root = NULL;
+  heap->size = 0;
+  heap->less = less;
+  heap->aux = aux;
+}
+
+/* Inserts ELEM into HEAP. */
+void
+heap_insert (struct heap *heap, struct heap_elem *elem) 
+{
+  ASSERT (heap != NULL);
+  ASSERT (elem != NULL);
+
+  elem->child = elem->next = elem->prev = NULL;
+  heap->root = heap->root != NULL ? meld (heap, heap->root, elem) : elem;
+  heap->size++;
+}
+
+/* Removes the minimum element from HEAP and returns it.
+   Undefined behavior if HEAP is empty. */
+struct heap_elem *
+heap_pop_min (struct heap *heap) 
+{
+  struct heap_elem *min;
+
+  ASSERT (!heap_empty (heap));
+
+  min = heap->root;
+  heap->root = meld_siblings (heap, min->child);
+  if (heap->root != NULL)
+    heap->root->prev = NULL;
+  min->child = NULL;
+  heap->size--;
+  return min;
+}
+
+/* Removes ELEM, which must be in HEAP, from HEAP. */
+void
+heap_remove (struct heap *heap, struct heap_elem *elem) 
+{
+  struct heap_elem *sub;
+
+  ASSERT (!heap_empty (heap));
+
+  if (elem == heap->root) 
+    {
+      heap_pop_min (heap);
+      return;
+    }
+
+  /* Cut ELEM's subtree out of its parent's list of children. */
+  ASSERT (elem->prev != NULL);
+  if (elem->prev->child == elem)
+    elem->prev->child = elem->next;
+  else
+    elem->prev->next = elem->next;
+  if (elem->next != NULL)
+    elem->next->prev = elem->prev;
+  elem->next = elem->prev = NULL;
+
+  /* Meld ELEM's children back into the heap. */
+  sub = meld_siblings (heap, elem->child);
+  elem->child = NULL;
+  if (sub != NULL) 
+    {
+      sub->prev = NULL;
+      heap->root = meld (heap, heap->root, sub);
+    }
+  heap->size--;
+}
+
+/* Returns the minimum element of HEAP, or a null pointer if HEAP
+   is empty. */
+struct heap_elem *
+heap_min (const struct heap *heap) 
+{
+  ASSERT (heap != NULL);
+
+  return heap->root;
+}
+
+/* Returns the number of elements in HEAP. */
+size_t
+heap_size (const struct heap *heap) 
+{
+  ASSERT (heap != NULL);
+
+  return heap->size;
+}
+
+/* Returns true if HEAP is empty, false otherwise. */
+bool
+heap_empty (const struct heap *heap) 
+{
+  return heap_size (heap) == 0;
+}
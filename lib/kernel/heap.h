@@ -0,0 +1,66 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue.
+
+   This is a pairing heap.  Like struct list, it needs no
+   dynamically allocated memory: each structure that can be in a
+   heap embeds a struct heap_elem member, and heap_entry()
+   converts a struct heap_elem back to the structure that
+   contains it.  The heap orders its elements by a caller-supplied
+   "less" function, and its minimum is the element that no other
+   element is less than.
+
+   heap_min() takes constant time, and so does heap_insert().
+   heap_pop_min() and heap_remove() take O(log n) amortized time.
+   None of them recurses, so they are safe on a small kernel
+   stack and, given suitable locking, in interrupt handlers. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem 
+  {
+    struct heap_elem *child;    /* Leftmost child. */
+    struct heap_elem *next;     /* Next sibling to the right. */
+    struct heap_elem *prev;     /* Previous sibling, or parent if leftmost. */
+  };
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap 
+  {
+    struct heap_elem *root;     /* Minimum element, or null. */
+    size_t size;                /* Number of elements. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element.  See the big comment at the top of list.h
+   for an example. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->child    \
+                     - offsetof (STRUCT, MEMBER.child)))
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+void heap_insert (struct heap *, struct heap_elem *);
+struct heap_elem *heap_pop_min (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+
+struct heap_elem *heap_min (const struct heap *);
+size_t heap_size (const struct heap *);
+bool heap_empty (const struct heap *);
+
+#endif /* lib/kernel/heap.h */
@@ -0,0 +1,183 @@
+#include "ring.h"
+#include <string.h>
+#include "../debug.h"
+
+/* x86 does not reorder loads with other loads, nor stores with
+   other stores, nor a store with an earlier load, so publishing a
+   span or giving back its room takes only a compiler barrier
+   between copying the data and storing the new position. */
+#define barrier() asm volatile ("" : : : "memory")
+
+/* Atomically sets *P to NEW if it is OLD.  Returns true if it
+   did.  See [IA32-v2a] "CMPXCHG". */
+static inline bool
+cas (volatile uint32_t *p, uint32_t old, uint32_t new)
+{
+  uint32_t prev;
+
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "=a" (prev), "+m" (*p)
+                : "r" (new), "0" (old)
+                : "memory");
+  return prev == old;
+}
+
+/* Initializes RING to hold up to CAPACITY elements of ELEM_SIZE
+   bytes each in BUF, which must be CAPACITY * ELEM_SIZE bytes
+   long.  CAPACITY must be a power of 2. */
+void
+ring_init (struct ring *ring, void *buf, size_t elem_size, size_t capacity)
+{
+  ASSERT (ring != NULL);
+  ASSERT (buf != NULL);
+  ASSERT (elem_size > 0);
+  ASSERT (capacity > 0 && (capacity & (capacity - 1)) == 0);
+  ASSERT (capacity <= (1u << 31));
+
+  ring->buf = buf;
+  ring->elem_size = elem_size;
+  ring->mask = capacity - 1;
+  ring->claimed = ring->head = ring->tail = 0;
+}
+
+/* Returns the number of elements RING can hold. */
+size_t
+ring_capacity (const struct ring *ring)
+{
+  return (size_t) ring->mask + 1;
+}
+
+/* Returns the number of elements in RING that its consumer can
+   take. */
+size_t
+ring_count (const struct ring *ring)
+{
+  return ring->head - ring->tail;
+}
+
+/* Returns the number of elements that producers can add to
+   RING. */
+size_t
+ring_space (const struct ring *ring)
+{
+  return ring_capacity (ring) - (ring->claimed - ring->tail);
+}
+
+/* Returns true if RING has nothing for its consumer. */
+bool
+ring_empty (const struct ring *ring)
+{
+  return ring_count (ring) == 0;
+}
+
+/* Returns true if RING has no room for producers. */
+bool
+ring_full (const struct ring *ring)
+{
+  return ring_space (ring) == 0;
+}
+
+/* Copies the CNT elements at SRC into RING starting at
+   position POS. */
+static void
+copy_in (struct ring *ring, uint32_t pos, const uint8_t *src, size_t cnt)
+{
+  size_t ofs = pos & ring->mask;
+  size_t first = ring_capacity (ring) - ofs;
+
+  if (first > cnt)
+    first = cnt;
+  memcpy (ring->buf + ofs * ring->elem_size, src, first * ring->elem_size);
+  memcpy (ring->buf, src + first * ring->elem_size,
+          (cnt - first) * ring->elem_size);
+}
+
+/* Copies the CNT elements in RING starting at position POS to
+   DST. */
+static void
+copy_out (const struct ring *ring, uint32_t pos, uint8_t *dst, size_t cnt)
+{
+  size_t ofs = pos & ring->mask;
+  size_t first = ring_capacity (ring) - ofs;
+
+  if (first > cnt)
+    first = cnt;
+  memcpy (dst, ring->buf + ofs * ring->elem_size, first * ring->elem_size);
+  memcpy (dst + first * ring->elem_size, ring->buf,
+          (cnt - first) * ring->elem_size);
+}
+
+/* Adds as many of the CNT elements at SRC to RING as fit and
+   returns the number added.  For a ring with a single
+   producer. */
+size_t
+ring_enqueue (struct ring *ring, const void *src, size_t cnt)
+{
+  uint32_t head = ring->head;
+  size_t space = ring_space (ring);
+
+  ASSERT (ring->claimed == head);
+
+  if (cnt > space)
+    cnt = space;
+  if (cnt == 0)
+    return 0;
+
+  copy_in (ring, head, src, cnt);
+  barrier ();
+  ring->claimed = ring->head = head + cnt;
+  return cnt;
+}
+
+/* Adds as many of the CNT elements at SRC to RING as fit and
+   returns the number added.  Safe with other producers calling
+   this function at the same time, as long as none of them can
+   interrupt this one. */
+size_t
+ring_enqueue_mp (struct ring *ring, const void *src, size_t cnt)
+{
+  uint32_t start;
+
+  /* Claim room. */
+  do
+    {
+      size_t space;
+
+      start = ring->claimed;
+      space = ring_capacity (ring) - (start - ring->tail);
+      if (cnt > space)
+        cnt = space;
+      if (cnt == 0)
+        return 0;
+    }
+  while (!cas (&ring->claimed, start, start + cnt));
+
+  copy_in (ring, start, src, cnt);
+  barrier ();
+
+  /* Publish, after every span claimed before ours. */
+  while (ring->head != start)
+    asm volatile ("pause" : : : "memory");
+  ring->head = start + cnt;
+  return cnt;
+}
+
+/* Removes up to CNT elements from RING into DST and returns the
+   number removed.  For RING's only consumer. */
+size_t
+ring_dequeue (struct ring *ring, void *dst, size_t cnt)
+{
+  uint32_t tail = ring->tail;
+  size_t avail = ring->head - tail;
+
+  if (cnt > avail)
+    cnt = avail;
+  if (cnt == 0)
+    return 0;
+
+  barrier ();
+  copy_out (ring, tail, dst, cnt);
+  barrier ();
+  ring->tail = tail + cnt;
+  return cnt;
+}
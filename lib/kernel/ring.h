@@ -0,0 +1,51 @@
+#ifndef __LIB_KERNEL_RING_H
+#define __LIB_KERNEL_RING_H
+
+/* Ring buffer.
+
+   A fixed-size circular queue of elements of a fixed size, in a
+   caller-supplied buffer whose capacity is a power of 2.  Data
+   goes in and out in spans of any number of elements, each
+   copied with at most two memcpy() calls.
+
+   A ring needs no lock between its producers and its consumer.
+   There may be only one consumer at a time.  There may be one
+   producer, calling ring_enqueue(), or any number of them, all
+   calling ring_enqueue_mp().  ring_enqueue_mp() claims room for
+   its span with an atomic compare-and-exchange, copies the span
+   in, and then publishes it, in the order in which the spans
+   were claimed.  A producer must therefore not be interrupted by
+   another producer of the same ring between claiming and
+   publishing; in the kernel, call it with interrupts off.
+
+   Positions count up forever and wrap around at 2**32, which is
+   harmless as long as the capacity is at most 2**31. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Ring buffer. */
+struct ring
+  {
+    uint8_t *buf;               /* Elements. */
+    size_t elem_size;           /* Size of an element in bytes. */
+    uint32_t mask;              /* Capacity minus 1. */
+    volatile uint32_t claimed;  /* End of the spans producers claimed. */
+    volatile uint32_t head;     /* End of the spans producers published. */
+    volatile uint32_t tail;     /* Start of the unconsumed elements. */
+  };
+
+void ring_init (struct ring *, void *buf, size_t elem_size, size_t capacity);
+
+size_t ring_capacity (const struct ring *);
+size_t ring_count (const struct ring *);
+size_t ring_space (const struct ring *);
+bool ring_empty (const struct ring *);
+bool ring_full (const struct ring *);
+
+size_t ring_enqueue (struct ring *, const void *, size_t cnt);
+size_t ring_enqueue_mp (struct ring *, const void *, size_t cnt);
+size_t ring_dequeue (struct ring *, void *, size_t cnt);
+
+#endif /* lib/kernel/ring.h */
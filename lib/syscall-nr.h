@@ -28,7 +28,11 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Fast user-space synchronization. */
+    SYS_FUTEX_WAIT,             /* Sleep if a word holds a value. */
+    SYS_FUTEX_WAKE              /* Wake threads sleeping on a word. */
   };
 
 #endif /* lib/syscall-nr.h */
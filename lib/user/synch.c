@@ -0,0 +1,145 @@
+#include <synch.h>
+#include <limits.h>
+#include <syscall.h>
+
+/* Mutexes and condition variables on top of futexes.
+
+   The mutex is the three-state one from Ulrich Drepper, "Futexes
+   Are Tricky": its word is 0 when free, 1 when held, and 2 when
+   held with threads possibly waiting.  Locking a free mutex is a
+   single compare-and-exchange from 0 to 1, and unlocking a mutex
+   still in state 1 a single exchange back to 0.  Only a thread
+   that finds the mutex held sets it to 2 and sleeps in
+   futex_wait(), and only an unlock that finds it at 2 calls
+   futex_wake().
+
+   A condition variable counts its waiters, under the mutex, so
+   that a signal with no one waiting returns at once.  A waiter
+   notes the sequence number before it lets go of the mutex and
+   sleeps only if no signal has bumped it since. */
+
+/* Atomically sets *P to NEW if it is OLD.  Returns the old value
+   of *P. */
+static inline int
+cmpxchg (int *p, int old, int new)
+{
+  int prev;
+
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "=a" (prev), "+m" (*p)
+                : "r" (new), "0" (old)
+                : "memory");
+  return prev;
+}
+
+/* Atomically stores VALUE in *P and returns the old value. */
+static inline int
+xchg (int *p, int value)
+{
+  asm volatile ("xchgl %0, %1" : "+m" (*p), "+r" (value) : : "memory");
+  return value;
+}
+
+/* Atomically adds 1 to *P. */
+static inline void
+atomic_inc (int *p)
+{
+  asm volatile ("lock incl %0" : "+m" (*p) : : "memory");
+}
+
+/* Initializes MUTEX as free. */
+void
+mutex_init (struct mutex *mutex)
+{
+  mutex->state = 0;
+}
+
+/* Acquires MUTEX, sleeping until it is free if necessary. */
+void
+mutex_lock (struct mutex *mutex)
+{
+  int c = cmpxchg (&mutex->state, 0, 1);
+
+  if (c != 0)
+    {
+      /* Held.  Mark it as having waiters and sleep until it is
+         free, then take it, still marked, since others may be
+         asleep too. */
+      if (c != 2)
+        c = xchg (&mutex->state, 2);
+      while (c != 0)
+        {
+          futex_wait (&mutex->state, 2);
+          c = xchg (&mutex->state, 2);
+        }
+    }
+}
+
+/* Acquires MUTEX if it is free and returns true, or returns
+   false if it is held. */
+bool
+mutex_trylock (struct mutex *mutex)
+{
+  return cmpxchg (&mutex->state, 0, 1) == 0;
+}
+
+/* Releases MUTEX, which the caller must hold, and wakes a
+   waiter, if there may be one. */
+void
+mutex_unlock (struct mutex *mutex)
+{
+  if (xchg (&mutex->state, 0) == 2)
+    futex_wake (&mutex->state, 1);
+}
+
+/* Initializes COND. */
+void
+cond_init (struct condvar *cond)
+{
+  cond->seq = 0;
+  cond->waiters = 0;
+}
+
+/* Atomically releases MUTEX and waits for COND to be signaled,
+   then reacquires MUTEX.  MUTEX must be held.  As with kernel
+   condition variables, the caller must recheck its condition
+   afterward. */
+void
+cond_wait (struct condvar *cond, struct mutex *mutex)
+{
+  int seq = cond->seq;
+
+  cond->waiters++;
+  mutex_unlock (mutex);
+  futex_wait (&cond->seq, seq);
+
+  /* Others may have been woken along with us, so mark the mutex
+     as having waiters. */
+  while (xchg (&mutex->state, 2) != 0)
+    futex_wait (&mutex->state, 2);
+  cond->waiters--;
+}
+
+/* Wakes one thread waiting on COND, if any.  MUTEX, the mutex
+   COND is used with, must be held. */
+void
+cond_signal (struct condvar *cond, struct mutex *mutex UNUSED)
+{
+  if (cond->waiters > 0)
+    {
+      atomic_inc (&cond->seq);
+      futex_wake (&cond->seq, 1);
+    }
+}
+
+/* Wakes every thread waiting on COND.  MUTEX, the mutex COND is
+   used with, must be held. */
+void
+cond_broadcast (struct condvar *cond, struct mutex *mutex UNUSED)
+{
+  if (cond->waiters > 0)
+    {
+      atomic_inc (&cond->seq);
+      futex_wake (&cond->seq, INT_MAX);
+    }
+}
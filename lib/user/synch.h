@@ -0,0 +1,37 @@
+#ifndef __LIB_USER_SYNCH_H
+#define __LIB_USER_SYNCH_H
+
+#include <stdbool.h>
+
+/* Mutex.  Taking a free mutex and releasing one that no one is
+   waiting for never enters the kernel. */
+struct mutex
+  {
+    int state;                  /* 0: free, 1: held, 2: held, waiters. */
+  };
+
+/* Initializer for a free mutex. */
+#define MUTEX_INITIALIZER { 0 }
+
+void mutex_init (struct mutex *);
+void mutex_lock (struct mutex *);
+bool mutex_trylock (struct mutex *);
+void mutex_unlock (struct mutex *);
+
+/* Condition variable.  Signaling a condition variable that no one
+   is waiting on never enters the kernel. */
+struct condvar
+  {
+    int seq;                    /* Bumped by every signal. */
+    int waiters;                /* Threads in cond_wait(). */
+  };
+
+/* Initializer for a condition variable. */
+#define CONDVAR_INITIALIZER { 0, 0 }
+
+void cond_init (struct condvar *);
+void cond_wait (struct condvar *, struct mutex *);
+void cond_signal (struct condvar *, struct mutex *);
+void cond_broadcast (struct condvar *, struct mutex *);
+
+#endif /* lib/user/synch.h */
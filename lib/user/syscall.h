@@ -45,4 +45,8 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Fast user-space synchronization.  See lib/user/synch.h. */
+int futex_wait (int *addr, int val);
+int futex_wake (int *addr, int cnt);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,129 @@
+#include "projects/1/balancebench.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/smp.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Measures how well the load balancer spreads a skewed workload
+   over the CPUs started by -smp.  Starts BALANCEBENCH_THREADS
+   workers per CPU, all from the boot CPU, so that once every
+   other CPU has one, the rest pile up on the boot CPU's run
+   queue.  One worker in four has HEAVY_UNITS units of work, the
+   rest one unit each, so that CPUs also run dry at different
+   times.  Reports the elapsed time, the throughput, and the
+   share of the work done on each CPU.  Run it once as is and
+   once with -no=balance to compare the balancer on and off.  The
+   imbalance is the busiest CPU's share over the
+   mean, so 100% is perfectly even. */
+
+#define BALANCEBENCH_THREADS 4          /* Workers per CPU. */
+#define HEAVY_UNITS 8                   /* Units for a heavy worker. */
+#define UNIT_CHUNKS 64                  /* Chunks per unit of work. */
+#define CHUNK_ITERATIONS (1 << 16)      /* LCG steps per chunk. */
+
+/* A worker. */
+struct worker
+  {
+    int chunks;                 /* Chunks of work to do. */
+    int done_on[CPU_MAX];       /* Chunks done on each CPU. */
+    uint32_t result;            /* Keeps the work from being elided. */
+    struct semaphore *done;     /* Upped when finished. */
+  };
+
+static struct worker workers[CPU_MAX * BALANCEBENCH_THREADS];
+
+/* Does W's work, chunk by chunk, without holding the kernel
+   lock, and records where each chunk ran. */
+static void
+work (void *w_)
+{
+  struct worker *w = w_;
+  uint32_t x = (uint32_t) thread_tid ();
+  int c, i;
+
+  for (c = 0; c < w->chunks; c++)
+    {
+      kernel_lock_release ();
+      for (i = 0; i < CHUNK_ITERATIONS; i++)
+        x = x * 1664525 + 1013904223;
+      kernel_lock_acquire ();
+      w->done_on[cpu_current ()->id]++;
+    }
+
+  w->result = x;
+  sema_up (w->done);
+}
+
+/* Runs one pass, labeled NAME, with WORKER_CNT workers. */
+static void
+run_pass (const char *name, int worker_cnt)
+{
+  int old_priority = thread_get_priority ();
+  int per_cpu[CPU_MAX];
+  int64_t total = 0, max = 0, mean, us;
+  struct semaphore done;
+  uint64_t start;
+  int i, cpu;
+
+  sema_init (&done, 0);
+
+  /* Create all the workers before any of them runs here. */
+  thread_set_priority (PRI_DEFAULT + 1);
+  start = rdtsc ();
+  for (i = 0; i < worker_cnt; i++)
+    {
+      struct worker *w = &workers[i];
+      w->chunks = (i % 4 == 0 ? HEAVY_UNITS : 1) * UNIT_CHUNKS;
+      for (cpu = 0; cpu < CPU_MAX; cpu++)
+        w->done_on[cpu] = 0;
+      w->done = &done;
+      thread_create ("worker", PRI_DEFAULT, work, w);
+    }
+  thread_set_priority (old_priority);
+  for (i = 0; i < worker_cnt; i++)
+    sema_down (&done);
+  us = (rdtsc () - start) / (timer_tsc_freq () / 1000000) + 1;
+
+  for (cpu = 0; cpu < cpu_cnt; cpu++)
+    {
+      per_cpu[cpu] = 0;
+      for (i = 0; i < worker_cnt; i++)
+        per_cpu[cpu] += workers[i].done_on[cpu];
+      total += per_cpu[cpu];
+      if (per_cpu[cpu] > max)
+        max = per_cpu[cpu];
+    }
+  mean = total / cpu_cnt;
+
+  printf ("balancebench: %-3s %9"PRId64" us %7"PRId64" chunks/s"
+          "  imbalance %4"PRId64"%%  per CPU:", name, us,
+          total * 1000000 / us, mean > 0 ? max * 100 / mean : 0);
+  for (cpu = 0; cpu < cpu_cnt; cpu++)
+    printf (" %3"PRId64"%%", per_cpu[cpu] * 100 / total);
+  printf ("\n");
+}
+
+/* Runs the benchmark. */
+void
+balancebench (char **argv UNUSED)
+{
+  int cpu;
+
+  for (cpu = 0; cpu < cpu_cnt; cpu++)
+    if (!cpus[cpu].online)
+      {
+        printf ("balancebench: needs all %d CPUs online (use -smp)\n",
+                cpu_cnt);
+        return;
+      }
+  printf ("balancebench: %d CPUs, %d workers\n",
+          cpu_cnt, cpu_cnt * BALANCEBENCH_THREADS);
+
+  run_pass (feature_enabled (FEATURE_BALANCE) ? "on" : "off",
+            cpu_cnt * BALANCEBENCH_THREADS);
+}
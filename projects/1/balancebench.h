@@ -0,0 +1,6 @@
+#ifndef __BALANCEBENCH_H__
+#define __BALANCEBENCH_H__
+
+void balancebench (char **argv);
+
+#endif
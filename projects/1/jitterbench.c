@@ -0,0 +1,90 @@
+#include "projects/1/jitterbench.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Measures how late high-resolution sleeps wake up.  For each of
+   a range of durations, sleeps JITTERBENCH_ROUNDS times with
+   timer_usleep() and reports the minimum, mean, and maximum
+   difference between the time asked for and the time slept, as
+   measured by the TSC.  The first pass runs on an idle CPU; the
+   second while a lower-priority thread spins, so that each wakeup
+   has to preempt it. */
+
+#define JITTERBENCH_ROUNDS 16
+
+/* Sleep durations to try, in microseconds. */
+static const int64_t durations[] = {20, 100, 500, 2000, 15000};
+
+/* Set to stop the spinning thread. */
+static volatile bool stop_spinning;
+
+/* Keeps the CPU busy until stop_spinning is set, then ups
+   DONE_. */
+static void
+spin (void *done_)
+{
+  struct semaphore *done = done_;
+
+  while (!stop_spinning)
+    barrier ();
+  sema_up (done);
+}
+
+/* Runs one pass over all the durations, labeled NAME. */
+static void
+run_pass (const char *name)
+{
+  uint64_t tsc_per_us = timer_tsc_freq () / 1000000;
+  size_t i;
+  int r;
+
+  for (i = 0; i < sizeof durations / sizeof *durations; i++)
+    {
+      int64_t us = durations[i];
+      int64_t min = INT64_MAX, max = INT64_MIN, sum = 0;
+
+      for (r = 0; r < JITTERBENCH_ROUNDS; r++)
+        {
+          uint64_t start = rdtsc ();
+          int64_t late;
+
+          timer_usleep (us);
+          late = (int64_t) ((rdtsc () - start) * 1000 / tsc_per_us)
+                 - us * 1000;
+          if (late < min)
+            min = late;
+          if (late > max)
+            max = late;
+          sum += late;
+        }
+      printf ("jitterbench: %-7s %6"PRId64" us  late by min %7"PRId64
+              " mean %7"PRId64" max %7"PRId64" ns\n", name, us, min,
+              sum / JITTERBENCH_ROUNDS, max);
+    }
+}
+
+/* Runs the benchmark. */
+void
+jitterbench (char **argv UNUSED)
+{
+  struct semaphore done;
+  int old_priority = thread_get_priority ();
+
+  printf ("jitterbench: %d rounds per duration, TSC at %"PRIu64" Hz\n",
+          JITTERBENCH_ROUNDS, timer_tsc_freq ());
+  run_pass ("idle");
+
+  sema_init (&done, 0);
+  stop_spinning = false;
+  thread_set_priority (PRI_DEFAULT + 1);
+  thread_create ("spinner", PRI_DEFAULT, spin, &done);
+  run_pass ("loaded");
+  stop_spinning = true;
+  thread_set_priority (old_priority);
+  sema_down (&done);
+}
@@ -0,0 +1,6 @@
+#ifndef __JITTERBENCH_H__
+#define __JITTERBENCH_H__
+
+void jitterbench (char **argv);
+
+#endif
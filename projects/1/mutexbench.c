@@ -0,0 +1,208 @@
+#include "projects/1/mutexbench.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/smp.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Measures lock_acquire() on a contended lock, for short and
+   for long critical sections.  One worker per CPU online, at
+   least two, take turns on one lock MUTEXBENCH_OPS times each,
+   and between turns do MUTEXBENCH_OUTSIDE steps of work of their
+   own.  By default a waiter spins while the holder runs on
+   another CPU; run it once as is and once with -no=lock-spin to
+   compare that with sleeping right away.
+
+   Both the critical sections and the work between them run
+   without the kernel lock, like code that does not touch
+   anything the kernel lock protects, so that the workers really
+   run at the same time.  Run with -smp; on one CPU the two modes
+   behave the same.
+
+   Before the timed runs, checks that a thread that acquires the
+   lock with interrupts off keeps the kernel lock until it
+   sleeps, even while the holder runs on another CPU. */
+
+#define MUTEXBENCH_OPS 2000             /* Acquisitions per worker. */
+#define MUTEXBENCH_SHORT 16             /* Steps in a short section. */
+#define MUTEXBENCH_LONG 20000           /* Steps in a long section. */
+#define MUTEXBENCH_OUTSIDE 256          /* Steps between sections. */
+#define MUTEXBENCH_HOLD 100000000ULL    /* Max cycles check holds. */
+
+/* Shared state, protected by mutex. */
+static struct lock mutex;
+static uint32_t shared;
+static long long turns;
+
+/* Keeps the work outside the sections from being elided.
+   Protected by the kernel lock. */
+static uint32_t sink;
+
+/* Current run. */
+static int section_steps;
+static struct semaphore done;
+
+/* Interrupts-off check.  Protected by the kernel lock. */
+static bool check_held;                 /* Holder has the mutex. */
+static struct thread *check_waiter;     /* Waiter in lock_acquire(). */
+static bool check_seen;                 /* Holder saw the waiter. */
+static bool check_failed;               /* Saw it running. */
+
+/* Steps a linear congruential generator STEPS times from X and
+   returns the result. */
+static uint32_t
+lcg (uint32_t x, int steps)
+{
+  int i;
+
+  for (i = 0; i < steps; i++)
+    x = x * 1664525 + 1013904223;
+  return x;
+}
+
+/* Takes MUTEXBENCH_OPS turns on the lock, then ups DONE. */
+static void
+worker (void *aux UNUSED)
+{
+  uint32_t x = (uint32_t) thread_tid ();
+  int i;
+
+  for (i = 0; i < MUTEXBENCH_OPS; i++)
+    {
+      lock_acquire (&mutex);
+      kernel_lock_release ();
+      shared = lcg (shared, section_steps);
+      turns++;
+      kernel_lock_acquire ();
+      lock_release (&mutex);
+
+      kernel_lock_release ();
+      x = lcg (x, MUTEXBENCH_OUTSIDE);
+      kernel_lock_acquire ();
+    }
+  sink ^= x;
+  sema_up (&done);
+}
+
+/* Holds the mutex, running on its own CPU, until it sees the
+   waiter inside lock_acquire() or MUTEXBENCH_HOLD cycles pass.
+   It can only see the waiter there if the waiter gave up the
+   kernel lock, which it may do by sleeping but not while it is
+   still running with interrupts off. */
+static void
+check_holder (void *aux UNUSED)
+{
+  uint64_t deadline;
+
+  lock_acquire (&mutex);
+  check_held = true;
+  deadline = rdtsc () + MUTEXBENCH_HOLD;
+  while (!check_seen && rdtsc () < deadline)
+    {
+      kernel_lock_release ();
+      asm volatile ("pause" : : : "memory");
+      kernel_lock_acquire ();
+      if (check_waiter != NULL)
+        {
+          check_seen = true;
+          if (check_waiter->status == THREAD_RUNNING)
+            check_failed = true;
+        }
+    }
+  lock_release (&mutex);
+  sema_up (&done);
+}
+
+/* Waits until the holder has the mutex, then acquires it with
+   interrupts off. */
+static void
+check_waiter_thread (void *aux UNUSED)
+{
+  enum intr_level old_level;
+
+  while (!check_held)
+    thread_yield ();
+
+  old_level = intr_disable ();
+  check_waiter = thread_current ();
+  lock_acquire (&mutex);
+  check_waiter = NULL;
+  intr_set_level (old_level);
+
+  lock_release (&mutex);
+  sema_up (&done);
+}
+
+/* Acquires the mutex with interrupts off while a thread on
+   another CPU holds it, and panics if the waiter let go of the
+   kernel lock without sleeping. */
+static void
+check_intr_off (void)
+{
+  check_held = check_seen = check_failed = false;
+  check_waiter = NULL;
+  sema_init (&done, 0);
+
+  thread_create ("mutexbench", PRI_DEFAULT, check_holder, NULL);
+  thread_create ("mutexbench", PRI_DEFAULT, check_waiter_thread, NULL);
+  sema_down (&done);
+  sema_down (&done);
+
+  if (check_failed)
+    PANIC ("mutexbench: lock_acquire() with interrupts off "
+           "released the kernel lock without sleeping");
+  printf ("mutexbench: contended acquire with interrupts off: ok\n");
+}
+
+/* Runs WORKERS workers with critical sections of STEPS steps
+   and prints the result labeled NAME. */
+static void
+run (const char *name, int steps, int workers)
+{
+  uint64_t start, cycles;
+  int i;
+
+  section_steps = steps;
+  turns = 0;
+  sema_init (&done, 0);
+
+  start = rdtsc ();
+  for (i = 0; i < workers; i++)
+    thread_create ("mutexbench", PRI_DEFAULT, worker, NULL);
+  for (i = 0; i < workers; i++)
+    sema_down (&done);
+  cycles = (rdtsc () - start) / (workers * MUTEXBENCH_OPS);
+
+  if (turns != (long long) workers * MUTEXBENCH_OPS)
+    PANIC ("mutexbench: %lld turns, expected %d",
+           turns, workers * MUTEXBENCH_OPS);
+  printf ("mutexbench: %-5s sections, %-8s %8"PRIu64" cycles/acquire\n",
+          name, feature_enabled (FEATURE_LOCK_SPIN) ? "adaptive"
+                                                    : "blocking", cycles);
+}
+
+/* Runs the benchmark. */
+void
+mutexbench (char **argv UNUSED)
+{
+  int workers = 0;
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    if (cpus[i].online)
+      workers++;
+  if (workers < 2)
+    workers = 2;
+
+  lock_init (&mutex, "mutexbench");
+  printf ("mutexbench: %d workers, %d acquisitions each, %d CPUs %s\n",
+          workers, MUTEXBENCH_OPS, cpu_cnt,
+          smp_active ? "active" : "inactive");
+  check_intr_off ();
+  run ("short", MUTEXBENCH_SHORT, workers);
+  run ("long", MUTEXBENCH_LONG, workers);
+}
@@ -0,0 +1,6 @@
+#ifndef __MUTEXBENCH_H__
+#define __MUTEXBENCH_H__
+
+void mutexbench (char **argv);
+
+#endif
@@ -0,0 +1,211 @@
+#include "projects/1/rwbench.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Compares a plain lock, a reader-writer lock, and a sequence
+   lock guarding the same table under a mix of reads and writes.
+   RWBENCH_THREADS threads each do RWBENCH_OPS operations, every
+   one either a read, which sums the table, or a write, which
+   adds one to every word of it.  The critical sections are long
+   enough that the timer often preempts a thread inside one.
+
+   Every write leaves all the words of the table equal, so each
+   read also checks that it saw them equal; a read that did not
+   saw a write half done, and is counted as torn. */
+
+#define RWBENCH_THREADS 8               /* Threads per run. */
+#define RWBENCH_OPS 2000                /* Operations per thread. */
+#define RWBENCH_WORDS 256               /* Words in the table. */
+
+/* Ways of guarding the table. */
+enum rwbench_kind
+  {
+    RWBENCH_LOCK,                       /* struct lock. */
+    RWBENCH_RWLOCK,                     /* struct rwlock. */
+    RWBENCH_SEQLOCK                     /* struct seqlock. */
+  };
+
+static const char *kind_names[] = { "lock", "rwlock", "seqlock" };
+
+/* Table and its guards. */
+static volatile unsigned table[RWBENCH_WORDS];
+static struct lock table_lock;
+static struct rwlock table_rwlock;
+static struct seqlock table_seq;
+
+/* Current run. */
+static enum rwbench_kind kind;
+static unsigned read_pct;               /* Percent of operations that read. */
+static struct semaphore done;           /* Upped by each finished thread. */
+static int torn_cnt;                    /* Torn reads seen. */
+static long long retry_cnt;             /* Seqlock read retries. */
+
+/* Returns true if every word of the table, copied or read
+   in place through WORDS, is equal. */
+static bool
+consistent (const volatile unsigned *words)
+{
+  int i;
+
+  for (i = 1; i < RWBENCH_WORDS; i++)
+    if (words[i] != words[0])
+      return false;
+  return true;
+}
+
+/* Adds one to every word of the table. */
+static void
+write_table (void)
+{
+  int i;
+
+  for (i = 0; i < RWBENCH_WORDS; i++)
+    table[i]++;
+}
+
+/* Reads the table and counts the read if it was torn. */
+static void
+read_op (void)
+{
+  unsigned copy[RWBENCH_WORDS];
+  bool ok;
+  int i;
+
+  switch (kind)
+    {
+    case RWBENCH_LOCK:
+      lock_acquire (&table_lock);
+      ok = consistent (table);
+      lock_release (&table_lock);
+      break;
+
+    case RWBENCH_RWLOCK:
+      rwlock_acquire_read (&table_rwlock);
+      ok = consistent (table);
+      rwlock_release_read (&table_rwlock);
+      break;
+
+    case RWBENCH_SEQLOCK:
+      for (;;)
+        {
+          unsigned seq = seqlock_read_begin (&table_seq);
+          for (i = 0; i < RWBENCH_WORDS; i++)
+            copy[i] = table[i];
+          if (!seqlock_read_retry (&table_seq, seq))
+            break;
+          retry_cnt++;
+        }
+      ok = consistent (copy);
+      break;
+
+    default:
+      NOT_REACHED ();
+    }
+
+  if (!ok)
+    torn_cnt++;
+}
+
+/* Writes the table. */
+static void
+write_op (void)
+{
+  enum intr_level old_level;
+
+  switch (kind)
+    {
+    case RWBENCH_LOCK:
+      lock_acquire (&table_lock);
+      write_table ();
+      lock_release (&table_lock);
+      break;
+
+    case RWBENCH_RWLOCK:
+      rwlock_acquire_write (&table_rwlock);
+      write_table ();
+      rwlock_release_write (&table_rwlock);
+      break;
+
+    case RWBENCH_SEQLOCK:
+      /* Sequence lock writes must not overlap, which the
+         interrupts being off guarantees. */
+      old_level = seqlock_write_begin (&table_seq);
+      write_table ();
+      seqlock_write_end (&table_seq, old_level);
+      break;
+
+    default:
+      NOT_REACHED ();
+    }
+}
+
+/* Does RWBENCH_OPS operations, seeding its choice of read or
+   write with SEED_, then ups DONE. */
+static void
+worker (void *seed_)
+{
+  unsigned state = (unsigned) seed_ * 2654435761u + 1;
+  int i;
+
+  for (i = 0; i < RWBENCH_OPS; i++)
+    {
+      /* xorshift32. */
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      if (state % 100 < read_pct)
+        read_op ();
+      else
+        write_op ();
+    }
+  sema_up (&done);
+}
+
+/* Runs RWBENCH_THREADS workers guarding the table with K, with
+   PCT percent reads, and prints the result. */
+static void
+run (enum rwbench_kind k, unsigned pct)
+{
+  uint64_t start, cycles;
+  int i;
+
+  kind = k;
+  read_pct = pct;
+  torn_cnt = 0;
+  retry_cnt = 0;
+  sema_init (&done, 0);
+
+  start = rdtsc ();
+  for (i = 0; i < RWBENCH_THREADS; i++)
+    thread_create ("rwbench", PRI_DEFAULT, worker, (void *) i);
+  for (i = 0; i < RWBENCH_THREADS; i++)
+    sema_down (&done);
+  cycles = (rdtsc () - start) / (RWBENCH_THREADS * RWBENCH_OPS);
+
+  printf ("rwbench: %-7s %3u%% reads: %7"PRIu64" cycles/op, "
+          "%d torn reads, %lld retries\n",
+          kind_names[k], pct, cycles, torn_cnt, retry_cnt);
+}
+
+/* Runs the benchmark. */
+void
+rwbench (char **argv UNUSED)
+{
+  static const unsigned pcts[] = { 100, 90, 50 };
+  size_t i;
+  int k;
+
+  lock_init (&table_lock, "rwbench");
+  rwlock_init (&table_rwlock);
+  seqlock_init (&table_seq);
+
+  printf ("rwbench: %d threads, %d operations each, %d-word table\n",
+          RWBENCH_THREADS, RWBENCH_OPS, RWBENCH_WORDS);
+  for (i = 0; i < sizeof pcts / sizeof *pcts; i++)
+    for (k = RWBENCH_LOCK; k <= RWBENCH_SEQLOCK; k++)
+      run (k, pcts[i]);
+}
@@ -0,0 +1,6 @@
+#ifndef __RWBENCH_H__
+#define __RWBENCH_H__
+
+void rwbench (char **argv);
+
+#endif
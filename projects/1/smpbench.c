@@ -0,0 +1,138 @@
+#include "projects/1/smpbench.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/smp.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Measures how well work spreads over the CPUs started by -smp.
+   For each number of workers from 1 to the number of CPUs
+   online, splits a fixed amount of work among that many threads
+   and reports the elapsed time and the speedup over one worker.
+
+   The "compute" phase does its work without the kernel lock, the
+   way user code runs.  The "spawn" phase creates threads and
+   waits for them to exit, also without the kernel lock, so that
+   it goes through the scheduler, semaphores and the page
+   allocator on every CPU at once.  Both should scale with the
+   number of CPUs; what keeps "spawn" short of that is the locks
+   that all CPUs share: for tids, for the lists of all threads
+   and of dead ones, and for the page pools. */
+
+#define COMPUTE_ITERATIONS (1 << 26)    /* Total LCG steps. */
+#define SPAWN_THREADS 2048              /* Total threads created. */
+
+/* One worker's share of a phase. */
+struct worker
+  {
+    int amount;                 /* Iterations or threads. */
+    uint32_t result;            /* Keeps the work from being elided. */
+    struct semaphore *done;     /* Upped when finished. */
+  };
+
+/* Steps a linear congruential generator W->amount times, without
+   holding the kernel lock. */
+static void
+compute (void *w_)
+{
+  struct worker *w = w_;
+  uint32_t x = (uint32_t) thread_tid ();
+  int i;
+
+  kernel_lock_release ();
+  for (i = 0; i < w->amount; i++)
+    x = x * 1664525 + 1013904223;
+  kernel_lock_acquire ();
+
+  w->result = x;
+  sema_up (w->done);
+}
+
+/* Ups semaphore EXITED_, then exits.  Runs without the kernel
+   lock, like the thread that created it. */
+static void
+child (void *exited_)
+{
+  sema_up (exited_);
+}
+
+/* Creates W->amount threads, one at a time, waiting for each to
+   exit, without holding the kernel lock. */
+static void
+spawn (void *w_)
+{
+  struct worker *w = w_;
+  struct semaphore exited;
+  int i;
+
+  sema_init (&exited, 0);
+  kernel_lock_release ();
+  for (i = 0; i < w->amount; i++)
+    {
+      thread_create ("child", PRI_DEFAULT, child, &exited);
+      sema_down (&exited);
+    }
+  kernel_lock_acquire ();
+  sema_up (w->done);
+}
+
+/* Runs FUNC in WORKERS threads that share TOTAL units of work
+   among themselves, and returns the elapsed time in
+   microseconds. */
+static int64_t
+run (thread_func *func, int workers, int total)
+{
+  struct worker w[CPU_MAX];
+  struct semaphore done;
+  uint64_t start;
+  int i;
+
+  sema_init (&done, 0);
+  start = rdtsc ();
+  for (i = 0; i < workers; i++)
+    {
+      w[i].amount = total / workers;
+      w[i].done = &done;
+      thread_create ("worker", PRI_DEFAULT, func, &w[i]);
+    }
+  for (i = 0; i < workers; i++)
+    sema_down (&done);
+  return (rdtsc () - start) / (timer_tsc_freq () / 1000000);
+}
+
+/* Runs FUNC, labeled NAME, with 1 through MAX_WORKERS workers. */
+static void
+run_phase (const char *name, thread_func *func, int total, int max_workers)
+{
+  int64_t base = 0;
+  int workers;
+
+  for (workers = 1; workers <= max_workers; workers++)
+    {
+      int64_t us = run (func, workers, total) + 1;
+      if (workers == 1)
+        base = us;
+      printf ("smpbench: %-7s %d worker%s %9"PRId64" us  speedup %3"PRId64
+              ".%02"PRId64"\n", name, workers, workers > 1 ? "s" : " ",
+              us, base * 100 / us / 100, base * 100 / us % 100);
+    }
+}
+
+/* Runs the benchmark. */
+void
+smpbench (char **argv UNUSED)
+{
+  int online = 0;
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    if (cpus[i].online)
+      online++;
+  printf ("smpbench: %d of %d CPUs online\n", online, cpu_cnt);
+
+  run_phase ("compute", compute, COMPUTE_ITERATIONS, online);
+  run_phase ("spawn", spawn, SPAWN_THREADS, online);
+}
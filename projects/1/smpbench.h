@@ -0,0 +1,6 @@
+#ifndef __SMPBENCH_H__
+#define __SMPBENCH_H__
+
+void smpbench (char **argv);
+
+#endif
@@ -0,0 +1,67 @@
+#include "projects/1/spawnbench.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Measures what it costs to create a thread and let it exit.
+   Spawns short-lived threads one at a time, so that each one has
+   died before the next is created, and then in bursts of
+   SPAWNBENCH_BURST, so that up to a burst's worth of pages are
+   dying at once.  Run it once as is and once with
+   -no=thread-cache to compare reusing the pages of dead threads
+   with allocating fresh ones. */
+
+#define SPAWNBENCH_THREADS 4096         /* Threads per pass. */
+#define SPAWNBENCH_BURST 32             /* Threads per burst. */
+
+/* Ups semaphore EXITED_, then exits. */
+static void
+child (void *exited_)
+{
+  sema_up (exited_);
+}
+
+/* Spawns SPAWNBENCH_THREADS threads, BURST at a time, and
+   returns the average TSC cycles per thread. */
+static uint64_t
+spawn (int burst)
+{
+  struct semaphore exited;
+  uint64_t start;
+  int i, j;
+
+  sema_init (&exited, 0);
+  start = rdtsc ();
+  for (i = 0; i < SPAWNBENCH_THREADS; i += burst)
+    {
+      for (j = 0; j < burst; j++)
+        thread_create ("child", PRI_DEFAULT, child, &exited);
+      for (j = 0; j < burst; j++)
+        sema_down (&exited);
+    }
+  return (rdtsc () - start) / SPAWNBENCH_THREADS;
+}
+
+/* Runs one pass, labeled NAME. */
+static void
+run_pass (const char *name)
+{
+  uint64_t single = spawn (1);
+  uint64_t burst = spawn (SPAWNBENCH_BURST);
+
+  printf ("spawnbench: %-9s %7"PRIu64" cycles/thread one at a time, "
+          "%7"PRIu64" in bursts of %d\n",
+          name, single, burst, SPAWNBENCH_BURST);
+}
+
+/* Runs the benchmark. */
+void
+spawnbench (char **argv UNUSED)
+{
+  printf ("spawnbench: %d threads per pass\n", SPAWNBENCH_THREADS);
+  run_pass (feature_enabled (FEATURE_THREAD_CACHE) ? "recycled" : "fresh");
+}
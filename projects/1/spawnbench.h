@@ -0,0 +1,6 @@
+#ifndef __SPAWNBENCH_H__
+#define __SPAWNBENCH_H__
+
+void spawnbench (char **argv);
+
+#endif
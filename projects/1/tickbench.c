@@ -0,0 +1,82 @@
+#include "projects/1/tickbench.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Counts interrupts per second while the CPU is idle, while one
+   thread keeps it busy, and while several threads share it, so
+   that the periodic tick can be compared against -tickless.
+   Without -tickless the timer interrupts TIMER_FREQ times a
+   second in every phase; with it, only the last phase, where
+   time slices have to end, should need that many. */
+
+#define TICKBENCH_SECONDS 2     /* Length of each phase. */
+#define TICKBENCH_MAX_SPINNERS 4
+
+/* Shared with the spinning threads. */
+struct tickbench_phase
+  {
+    int64_t end;                /* Tick at which to stop spinning. */
+    struct semaphore done;      /* Upped by each spinner at the end. */
+  };
+
+/* Keeps the CPU busy until the end of phase PHASE_. */
+static void
+spin (void *phase_)
+{
+  struct tickbench_phase *phase = phase_;
+
+  while (timer_ticks () < phase->end)
+    barrier ();
+  sema_up (&phase->done);
+}
+
+/* Runs a phase with SPINNERS threads spinning while we sleep,
+   and prints the timer and external interrupts per second. */
+static void
+run_phase (const char *name, int spinners)
+{
+  struct tickbench_phase phase;
+  int64_t start, timer_start;
+  long long intr_start;
+  int64_t timer_cnt;
+  long long intr_cnt;
+  int i;
+
+  ASSERT (spinners <= TICKBENCH_MAX_SPINNERS);
+
+  sema_init (&phase.done, 0);
+  start = timer_ticks ();
+  phase.end = start + TICKBENCH_SECONDS * TIMER_FREQ;
+  timer_start = timer_interrupts ();
+  intr_start = intr_external_count ();
+
+  for (i = 0; i < spinners; i++)
+    thread_create ("spinner", PRI_DEFAULT, spin, &phase);
+  timer_sleep (phase.end - timer_ticks ());
+  for (i = 0; i < spinners; i++)
+    sema_down (&phase.done);
+
+  timer_cnt = timer_interrupts () - timer_start;
+  intr_cnt = intr_external_count () - intr_start;
+  printf ("tickbench: %-12s %2d spinners  %5"PRId64" timer/s  "
+          "%5lld interrupts/s  %"PRId64" ticks\n",
+          name, spinners, timer_cnt / TICKBENCH_SECONDS,
+          intr_cnt / TICKBENCH_SECONDS, timer_ticks () - start);
+}
+
+/* Runs the benchmark. */
+void
+tickbench (char **argv UNUSED)
+{
+  printf ("tickbench: %s tick, %d Hz, %d s per phase\n",
+          timer_tickless ? "dynamic" : "periodic", TIMER_FREQ,
+          TICKBENCH_SECONDS);
+  run_phase ("idle", 0);
+  run_phase ("one busy", 1);
+  run_phase ("time-sliced", TICKBENCH_MAX_SPINNERS);
+}
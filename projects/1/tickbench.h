@@ -0,0 +1,6 @@
+#ifndef __TICKBENCH_H__
+#define __TICKBENCH_H__
+
+void tickbench (char **argv);
+
+#endif
@@ -0,0 +1,126 @@
+#include "projects/1/workbench.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+#include "threads/workqueue.h"
+
+/* Compares the cost of running small jobs in threads of their
+   own with running them on a workqueue, then checks how late
+   delayed work runs.  Each job just bumps a counter. */
+
+#define WORKBENCH_JOBS 1024             /* Jobs per pass. */
+#define WORKBENCH_WORKERS 2             /* Workqueue workers. */
+#define WORKBENCH_DELAYED 16            /* Delayed jobs. */
+
+/* A job. */
+struct job
+  {
+    struct work work;           /* Work item. */
+    int64_t due_tick;           /* Tick it was due at, if delayed. */
+    int64_t late;               /* Ticks it ran late, if delayed. */
+  };
+
+static struct job jobs[WORKBENCH_JOBS];
+static struct workqueue bench_wq;
+static int counter;
+
+/* Job as a thread.  Ups semaphore DONE_ when finished. */
+static void
+job_thread (void *done_)
+{
+  counter++;
+  sema_up (done_);
+}
+
+/* Job as a work item. */
+static void
+job_work (struct work *w UNUSED)
+{
+  counter++;
+}
+
+/* Delayed job as a work item. */
+static void
+delayed_work (struct work *w)
+{
+  struct job *j = (struct job *) ((uint8_t *) w
+                                  - offsetof (struct job, work));
+  j->late = timer_ticks () - j->due_tick;
+}
+
+/* Returns the TSC cycles per job taken since START. */
+static uint64_t
+per_job (uint64_t start)
+{
+  return (rdtsc () - start) / WORKBENCH_JOBS;
+}
+
+/* Runs the benchmark. */
+void
+workbench (char **argv UNUSED)
+{
+  static bool started;
+  struct semaphore done;
+  uint64_t start;
+  int64_t max_late = 0;
+  int i;
+
+  if (!started)
+    {
+      workqueue_init (&bench_wq, "bench-worker");
+      workqueue_start (&bench_wq, WORKBENCH_WORKERS, PRI_DEFAULT);
+      started = true;
+    }
+
+  /* One thread per job. */
+  counter = 0;
+  sema_init (&done, 0);
+  start = rdtsc ();
+  for (i = 0; i < WORKBENCH_JOBS; i++)
+    thread_create ("job", PRI_DEFAULT, job_thread, &done);
+  for (i = 0; i < WORKBENCH_JOBS; i++)
+    sema_down (&done);
+  printf ("workbench: thread per job   %7"PRIu64" cycles/job (%d run)\n",
+          per_job (start), counter);
+
+  /* One work item per job. */
+  counter = 0;
+  start = rdtsc ();
+  for (i = 0; i < WORKBENCH_JOBS; i++)
+    {
+      work_init (&jobs[i].work, job_work);
+      work_queue (&bench_wq, &jobs[i].work);
+    }
+  workqueue_flush (&bench_wq);
+  printf ("workbench: workqueue        %7"PRIu64" cycles/job (%d run)\n",
+          per_job (start), counter);
+  workqueue_print_stats (&bench_wq);
+
+  /* Delayed work, every other item canceled. */
+  for (i = 0; i < WORKBENCH_DELAYED; i++)
+    {
+      work_init (&jobs[i].work, delayed_work);
+      jobs[i].due_tick = timer_ticks () + i + 1;
+      jobs[i].late = -1;
+      work_queue_delayed (&bench_wq, &jobs[i].work, i + 1);
+    }
+  for (i = 1; i < WORKBENCH_DELAYED; i += 2)
+    work_cancel (&jobs[i].work);
+  timer_sleep (WORKBENCH_DELAYED + 2);
+  workqueue_flush (&bench_wq);
+  for (i = 0; i < WORKBENCH_DELAYED; i++)
+    {
+      if (i % 2 == 0 && jobs[i].late < 0)
+        printf ("workbench: delayed job %d did not run\n", i);
+      else if (i % 2 == 1 && jobs[i].late >= 0)
+        printf ("workbench: canceled job %d ran\n", i);
+      if (jobs[i].late > max_late)
+        max_late = jobs[i].late;
+    }
+  printf ("workbench: delayed work ran at most %"PRId64" ticks late\n",
+          max_late);
+}
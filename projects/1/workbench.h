@@ -0,0 +1,6 @@
+#ifndef __WORKBENCH_H__
+#define __WORKBENCH_H__
+
+void workbench (char **argv);
+
+#endif
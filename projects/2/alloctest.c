@@ -1,119 +1,314 @@
+#include "projects/2/alloctest.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
 #include <stdio.h>
-
-void alloctest_NF(void);
-void alloctest_BF(void);
-void alloctest_BUDDY(void);
-void alloctest(void){
-
-
-//	alloctest_NF();
-//	alloctest_BF();
-	alloctest_BUDDY();
+#include <stdlib.h>
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/tsc.h"
+
+/* Placement benchmark.
+
+   Replays seeded synthetic allocation traces against the user
+   pool under every placement policy in turn, so that one boot
+   compares them all.  Each allocation in a trace has a size and
+   a lifetime, measured in allocations; a trace runs in three
+   phases:
+
+     1. Steady state: ALLOCTEST_STEPS allocations, each preceded
+        by freeing whatever has outlived its lifetime.  Every
+        allocation and free is timed.
+
+     2. Fragmentation: with the steady-state allocations still
+        live, we look at the longest run of free pages.  The
+        external-fragmentation index is 1 - longest / free, so 0
+        means all free pages are contiguous.  It is printed in
+        thousandths, since the kernel's printf() has no %f.
+
+     3. Exhaustion: ALLOCTEST_EXHAUST more allocations, with no
+        frees, show how much of the pool a policy can still
+        hand out once it is full.
+
+   The random generator is reseeded for every policy, and a trace
+   draws the same numbers whether or not its allocations succeed,
+   so every policy sees exactly the same requests.  It must be
+   run with -no=page-cache, or single-page requests would mostly
+   be served from the per-thread page caches and never reach the
+   policy under test. */
+
+#define ALLOCTEST_SEED 15841    /* Seed, so every policy sees one trace. */
+#define ALLOCTEST_STEPS 2048    /* Steady-state allocations per trace. */
+#define ALLOCTEST_EXHAUST 256   /* Allocations in exhaustion phase. */
+#define ALLOCTEST_LIVE 1024     /* Most allocations live at once. */
+#define ALLOCTEST_LOAD 60       /* Target steady-state load, in %. */
+#define LIFETIME_FOREVER UINT32_MAX     /* Never freed by the trace. */
+
+/* One allocation in a trace. */
+struct alloctest_alloc
+  {
+    void *pages;                /* Pages, or a null pointer if failed. */
+    size_t cnt;                 /* Number of pages. */
+    uint32_t death;             /* Step at which to free it. */
+  };
+
+/* A synthetic trace.  SIZE returns the size of the next request
+   in pages and LIFETIME its lifetime in steps; MEAN_LIFE is the
+   mean lifetime that keeps the pool about ALLOCTEST_LOAD% full. */
+struct alloctest_trace
+  {
+    const char *name;
+    size_t (*size) (void);
+    uint32_t (*lifetime) (uint32_t mean_life);
+    size_t mean_size;           /* Mean request size, in pages. */
+  };
+
+/* Uniform: 1 to 16 pages. */
+static size_t
+size_uniform (void)
+{
+  return 1 + random_ulong () % 16;
 }
 
-void alloctest_NF(void){
-
-	/* nextfit testcode */
-        char * mem[5];
-
-	for(size_t i=0;i<5;i++ ){
-		mem[i] = (char *)malloc(2048*6);
-		ASSERT(mem[i]);
-		memset(mem[i], 0X00, 2048*6);
-		palloc_get_status(0);
-	}
-
-	free(mem[1]);
-	palloc_get_status(0);
-
-	mem[1] = (char *)malloc(2048*6);
-	ASSERT(mem[1]);
-	memset(mem[1], 0X00, 2048*6);
-	palloc_get_status(0);
-
-
-
+/* Bimodal: mostly 1 or 2 pages, sometimes 24 to 32. */
+static size_t
+size_bimodal (void)
+{
+  unsigned long r = random_ulong ();
+  return r % 5 != 0 ? 1 + (r >> 8) % 2 : 24 + (r >> 8) % 9;
 }
-void alloctest_BUDDY(void){
-
-	/* buddy testcode */
-        char * mem[7];
-
-	for(size_t i=0;i<7;i++ ){
-		mem[i] = (char *)malloc(2048*6);
-		ASSERT(mem[i]);
-		memset(mem[i], 0X00, 2048*6);
-		palloc_get_status(0);
-	}
-	free(mem[1]);
-	palloc_get_status(0);
-
-	free(mem[2]);
-	palloc_get_status(0);
-
-	free(mem[4]);
-	palloc_get_status(0);
-
-	free(mem[5]);
-	palloc_get_status(0);
-
-	mem[1] = (char *)malloc(2048*6);
-	ASSERT(mem[1]);
-	memset(mem[1], 0X00, 2048*6);
-	palloc_get_status(0);
-
 
+/* Power of two: 1, 2, 4, 8 or 16 pages. */
+static size_t
+size_pow2 (void)
+{
+  return (size_t) 1 << random_ulong () % 5;
 }
-void alloctest_BF(void){
-	
-	/* bestfit testcode */
-        char * mem[6];
-     	mem[0] = (char *)malloc(2048*10);
-	ASSERT(mem[0]);
-	memset(mem[0], 0X00, 2048*10);
-	palloc_get_status(0);
-     	
-	mem[1] = (char *)malloc(2048*10);
-	ASSERT(mem[1]);
-	memset(mem[1], 0X00, 2048*10);
-	palloc_get_status(0);
-
-	mem[2] = (char *)malloc(2048*10);
-	ASSERT(mem[2]);
-	memset(mem[2], 0X00, 2048*10);
-	palloc_get_status(0);
-
-	mem[3] = (char *)malloc(2048*14);
-	ASSERT(mem[3]);
-	memset(mem[3], 0X00, 2048*14);
-	palloc_get_status(0);
 
+/* Long/short mix: 1 to 8 pages. */
+static size_t
+size_small (void)
+{
+  return 1 + random_ulong () % 8;
+}
 
-	mem[4] = (char *)malloc(2048*6);
-	ASSERT(mem[4]);
-	memset(mem[4], 0X00, 2048*6);
-	palloc_get_status(0);
-
-	mem[5] = (char *)malloc(2048*10);
-	ASSERT(mem[5]);
-	memset(mem[5], 0X00, 2048*10);
-	palloc_get_status(0);
-
-	free(mem[1]);
-	palloc_get_status(0);
-
+/* Uniform between 1 and twice the mean. */
+static uint32_t
+life_uniform (uint32_t mean_life)
+{
+  return 1 + random_ulong () % (2 * mean_life);
+}
 
-	free(mem[4]);
-	palloc_get_status(0);
+/* One in ten allocations lives for the rest of the trace; the
+   others are gone after a few steps. */
+static uint32_t
+life_long_short (uint32_t mean_life)
+{
+  unsigned long r = random_ulong ();
+  return r % 10 == 0 ? LIFETIME_FOREVER : 1 + (r >> 8) % (mean_life / 4 + 1);
+}
 
-	mem[4] = (char *)malloc(2048*6);
-	ASSERT(mem[4]);
-	memset(mem[4], 0X00, 2048*6);
-	palloc_get_status(0);
+static const struct alloctest_trace traces[] =
+  {
+    {"uniform", size_uniform, life_uniform, 9},
+    {"bimodal", size_bimodal, life_uniform, 7},
+    {"pow2", size_pow2, life_uniform, 6},
+    {"long/short", size_small, life_long_short, 5},
+  };
+
+/* Placement policies under test. */
+static const struct
+  {
+    const char *name;
+    enum palloc_allocator policy;
+  }
+policies[] =
+  {
+    {"FF", ALLOCATOR_FF},
+    {"NF", ALLOCATOR_NF},
+    {"BF", ALLOCATOR_BF},
+    {"BUDDY", ALLOCATOR_BUDDY},
+    {"WF", ALLOCATOR_WF},
+  };
+
+static struct alloctest_alloc live[ALLOCTEST_LIVE];
+static uint64_t alloc_cycles[ALLOCTEST_STEPS];
+static uint64_t free_cycles[ALLOCTEST_STEPS];
+
+/* Compares the uint64_t values that A and B point to, for
+   qsort(). */
+static int
+compare_cycles (const void *a_, const void *b_)
+{
+  const uint64_t *a = a_;
+  const uint64_t *b = b_;
+
+  return *a < *b ? -1 : *a > *b;
+}
 
+/* Sorts the CNT samples in CYCLES and prints their percentiles
+   under NAME. */
+static void
+print_percentiles (const char *name, uint64_t *cycles, size_t cnt)
+{
+  if (cnt == 0)
+    {
+      printf ("  %-5s no samples\n", name);
+      return;
+    }
+  qsort (cycles, cnt, sizeof *cycles, compare_cycles);
+  printf ("  %-5s cycles p50 %6"PRIu64"  p90 %6"PRIu64"  p99 %6"PRIu64
+          "  max %7"PRIu64"\n", name, cycles[cnt / 2],
+          cycles[cnt * 9 / 10], cycles[cnt * 99 / 100], cycles[cnt - 1]);
+}
 
+/* Times freeing A. */
+static uint64_t
+timed_free (struct alloctest_alloc *a)
+{
+  uint64_t start = rdtsc ();
+  palloc_free_multiple (a->pages, a->cnt);
+  return rdtsc () - start;
+}
 
-	
+/* Finds a slot in LIVE for a new allocation at STEP, freeing
+   allocations that are due as it goes.  Adds the cost of each
+   free to FREE_CYCLES, counting them in *FREE_CNT unless
+   TIMED is false.  Returns a null pointer if LIVE is full. */
+static struct alloctest_alloc *
+retire (uint32_t step, bool timed, size_t *free_cnt)
+{
+  struct alloctest_alloc *slot = NULL;
+  size_t i;
+
+  for (i = 0; i < ALLOCTEST_LIVE; i++)
+    {
+      struct alloctest_alloc *a = &live[i];
+
+      if (a->pages != NULL && a->death <= step)
+        {
+          uint64_t cycles = timed_free (a);
+          if (timed && *free_cnt < ALLOCTEST_STEPS)
+            free_cycles[(*free_cnt)++] = cycles;
+          a->pages = NULL;
+        }
+      if (a->pages == NULL && slot == NULL)
+        slot = a;
+    }
+  return slot;
+}
 
+/* Runs TRACE against the user pool, whose USABLE pages are all
+   free, under the placement policy named NAME, and prints what
+   it finds. */
+static void
+run_trace (const struct alloctest_trace *trace, const char *name,
+           size_t usable)
+{
+  uint32_t mean_life = usable * ALLOCTEST_LOAD / 100 / trace->mean_size;
+  size_t alloc_cnt = 0, free_cnt = 0, failed = 0, exhaust_ok = 0;
+  size_t free_pages, largest, i;
+  uint32_t step;
+
+  /* Leave some slots in LIVE for the exhaustion phase. */
+  if (mean_life > ALLOCTEST_LIVE / 2)
+    mean_life = ALLOCTEST_LIVE / 2;
+  if (mean_life == 0)
+    mean_life = 1;
+
+  random_init (ALLOCTEST_SEED);
+
+  /* Steady state. */
+  for (step = 0; step < ALLOCTEST_STEPS; step++)
+    {
+      struct alloctest_alloc *a = retire (step, true, &free_cnt);
+      size_t cnt = trace->size ();
+      uint32_t life = trace->lifetime (mean_life);
+      uint64_t start;
+      void *pages;
+
+      start = rdtsc ();
+      pages = palloc_get_multiple (PAL_USER, cnt);
+      alloc_cycles[alloc_cnt++] = rdtsc () - start;
+
+      if (pages == NULL)
+        failed++;
+      else if (a == NULL)
+        palloc_free_multiple (pages, cnt);
+      else
+        {
+          a->pages = pages;
+          a->cnt = cnt;
+          a->death = life == LIFETIME_FOREVER ? life : step + life;
+        }
+    }
+
+  /* Fragmentation. */
+  palloc_free_stats (PAL_USER, &free_pages, &largest);
+
+  /* Exhaustion. */
+  for (i = 0; i < ALLOCTEST_EXHAUST; i++)
+    {
+      struct alloctest_alloc *a = retire (0, false, NULL);
+      size_t cnt = trace->size ();
+      void *pages;
+
+      trace->lifetime (mean_life);
+      pages = palloc_get_multiple (PAL_USER, cnt);
+      if (pages == NULL)
+        continue;
+      exhaust_ok++;
+      if (a == NULL)
+        palloc_free_multiple (pages, cnt);
+      else
+        {
+          a->pages = pages;
+          a->cnt = cnt;
+          a->death = LIFETIME_FOREVER;
+        }
+    }
+
+  /* Clean up. */
+  retire (LIFETIME_FOREVER, false, NULL);
+
+  printf ("%s/%s: %zu of %d steady-state allocations failed\n",
+          trace->name, name, failed, ALLOCTEST_STEPS);
+  print_percentiles ("alloc", alloc_cycles, alloc_cnt);
+  print_percentiles ("free", free_cycles, free_cnt);
+  printf ("  largest free extent %zu of %zu free pages, "
+          "fragmentation %zu/1000\n", largest, free_pages,
+          free_pages > 0 ? 1000 - largest * 1000 / free_pages : 0);
+  printf ("  exhaustion: %zu of %d allocations succeeded (%zu%%)\n",
+          exhaust_ok, ALLOCTEST_EXHAUST, exhaust_ok * 100 / ALLOCTEST_EXHAUST);
 }
 
+/* Runs every trace under every placement policy against the user
+   pool, which must be otherwise unused, then puts the pool back
+   under the policy chosen at boot. */
+void
+alloctest (char **argv UNUSED)
+{
+  size_t usable, largest;
+  size_t t, p;
+
+  if (feature_enabled (FEATURE_PAGE_CACHE))
+    {
+      printf ("alloctest: needs the page caches off (use -no=page-cache)\n");
+      return;
+    }
+  if (!palloc_set_policy (PAL_USER, pallocator_user))
+    PANIC ("alloctest: user pool is in use");
+  palloc_free_stats (PAL_USER, &usable, &largest);
+  printf ("alloctest: %zu user pages, seed %d, %d steps\n",
+          usable, ALLOCTEST_SEED, ALLOCTEST_STEPS);
+
+  for (t = 0; t < sizeof traces / sizeof *traces; t++)
+    for (p = 0; p < sizeof policies / sizeof *policies; p++)
+      {
+        if (!palloc_set_policy (PAL_USER, policies[p].policy))
+          PANIC ("alloctest: user pool did not drain");
+        run_trace (&traces[t], policies[p].name, usable);
+      }
+
+  palloc_set_policy (PAL_USER, pallocator_user);
+}
@@ -1,6 +1,6 @@
 #ifndef __ALLOCTEST_H__
 #define __ALLOCTEST_H__
 
-void alloctest(void);
+void alloctest (char **argv);
 
 #endif
@@ -0,0 +1,151 @@
+#include "projects/2/scanbench.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/palloc.h"
+#include "threads/tsc.h"
+
+/* Micro-benchmark for the bitmap scanners behind the placement
+   policies.  Each policy replays the same seeded stream of
+   allocations and frees against a private, pre-fragmented
+   bitmap as large as a big user pool, and we report how many
+   cycles each allocation (scan plus flip) took on average. */
+
+#define SCANBENCH_SEED 15841    /* Seed, so every policy sees one trace. */
+#define SCANBENCH_PAGES 16384   /* Bitmap size: a 64 MB pool. */
+#define SCANBENCH_ROUNDS 4096   /* Allocations per policy. */
+#define SCANBENCH_LIVE 128      /* Allocations kept live at once. */
+#define SCANBENCH_MAX_CNT 16    /* Largest allocation, in pages. */
+
+/* One live allocation. */
+struct scanbench_alloc
+  {
+    size_t idx;                 /* First page. */
+    size_t cnt;                 /* Number of pages. */
+  };
+
+/* A scanner under test.  Returns the first page of a free run of
+   CNT pages in B, without marking it, or BITMAP_ERROR. */
+typedef size_t scan_func (struct bitmap *b, size_t cnt);
+
+/* First fit, testing one bit at a time, as bitmap_scan() used to.
+   Kept here as the baseline the word-at-a-time scanners are
+   measured against. */
+static size_t
+scan_bitwise (struct bitmap *b, size_t cnt)
+{
+  size_t last = bitmap_size (b) - cnt;
+  size_t i, j;
+
+  for (i = 0; i <= last; i++)
+    {
+      for (j = 0; j < cnt; j++)
+        if (bitmap_test (b, i + j))
+          break;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
+
+static size_t
+scan_ff (struct bitmap *b, size_t cnt)
+{
+  return bitmap_scan (b, 0, cnt, false);
+}
+
+static size_t
+scan_nf (struct bitmap *b, size_t cnt)
+{
+  return bitmap_scan_NF (b, 0, cnt, false);
+}
+
+static size_t
+scan_bf (struct bitmap *b, size_t cnt)
+{
+  return bitmap_scan_BF (b, 0, cnt, false);
+}
+
+/* Marks roughly two thirds of B as used, in runs of random
+   length, so that the scanners have holes of every size to step
+   over. */
+static void
+fragment (struct bitmap *b)
+{
+  size_t i = 0;
+
+  while (i < bitmap_size (b))
+    {
+      size_t used = 1 + random_ulong () % 8;
+      size_t hole = 1 + random_ulong () % 4;
+
+      if (used > bitmap_size (b) - i)
+        used = bitmap_size (b) - i;
+      bitmap_set_multiple (b, i, used, true);
+      i += used + hole;
+    }
+}
+
+/* Replays the benchmark trace with SCAN and prints the average
+   cost of an allocation under NAME. */
+static void
+run_scanner (const char *name, scan_func *scan)
+{
+  static struct scanbench_alloc live[SCANBENCH_LIVE];
+  struct bitmap *b;
+  uint64_t cycles = 0;
+  size_t failed = 0;
+  size_t round;
+
+  b = bitmap_create (SCANBENCH_PAGES);
+  if (b == NULL)
+    PANIC ("scanbench: out of memory");
+
+  random_init (SCANBENCH_SEED);
+  fragment (b);
+
+  for (round = 0; round < SCANBENCH_ROUNDS; round++)
+    {
+      struct scanbench_alloc *a = &live[round % SCANBENCH_LIVE];
+      size_t cnt = 1 + random_ulong () % SCANBENCH_MAX_CNT;
+      uint64_t start;
+      size_t idx;
+
+      /* Make room by retiring the oldest live allocation. */
+      if (round >= SCANBENCH_LIVE && a->idx != BITMAP_ERROR)
+        bitmap_set_multiple (b, a->idx, a->cnt, false);
+
+      start = rdtsc ();
+      idx = scan (b, cnt);
+      if (idx != BITMAP_ERROR)
+        {
+          bitmap_set_multiple (b, idx, cnt, true);
+          bitmap_modify_idx (b, idx + cnt);
+        }
+      cycles += rdtsc () - start;
+
+      if (idx == BITMAP_ERROR)
+        failed++;
+      a->idx = idx;
+      a->cnt = cnt;
+    }
+
+  printf ("scanbench: %-10s %6"PRIu64" cycles/alloc, %zu of %d failed\n",
+          name, cycles / SCANBENCH_ROUNDS, failed, SCANBENCH_ROUNDS);
+  bitmap_destroy (b);
+}
+
+/* Runs the scanner micro-benchmark for every word-at-a-time
+   placement policy, plus the old bit-at-a-time first fit. */
+void
+scanbench (char **argv UNUSED)
+{
+  printf ("scanbench: %d pages, %d allocations of 1-%d pages\n",
+          SCANBENCH_PAGES, SCANBENCH_ROUNDS, SCANBENCH_MAX_CNT);
+  run_scanner ("FF bitwise", scan_bitwise);
+  run_scanner ("FF", scan_ff);
+  run_scanner ("NF", scan_nf);
+  run_scanner ("BF", scan_bf);
+}
@@ -0,0 +1,6 @@
+#ifndef __SCANBENCH_H__
+#define __SCANBENCH_H__
+
+void scanbench (char **argv);
+
+#endif
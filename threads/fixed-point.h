@@ -0,0 +1,59 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* 17.14 fixed-point arithmetic, for the 4.4BSD scheduler.
+
+   A fixed_t holds a real number X as the integer X * FP_ONE in a
+   32-bit int: 17 bits before the binary point, 14 after, plus the
+   sign.  Products and quotients of two fixed_t values go through
+   64 bits so that they do not overflow on the way. */
+typedef int fixed_t;
+
+#define FP_SHIFT 14                     /* Bits after the point. */
+#define FP_ONE (1 << FP_SHIFT)          /* 1 as a fixed_t. */
+
+/* Converts integer N to fixed point. */
+static inline fixed_t
+fp_from_int (int n)
+{
+  return n * FP_ONE;
+}
+
+/* Converts X to an integer, rounding toward zero. */
+static inline int
+fp_trunc (fixed_t x)
+{
+  return x / FP_ONE;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int
+fp_round (fixed_t x)
+{
+  return x >= 0 ? (x + FP_ONE / 2) / FP_ONE : (x - FP_ONE / 2) / FP_ONE;
+}
+
+/* Returns X + N. */
+static inline fixed_t
+fp_add_int (fixed_t x, int n)
+{
+  return x + n * FP_ONE;
+}
+
+/* Returns X * Y. */
+static inline fixed_t
+fp_mul (fixed_t x, fixed_t y)
+{
+  return (int64_t) x * y / FP_ONE;
+}
+
+/* Returns X / Y. */
+static inline fixed_t
+fp_div (fixed_t x, fixed_t y)
+{
+  return (int64_t) x * FP_ONE / y;
+}
+
+#endif /* threads/fixed-point.h */
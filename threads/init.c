@@ -16,11 +16,14 @@
 #include "devices/vga.h"
 #include "devices/rtc.h"
 #include "threads/interrupt.h"
+#include "threads/lockstat.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/palloc-trace.h"
 #include "threads/pte.h"
+#include "threads/smp.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -30,8 +33,17 @@
 #include "userprog/tss.h"
 #else
 /* project #1 */
+#include "projects/1/balancebench.h"
+#include "projects/1/jitterbench.h"
+#include "projects/1/mutexbench.h"
+#include "projects/1/rwbench.h"
+#include "projects/1/smpbench.h"
+#include "projects/1/spawnbench.h"
 #include "projects/1/synctest.h"
+#include "projects/1/tickbench.h"
+#include "projects/1/workbench.h"
 #include "projects/2/alloctest.h"
+#include "projects/2/scanbench.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
@@ -59,10 +71,23 @@ static const char *swap_bdev_name;
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/* -no: Kernel features turned off. */
+static bool feature_off[FEATURE_CNT];
+
+/* Names of the kernel features, as given to -no. */
+static const char *feature_names[FEATURE_CNT] =
+  {
+    [FEATURE_PAGE_CACHE] = "page-cache",
+    [FEATURE_BALANCE] = "balance",
+    [FEATURE_THREAD_CACHE] = "thread-cache",
+    [FEATURE_LOCK_SPIN] = "lock-spin",
+  };
+
 static void bss_init (void);
 static void paging_init (void);
 
 static char **read_command_line (void);
+static void disable_features (char *names);
 static char **parse_options (char **argv);
 static void run_actions (char **argv);
 static void usage (void);
@@ -94,12 +119,12 @@ int main (void)
 	/* Greet user. */
 	printf ("Pintos booting with %'"PRIu32" kB RAM...\n",
 	        init_ram_pages * PGSIZE / 1024);
-	printf ("Using page allocator %d\n", pallocator);
+	printf ("Using page allocator %d for kernel pool, %d for user pool\n",
+	        pallocator, pallocator_user);
 
 	/* Initialize memory system. */
 	palloc_init (user_page_limit);
 	malloc_init ();
-	buddy_info_init();
 	paging_init ();
 
 	/* Segmentation. */
@@ -120,8 +145,10 @@ int main (void)
 
 	/* Start thread scheduler and enable interrupts. */
 	thread_start ();
+	palloc_zero_start ();
 	serial_init_queue ();
 	timer_calibrate ();
+	smp_init ();
 
 #ifdef FILESYS
 	/* Initialize file system. */
@@ -252,8 +279,22 @@ static char **parse_options (char **argv)
 #endif
 		else if (!strcmp (name, "-rs"))
 			random_init (atoi (value));
-		else if (!strcmp (name, "-ma"))
+		else if (!strcmp (name, "-ma")) {
+			char *user = strchr (value, ',');
 			pallocator = (enum palloc_allocator) atoi (value);
+			pallocator_user = user != NULL
+			  ? (enum palloc_allocator) atoi (user + 1) : pallocator;
+		}
+		else if (!strcmp (name, "-pt"))
+			palloc_trace_enabled = true;
+		else if (!strcmp (name, "-tickless"))
+			timer_tickless = true;
+		else if (!strcmp (name, "-mlfqs"))
+			thread_mlfqs = true;
+		else if (!strcmp (name, "-smp"))
+			smp_enabled = true;
+		else if (!strcmp (name, "-no") && value != NULL)
+			disable_features (value);
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
@@ -275,6 +316,36 @@ static char **parse_options (char **argv)
 	return argv;
 }
 
+/* Turns off the kernel features named in NAMES, a
+   comma-separated list. */
+static void
+disable_features (char *names)
+{
+	char *name, *save_ptr;
+
+	for (name = strtok_r (names, ",", &save_ptr); name != NULL;
+	     name = strtok_r (NULL, ",", &save_ptr)) {
+		int i;
+
+		for (i = 0; i < FEATURE_CNT; i++)
+			if (!strcmp (name, feature_names[i]))
+				break;
+		if (i == FEATURE_CNT)
+			PANIC ("unknown feature `%s' for -no (use -h for help)", name);
+		feature_off[i] = true;
+	}
+}
+
+/* Returns true unless FEATURE was turned off with -no.  The
+   answer is settled while the command line is parsed, before
+   any thread starts, so it never changes under a caller. */
+bool
+feature_enabled (enum kernel_feature feature)
+{
+	ASSERT (feature < FEATURE_CNT);
+	return !feature_off[feature];
+}
+
 /* Runs the task specified in ARGV[1]. */
 static void
 run_task (char **argv)
@@ -290,6 +361,29 @@ run_task (char **argv)
 	printf ("Execution of '%s' complete.\n", task);
 }
 
+/* Switches the pool named by ARGV[1], "kernel" or "user", to
+   the page allocator numbered ARGV[2], as soon as the pool has
+   drained. */
+static void
+set_allocator (char **argv)
+{
+	enum palloc_flags pool;
+
+	if (!strcmp (argv[1], "kernel"))
+		pool = 0;
+	else if (!strcmp (argv[1], "user"))
+		pool = PAL_USER;
+	else
+		PANIC ("ma: unknown pool `%s'", argv[1]);
+
+	if (palloc_set_policy (pool, (enum palloc_allocator) atoi (argv[2])))
+		printf ("%s pool now uses page allocator %s\n",
+		        argv[1], palloc_policy_name (pool));
+	else
+		printf ("%s pool still in use; it will switch once drained\n",
+		        argv[1]);
+}
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -307,6 +401,19 @@ run_actions (char **argv)
 		{"run", 2, run_task},
 		{"synctest", 1, synctest},
 		{"alloctest", 1, alloctest},
+		{"scanbench", 1, scanbench},
+		{"tickbench", 1, tickbench},
+		{"jitterbench", 1, jitterbench},
+		{"smpbench", 1, smpbench},
+		{"balancebench", 1, balancebench},
+		{"workbench", 1, workbench},
+		{"spawnbench", 1, spawnbench},
+		{"rwbench", 1, rwbench},
+		{"mutexbench", 1, mutexbench},
+		{"ma", 3, set_allocator},
+		{"ptdump", 1, palloc_trace_dump},
+		{"ptsave", 1, palloc_trace_save},
+		{"lockstat", 1, lockstat_dump},
 #ifdef FILESYS
 		{"ls", 1, fsutil_ls},
 		{"cat", 2, fsutil_cat},
@@ -362,6 +469,11 @@ usage (void)
 	        "  extract            Untar from scratch device into file system.\n"
 	        "  append FILE        Append FILE to tar file on scratch device.\n"
 #endif
+	        "  ma POOL NUM        Switch POOL (kernel or user) to memory allocator\n"
+	        "                     NUM (see -ma) once all its pages are free.\n"
+	        "  ptdump             Print the page allocator trace (see -pt).\n"
+	        "  ptsave             Write the page allocator trace to scratch device.\n"
+	        "  lockstat           Print the most contended locks (see lockstat.c).\n"
 	        "\nOptions:\n"
 	        "  -h                 Print this help message and power off.\n"
 	        "  -q                 Power off VM after actions or on panic.\n"
@@ -375,7 +487,15 @@ usage (void)
 #endif
 #endif
 	        "  -rs=SEED           Set random number seed to SEED.\n"
-	        "  -ma=NUM            Use specified memory allocator FF:0 NF:1\n"
+	        "  -ma=NUM[,NUM]      Use specified memory allocator FF:0 NF:1\n"
+	        "                     BF:2 BUDDY:3 WF:4, for the kernel pool\n"
+	        "                     and, if given, the second for the user pool\n"
+	        "  -pt                Trace page allocations and frees.\n"
+	        "  -tickless          Take timer interrupts only when needed.\n"
+	        "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+	        "  -smp               Start all CPUs, not just the boot CPU.\n"
+	        "  -no=FEATURE[,...]  Turn off kernel features: page-cache,\n"
+	        "                     balance, thread-cache, lock-spin.\n"
 #ifdef USERPROG
 	        "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
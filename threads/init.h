@@ -9,4 +9,19 @@
 /* Page directory with kernel mappings only. */
 extern uint32_t *init_page_dir;
 
+/* Optional kernel features.  All of them are on unless turned
+   off on the command line with -no=FEATURE[,FEATURE...], so that
+   a benchmark can compare a run with a feature against a run
+   without it.  None of them changes after boot. */
+enum kernel_feature
+  {
+    FEATURE_PAGE_CACHE,         /* "page-cache": palloc's thread caches. */
+    FEATURE_BALANCE,            /* "balance": balance run queues. */
+    FEATURE_THREAD_CACHE,       /* "thread-cache": reuse dead threads. */
+    FEATURE_LOCK_SPIN,          /* "lock-spin": spin on busy locks. */
+    FEATURE_CNT                 /* Number of features. */
+  };
+
+bool feature_enabled (enum kernel_feature);
+
 #endif /* threads/init.h */
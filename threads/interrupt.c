@@ -6,8 +6,10 @@
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/smp.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "devices/lapic.h"
 #include "devices/timer.h"
 
 /* Programmable Interrupt Controller (PIC) registers.
@@ -43,9 +45,19 @@ static unsigned int unexpected_cnt[INTR_CNT];
    pre-empted.  Handlers for external interrupts also may not
    sleep, although they may invoke intr_yield_on_return() to
    request that a new process be scheduled just before the
-   interrupt returns. */
-static bool in_external_intr;   /* Are we processing an external interrupt? */
-static bool yield_on_return;    /* Should we yield on interrupt return? */
+   interrupt returns.  Each CPU keeps its own in_external_intr
+   and yield_on_return flags in its struct cpu.
+
+   External interrupts come from the PICs, at 0x20...0x2f, or from
+   the CPU's local APIC, at 0xf0...0xff. */
+static long long external_cnt;  /* # of external interrupts handled. */
+
+/* Returns true if VEC_NO is an external interrupt vector. */
+static inline bool
+is_external (uint8_t vec_no)
+{
+  return (vec_no >= 0x20 && vec_no < 0x30) || vec_no >= 0xf0;
+}
 
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
@@ -157,6 +169,16 @@ intr_init (void)
   intr_names[19] = "#XF SIMD Floating-Point Exception";
 }
 
+/* Loads the IDT set up by intr_init() on an application
+   processor, the one we are running on.  The IDT is shared by
+   all CPUs. */
+void
+intr_init_ap (void)
+{
+  uint64_t idtr_operand = make_idtr_operand (sizeof idt - 1, idt);
+  asm volatile ("lidt %0" : : "m" (idtr_operand));
+}
+
 /* Registers interrupt VEC_NO to invoke HANDLER with descriptor
    privilege level DPL.  Names the interrupt NAME for debugging
    purposes.  The interrupt handler will be invoked with
@@ -181,7 +203,7 @@ void
 intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
                    const char *name) 
 {
-  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+  ASSERT (is_external (vec_no));
   register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
@@ -202,16 +224,26 @@ void
 intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
                    intr_handler_func *handler, const char *name)
 {
-  ASSERT (vec_no < 0x20 || vec_no > 0x2f);
+  ASSERT (!is_external (vec_no));
   register_handler (vec_no, dpl, level, handler, name);
 }
 
+/* Returns the number of external interrupts handled so far. */
+long long
+intr_external_count (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  long long cnt = external_cnt;
+  intr_set_level (old_level);
+  return cnt;
+}
+
 /* Returns true during processing of an external interrupt
    and false at all other times. */
 bool
 intr_context (void) 
 {
-  return in_external_intr;
+  return cpu_current ()->in_external_intr;
 }
 
 /* During processing of an external interrupt, directs the
@@ -222,7 +254,7 @@ void
 intr_yield_on_return (void) 
 {
   ASSERT (intr_context ());
-  yield_on_return = true;
+  cpu_current ()->yield_on_return = true;
 }
 
 /* 8259A Programmable Interrupt Controller. */
@@ -345,27 +377,36 @@ void
 intr_handler (struct intr_frame *frame) 
 {
   bool external;
+  bool took_kernel_lock;
   intr_handler_func *handler;
+  struct cpu *c;
+
+  /* With more than one CPU running, interrupt handlers run under
+     the kernel lock, like most of the kernel.  See smp.c. */
+  took_kernel_lock = kernel_lock_enter ();
 
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
-     and they need to be acknowledged on the PIC (see below).
-     An external interrupt handler cannot sleep. */
-  external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+     and they need to be acknowledged on the PIC or local APIC
+     (see below).  An external interrupt handler cannot sleep. */
+  external = is_external (frame->vec_no);
+  c = cpu_current ();
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (!intr_context ());
 
-      in_external_intr = true;
-      yield_on_return = false;
+      c->in_external_intr = true;
+      c->yield_on_return = false;
+      external_cnt++;
     }
 
   /* Invoke the interrupt's handler. */
   handler = intr_handlers[frame->vec_no];
   if (handler != NULL)
     handler (frame);
-  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f)
+  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f
+           || frame->vec_no == LAPIC_SPURIOUS_VEC)
     {
       /* There is no handler, but this interrupt can trigger
          spuriously due to a hardware fault or hardware race
@@ -380,12 +421,17 @@ intr_handler (struct intr_frame *frame)
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (intr_context ());
 
-      in_external_intr = false;
-      pic_end_of_interrupt (frame->vec_no); 
+      c->in_external_intr = false;
+      if (frame->vec_no < 0x30)
+        pic_end_of_interrupt (frame->vec_no); 
+      else if (frame->vec_no != LAPIC_SPURIOUS_VEC)
+        lapic_eoi ();
 
-      if (yield_on_return) 
+      if (c->yield_on_return) 
         thread_yield (); 
     }
+
+  kernel_lock_exit (took_kernel_lock);
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
@@ -0,0 +1,159 @@
+#include "threads/lockstat.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+
+/* Lock contention statistics.
+
+   When the kernel is built with LOCKSTAT defined, with
+   "make DEFINES=-DLOCKSTAT", lock_init() files each lock under
+   the class for its name, and lock_acquire(), sema_down(),
+   lock_release() and cond_wait() charge every acquisition, wait,
+   spin and hold to the lock's class.  Locks with the same name, such
+   as every inode's lock, share one class.  The "lockstat" action
+   prints the LOCKSTAT_TOP classes that spent the most time
+   waiting.
+
+   Without LOCKSTAT, none of this is compiled in: locks carry no
+   statistics and the synchronization primitives do no extra
+   work. */
+
+#define LOCKSTAT_CLASSES 64             /* Distinct lock names. */
+#define LOCKSTAT_TOP 16                 /* Classes printed. */
+
+#ifdef LOCKSTAT
+/* Lock classes.  The last one collects the locks whose names
+   did not fit. */
+static struct lock_class classes[LOCKSTAT_CLASSES];
+static size_t class_cnt;
+
+/* Returns the class for locks named NAME, creating it if
+   necessary. */
+struct lock_class *
+lockstat_class (const char *name)
+{
+  struct lock_class *c = NULL;
+  enum intr_level old_level;
+  size_t i;
+
+  ASSERT (name != NULL);
+
+  old_level = intr_disable ();
+  for (i = 0; i < class_cnt && c == NULL; i++)
+    if (!strcmp (classes[i].name, name))
+      c = &classes[i];
+  if (c == NULL)
+    {
+      if (class_cnt < LOCKSTAT_CLASSES)
+        {
+          c = &classes[class_cnt++];
+          strlcpy (c->name, class_cnt < LOCKSTAT_CLASSES ? name : "(other)",
+                   sizeof c->name);
+        }
+      else
+        c = &classes[LOCKSTAT_CLASSES - 1];
+    }
+  intr_set_level (old_level);
+
+  return c;
+}
+
+/* Charges an acquisition to class C, which waited WAIT cycles
+   for it if CONTENDED is true.  Interrupts must be off. */
+void
+lockstat_acquired (struct lock_class *c, bool contended, uint64_t wait)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  c->acquire_cnt++;
+  if (contended)
+    {
+      c->contended_cnt++;
+      c->wait_cycles += wait;
+      if (wait > c->max_wait_cycles)
+        c->max_wait_cycles = wait;
+    }
+}
+
+/* Charges a lock held for HOLD cycles to class C.  Interrupts
+   must be off. */
+void
+lockstat_released (struct lock_class *c, uint64_t hold)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  c->hold_cycles += hold;
+  if (hold > c->max_hold_cycles)
+    c->max_hold_cycles = hold;
+}
+
+/* Counts a cond_wait() on a lock of class C. */
+void
+lockstat_cond_wait (struct lock_class *c)
+{
+  enum intr_level old_level = intr_disable ();
+  c->cond_wait_cnt++;
+  intr_set_level (old_level);
+}
+
+/* Charges a spin of SPIN cycles on a running holder to class
+   C. */
+void
+lockstat_spun (struct lock_class *c, uint64_t spin)
+{
+  enum intr_level old_level = intr_disable ();
+  c->spin_cnt++;
+  c->spin_cycles += spin;
+  intr_set_level (old_level);
+}
+
+/* Prints the LOCKSTAT_TOP classes that spent the most time
+   waiting, most first. */
+void
+lockstat_dump (char **argv UNUSED)
+{
+  static struct lock_class snap[LOCKSTAT_CLASSES];
+  enum intr_level old_level;
+  size_t cnt, i, j;
+
+  /* Take a consistent copy, sorted by insertion. */
+  old_level = intr_disable ();
+  cnt = class_cnt;
+  for (i = 0; i < cnt; i++)
+    {
+      for (j = i; j > 0 && snap[j - 1].wait_cycles < classes[i].wait_cycles;
+           j--)
+        snap[j] = snap[j - 1];
+      snap[j] = classes[i];
+    }
+  intr_set_level (old_level);
+
+  printf ("lockstat: %zu lock classes, top %d by cycles waited\n",
+          cnt, LOCKSTAT_TOP);
+  printf ("%-16s %10s %9s %12s %10s %10s %10s %8s %8s %12s\n",
+          "name", "acquired", "contended", "wait", "max wait",
+          "avg hold", "max hold", "cond", "spins", "spin");
+  for (i = 0; i < cnt && i < LOCKSTAT_TOP; i++)
+    {
+      const struct lock_class *c = &snap[i];
+      uint64_t avg_hold = (c->acquire_cnt > 0
+                           ? c->hold_cycles / c->acquire_cnt : 0);
+
+      printf ("%-16s %10lld %9lld %12"PRIu64" %10"PRIu64" %10"PRIu64
+              " %10"PRIu64" %8lld %8lld %12"PRIu64"\n",
+              c->name, c->acquire_cnt, c->contended_cnt, c->wait_cycles,
+              c->max_wait_cycles, avg_hold, c->max_hold_cycles,
+              c->cond_wait_cnt, c->spin_cnt, c->spin_cycles);
+    }
+}
+#else /* !LOCKSTAT */
+/* Explains that there are no statistics to print. */
+void
+lockstat_dump (char **argv UNUSED)
+{
+  printf ("lockstat: not compiled in; rebuild with "
+          "\"make DEFINES=-DLOCKSTAT\"\n");
+}
+#endif /* !LOCKSTAT */
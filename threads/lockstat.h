@@ -0,0 +1,35 @@
+#ifndef THREADS_LOCKSTAT_H
+#define THREADS_LOCKSTAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Longest lock name kept, not counting the null terminator. */
+#define LOCKSTAT_NAME_MAX 23
+
+/* Contention statistics shared by all the locks with one name. */
+struct lock_class
+  {
+    char name[LOCKSTAT_NAME_MAX + 1];   /* Name given to lock_init(). */
+    long long acquire_cnt;              /* Acquisitions. */
+    long long contended_cnt;            /* Acquisitions that had to wait. */
+    uint64_t wait_cycles;               /* Total cycles spent waiting. */
+    uint64_t max_wait_cycles;           /* Longest wait. */
+    uint64_t hold_cycles;               /* Total cycles held. */
+    uint64_t max_hold_cycles;           /* Longest hold. */
+    long long cond_wait_cnt;            /* cond_wait() calls on the lock. */
+    long long spin_cnt;                 /* Spins on a running holder. */
+    uint64_t spin_cycles;               /* Total cycles spent spinning. */
+  };
+
+#ifdef LOCKSTAT
+struct lock_class *lockstat_class (const char *name);
+void lockstat_acquired (struct lock_class *, bool contended, uint64_t wait);
+void lockstat_released (struct lock_class *, uint64_t hold);
+void lockstat_cond_wait (struct lock_class *);
+void lockstat_spun (struct lock_class *, uint64_t spin);
+#endif
+
+void lockstat_dump (char **argv);
+
+#endif /* threads/lockstat.h */
@@ -6,27 +6,38 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/palloc.h"
+#include "threads/smp.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
 
-   The size of each request, in bytes, is rounded up to a power
-   of 2 and assigned to the "descriptor" that manages blocks of
-   that size.  The descriptor keeps a list of free blocks.  If
-   the free list is nonempty, one of its blocks is used to
-   satisfy the request.
+   The size of each request, in bytes, is rounded up to a
+   multiple of 16, for requests up to 256 bytes, or else to a
+   power of 2, and assigned to the "descriptor" that manages
+   blocks of that size.  The descriptor keeps a list of the
+   arenas (see below) that have free blocks, and each arena keeps
+   a list of its own free blocks.  If the descriptor's list is
+   nonempty, a block from its first arena is used to satisfy the
+   request.
 
    Otherwise, a new page of memory, called an "arena", is
    obtained from the page allocator (if none is available,
    malloc() returns a null pointer).  The new arena is divided
-   into blocks, all of which are added to the descriptor's free
-   list.  Then we return one of the new blocks.
+   into blocks, all of which go on the arena's free list, and the
+   arena goes on the descriptor's list.  Then we return one of
+   the new blocks.
 
-   When we free a block, we add it to its descriptor's free list.
-   But if the arena that the block was in now has no in-use
-   blocks, we remove all of the arena's blocks from the free list
-   and give the arena back to the page allocator.
+   When we free a block, we add it to its arena's free list.  But
+   if the arena now has no in-use blocks, we take it off the
+   descriptor's list and give it back to the page allocator, all
+   in constant time.
+
+   In front of the descriptors of up to 256 bytes, each thread
+   keeps a few free blocks of each size in its own cache, which
+   it can use without taking any lock.  A thread's cache goes to
+   and from the descriptors MALLOC_CACHE_BATCH blocks at a time.
 
    We can't handle blocks bigger than 2 kB using this scheme,
    because they're too big to fit in a single page with a
@@ -39,7 +50,7 @@ struct desc
   {
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
-    struct list free_list;      /* List of free blocks. */
+    struct list arenas;         /* Arenas with free blocks. */
     struct lock lock;           /* Lock. */
   };
 
@@ -52,20 +63,27 @@ struct arena
     unsigned magic;             /* Always set to ARENA_MAGIC. */
     struct desc *desc;          /* Owning descriptor, null for big block. */
     size_t free_cnt;            /* Free blocks; pages in big block. */
+    struct block *free_list;    /* Free blocks. */
+    struct list_elem elem;      /* Element in descriptor's arena list. */
   };
 
 /* Free block. */
 struct block 
   {
-    struct list_elem free_elem; /* Free list element. */
+    struct block *next;         /* Next free block. */
   };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[MALLOC_CACHE_CLASSES + 2];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct block *desc_get (struct desc *);
+static void desc_put (struct desc *, struct block *);
+static struct block *cache_get (struct desc *);
+static void cache_put (struct desc *, struct block *);
+static void cache_drain (struct desc *, size_t cnt);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -73,15 +91,35 @@ malloc_init (void)
 {
   size_t block_size;
 
-  for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
+  for (block_size = 16; block_size < PGSIZE / 2;
+       block_size += block_size < MALLOC_CACHE_MAX ? 16 : block_size)
     {
       struct desc *d = &descs[desc_cnt++];
+      char name[16];
+
       ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
-      list_init (&d->free_list);
-      lock_init (&d->lock);
+      list_init (&d->arenas);
+      snprintf (name, sizeof name, "malloc %zu", block_size);
+      lock_init (&d->lock, name);
     }
+  ASSERT (descs[MALLOC_CACHE_CLASSES - 1].block_size == MALLOC_CACHE_MAX);
+}
+
+/* Returns the smallest descriptor that satisfies a SIZE-byte
+   request, or a null pointer if SIZE is too big for any. */
+static struct desc *
+size_to_desc (size_t size)
+{
+  struct desc *d;
+
+  if (size <= MALLOC_CACHE_MAX)
+    return &descs[(size - 1) / 16];
+  for (d = descs + MALLOC_CACHE_CLASSES; d < descs + desc_cnt; d++)
+    if (d->block_size >= size)
+      return d;
+  return NULL;
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -90,7 +128,6 @@ void *
 malloc (size_t size) 
 {
   struct desc *d;
-  struct block *b;
   struct arena *a;
 
   /* A null pointer satisfies a request for 0 bytes. */
@@ -99,11 +136,9 @@ malloc (size_t size)
 
   /* Find the smallest descriptor that satisfies a SIZE-byte
      request. */
-  for (d = descs; d < descs + desc_cnt; d++)
-    if (d->block_size >= size)
-      break;
+  d = size_to_desc (size);
 
-  if (d == descs + desc_cnt) 
+  if (d == NULL) 
     {
 	          /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
@@ -124,38 +159,17 @@ malloc (size_t size)
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  if (d < descs + MALLOC_CACHE_CLASSES)
+    return cache_get (d);
+  else
     {
-      size_t i;
+      struct block *b;
 
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
+      lock_acquire (&d->lock);
+      b = desc_get (d);
+      lock_release (&d->lock);
+      return b;
     }
-
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
-  lock_release (&d->lock);
-  return b;
 }
 
 /* Allocates and return A times B bytes initialized to zeroes.
@@ -238,26 +252,14 @@ free (void *p)
           memset (b, 0xcc, d->block_size);
 #endif
   
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          if (d < descs + MALLOC_CACHE_CLASSES)
+            cache_put (d, b);
+          else
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              lock_acquire (&d->lock);
+              desc_put (d, b);
+              lock_release (&d->lock);
             }
-
-          lock_release (&d->lock);
         }
       else
         {
@@ -268,6 +270,177 @@ free (void *p)
     }
 }
 
+/* Returns every block in the current thread's cache to its
+   descriptor.  A thread must do this before it exits. */
+void
+malloc_cache_flush (void)
+{
+  struct desc *d;
+
+  for (d = descs; d < descs + MALLOC_CACHE_CLASSES; d++)
+    cache_drain (d, MALLOC_CACHE_SIZE);
+}
+
+/* Takes a free block from descriptor D and returns it, creating
+   a new arena if D has none with free blocks.  Returns a null
+   pointer if memory is not available.  D's lock must be held. */
+static struct block *
+desc_get (struct desc *d)
+{
+  struct arena *a;
+  struct block *b;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* If no arena has free blocks, create a new one. */
+  if (list_empty (&d->arenas))
+    {
+      size_t i;
+
+      /* Allocate a page. */
+      a = palloc_get_page (0);
+      if (a == NULL) 
+        return NULL; 
+
+      /* Initialize arena and put all its blocks on its free
+         list, lowest address first. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      a->free_list = NULL;
+      for (i = d->blocks_per_arena; i-- > 0; ) 
+        {
+          struct block *b = arena_to_block (a, i);
+          b->next = a->free_list;
+          a->free_list = b;
+        }
+      list_push_front (&d->arenas, &a->elem);
+    }
+
+  /* Get a block from the first arena's free list. */
+  a = list_entry (list_front (&d->arenas), struct arena, elem);
+  b = a->free_list;
+  a->free_list = b->next;
+  if (--a->free_cnt == 0)
+    list_remove (&a->elem);
+  return b;
+}
+
+/* Returns block B to descriptor D, freeing its arena if that
+   leaves the arena unused.  D's lock must be held. */
+static void
+desc_put (struct desc *d, struct block *b)
+{
+  struct arena *a = block_to_arena (b);
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+  ASSERT (a->desc == d);
+
+  /* Add block to its arena's free list.  An arena that was full
+     has free blocks again. */
+  b->next = a->free_list;
+  a->free_list = b;
+  if (a->free_cnt++ == 0)
+    list_push_front (&d->arenas, &a->elem);
+
+  /* If the arena is now entirely unused, free it. */
+  if (a->free_cnt >= d->blocks_per_arena) 
+    {
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      list_remove (&a->elem);
+      palloc_free_page (a);
+    }
+}
+
+/* Returns the current thread's cache of free blocks for
+   descriptor D, which must be one of the first
+   MALLOC_CACHE_CLASSES.  Sets *CNT to the number of blocks in
+   it and returns the address of the head of its list. */
+static void **
+thread_cache (struct desc *d, uint8_t **cnt)
+{
+  struct malloc_cache *c = &thread_current ()->malloc_cache;
+  size_t idx = d - descs;
+
+  *cnt = &c->cnt[idx];
+  return &c->blocks[idx];
+}
+
+/* Takes a block from the current thread's cache for descriptor
+   D, first refilling the cache from D if it is empty.  Returns a
+   null pointer if memory is not available. */
+static struct block *
+cache_get (struct desc *d)
+{
+  uint8_t *cnt;
+  void **head = thread_cache (d, &cnt);
+  struct block *b;
+
+  if (*cnt == 0)
+    {
+      lock_acquire (&d->lock);
+      while (*cnt < MALLOC_CACHE_BATCH)
+        {
+          b = desc_get (d);
+          if (b == NULL)
+            break;
+          b->next = *head;
+          *head = b;
+          ++*cnt;
+        }
+      lock_release (&d->lock);
+      if (*cnt == 0)
+        return NULL;
+    }
+
+  b = *head;
+  *head = b->next;
+  --*cnt;
+  return b;
+}
+
+/* Puts block B into the current thread's cache for descriptor
+   D, first returning part of the cache to D if it is full. */
+static void
+cache_put (struct desc *d, struct block *b)
+{
+  uint8_t *cnt;
+  void **head = thread_cache (d, &cnt);
+
+  if (*cnt == MALLOC_CACHE_SIZE)
+    cache_drain (d, MALLOC_CACHE_BATCH);
+  b->next = *head;
+  *head = b;
+  ++*cnt;
+}
+
+/* Returns up to CNT blocks from the current thread's cache for
+   descriptor D to D. */
+static void
+cache_drain (struct desc *d, size_t cnt)
+{
+  uint8_t *cache_cnt;
+  void **head = thread_cache (d, &cache_cnt);
+  bool acquired;
+
+  if (*cache_cnt == 0)
+    return;
+
+  /* A thread may exit without the kernel lock, which D's lock
+     relies on, so take it for the drain. */
+  acquired = kernel_lock_enter ();
+  lock_acquire (&d->lock);
+  while (cnt-- > 0 && *cache_cnt > 0)
+    {
+      struct block *b = *head;
+      *head = b->next;
+      --*cache_cnt;
+      desc_put (d, b);
+    }
+  lock_release (&d->lock);
+  kernel_lock_exit (acquired);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
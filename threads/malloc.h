@@ -3,8 +3,25 @@
 
 #include <debug.h>
 #include <stddef.h>
+#include <stdint.h>
+
+/* Per-thread cache of free malloc() blocks, for each of the
+   MALLOC_CACHE_CLASSES block sizes from 16 to MALLOC_CACHE_MAX
+   bytes in steps of 16.  Each size has a list of at most
+   MALLOC_CACHE_SIZE blocks, linked through their first words. */
+#define MALLOC_CACHE_MAX 256    /* Largest cached block size. */
+#define MALLOC_CACHE_CLASSES (MALLOC_CACHE_MAX / 16)
+#define MALLOC_CACHE_SIZE 8     /* Most blocks cached per size. */
+#define MALLOC_CACHE_BATCH 4    /* Blocks moved per refill or drain. */
+
+struct malloc_cache
+  {
+    void *blocks[MALLOC_CACHE_CLASSES]; /* Free blocks, per size. */
+    uint8_t cnt[MALLOC_CACHE_CLASSES];  /* Number of blocks, per size. */
+  };
 
 void malloc_init (void);
+void malloc_cache_flush (void);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
@@ -0,0 +1,212 @@
+#include "threads/palloc-trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/spinlock.h"
+#include "threads/tsc.h"
+
+/* Page allocator tracer.
+
+   While palloc_trace_enabled is true (the -pt option), every
+   call to palloc_get_multiple() and palloc_free_multiple() is
+   recorded in a ring buffer that keeps the last
+   PALLOC_TRACE_EVENTS events.  The "ptdump" action prints them
+   to the console and "ptsave" writes them to the scratch device,
+   both as text that utils/palloc-replay replays on the host:
+
+        palloc-trace: begin EVENTS LOST KERNEL_PAGES USER_PAGES
+        palloc-trace: TSC a|f k|u POLICY PAGE_IDX|- PAGE_CNT CALLER
+        ...
+        palloc-trace: end
+
+   LOST counts older events the ring no longer holds.  The
+   PAGE_IDX of an allocation that failed is "-". */
+
+#define PALLOC_TRACE_EVENTS 4096        /* Events kept in the ring. */
+
+/* One traced event. */
+struct palloc_event
+  {
+    uint64_t tsc;               /* Time stamp counter. */
+    void *caller;               /* Return address into the caller. */
+    uint32_t page_idx;          /* First page, or PALLOC_TRACE_FAILED. */
+    uint16_t page_cnt;          /* Number of pages. */
+    uint8_t type;               /* An enum palloc_trace_type. */
+    uint8_t user;               /* 1 for the user pool, 0 for kernel. */
+    uint8_t policy;             /* The pool's enum palloc_allocator. */
+  };
+
+/* Whether to record events. */
+bool palloc_trace_enabled;
+
+static struct palloc_event events[PALLOC_TRACE_EVENTS];
+static uint64_t event_cnt;      /* Events ever recorded. */
+
+/* Protects the ring, which CPUs may record into at once. */
+static struct spinlock events_lock = SPINLOCK_INITIALIZER;
+
+/* Records an event of the given TYPE in the user pool if USER
+   is true, otherwise in the kernel pool.  Only call this while
+   palloc_trace_enabled is true. */
+void
+palloc_trace_record (enum palloc_trace_type type, bool user, int policy,
+                     size_t page_idx, size_t page_cnt, void *caller)
+{
+  struct palloc_event *e;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&events_lock);
+  e = &events[event_cnt++ % PALLOC_TRACE_EVENTS];
+  e->tsc = rdtsc ();
+  e->caller = caller;
+  e->page_idx = page_idx;
+  e->page_cnt = page_cnt;
+  e->type = type;
+  e->user = user;
+  e->policy = policy;
+  spinlock_release (&events_lock);
+  intr_set_level (old_level);
+}
+
+/* Formats the line of trace output for the event with sequence
+   number SEQ, or for the header if SEQ is -1 or the trailer if
+   it is -2, into LINE, which has room for SIZE bytes. */
+static void
+format_line (char *line, size_t size, int64_t seq)
+{
+  const struct palloc_event *e;
+  uint64_t kept;
+
+  kept = event_cnt < PALLOC_TRACE_EVENTS ? event_cnt : PALLOC_TRACE_EVENTS;
+  if (seq == -1)
+    {
+      snprintf (line, size, "palloc-trace: begin %"PRIu64" %"PRIu64
+                " %zu %zu\n", kept, event_cnt - kept,
+                palloc_pool_size (0), palloc_pool_size (PAL_USER));
+      return;
+    }
+  if (seq == -2)
+    {
+      snprintf (line, size, "palloc-trace: end\n");
+      return;
+    }
+
+  e = &events[seq % PALLOC_TRACE_EVENTS];
+  if (e->page_idx == (uint32_t) PALLOC_TRACE_FAILED)
+    snprintf (line, size, "palloc-trace: %"PRIu64" %c %c %d - %u %p\n",
+              e->tsc, e->type == PALLOC_TRACE_ALLOC ? 'a' : 'f',
+              e->user ? 'u' : 'k', e->policy, e->page_cnt, e->caller);
+  else
+    snprintf (line, size, "palloc-trace: %"PRIu64" %c %c %d %"PRIu32
+              " %u %p\n", e->tsc, e->type == PALLOC_TRACE_ALLOC ? 'a' : 'f',
+              e->user ? 'u' : 'k', e->policy, e->page_idx, e->page_cnt,
+              e->caller);
+}
+
+/* Calls EMIT with each line of trace output and AUX, with
+   tracing paused. */
+static void
+trace_foreach (void (*emit) (const char *line, void *aux), void *aux)
+{
+  bool was_enabled = palloc_trace_enabled;
+  char line[96];
+  int64_t seq;
+
+  palloc_trace_enabled = false;
+  format_line (line, sizeof line, -1);
+  emit (line, aux);
+  for (seq = event_cnt - (event_cnt < PALLOC_TRACE_EVENTS
+                          ? event_cnt : PALLOC_TRACE_EVENTS);
+       (uint64_t) seq < event_cnt; seq++)
+    {
+      format_line (line, sizeof line, seq);
+      emit (line, aux);
+    }
+  format_line (line, sizeof line, -2);
+  emit (line, aux);
+  palloc_trace_enabled = was_enabled;
+}
+
+/* Prints LINE to the console. */
+static void
+print_line (const char *line, void *aux UNUSED)
+{
+  printf ("%s", line);
+}
+
+/* Prints the trace to the console, from which it reaches the
+   serial port. */
+void
+palloc_trace_dump (char **argv UNUSED)
+{
+  trace_foreach (print_line, NULL);
+}
+
+/* Trace output on its way to the scratch device. */
+struct scratch_writer
+  {
+    struct block *block;                /* Scratch device. */
+    block_sector_t sector;              /* Next sector to write. */
+    size_t ofs;                         /* Bytes used in BUFFER. */
+    bool truncated;                     /* Ran out of sectors? */
+    uint8_t buffer[BLOCK_SECTOR_SIZE];  /* Sector being filled. */
+  };
+
+/* Writes W's buffer to the scratch device, padded with null
+   bytes, unless the device is full. */
+static void
+scratch_flush (struct scratch_writer *w)
+{
+  if (w->sector < block_size (w->block))
+    {
+      memset (w->buffer + w->ofs, 0, BLOCK_SECTOR_SIZE - w->ofs);
+      block_write (w->block, w->sector++, w->buffer);
+    }
+  else
+    w->truncated = true;
+  w->ofs = 0;
+}
+
+/* Appends LINE to the scratch writer AUX. */
+static void
+scratch_line (const char *line, void *aux)
+{
+  struct scratch_writer *w = aux;
+
+  for (; *line != '\0'; line++)
+    {
+      w->buffer[w->ofs++] = *line;
+      if (w->ofs == BLOCK_SECTOR_SIZE)
+        scratch_flush (w);
+    }
+}
+
+/* Writes the trace to the beginning of the scratch device, from
+   which it can be read straight out of the disk image. */
+void
+palloc_trace_save (char **argv UNUSED)
+{
+  static struct scratch_writer w;
+
+  w.block = block_get_role (BLOCK_SCRATCH);
+  if (w.block == NULL)
+    {
+      printf ("ptsave: no scratch device\n");
+      return;
+    }
+  w.sector = 0;
+  w.ofs = 0;
+  w.truncated = false;
+  trace_foreach (scratch_line, &w);
+  scratch_flush (&w);
+  printf ("ptsave: wrote %"PRIu32" sectors to scratch device %s\n",
+          w.sector, block_name (w.block));
+  if (w.truncated)
+    printf ("ptsave: scratch device full, trace truncated\n");
+}
@@ -0,0 +1,24 @@
+#ifndef THREADS_PALLOC_TRACE_H
+#define THREADS_PALLOC_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Kinds of traced event. */
+enum palloc_trace_type
+  {
+    PALLOC_TRACE_ALLOC,         /* palloc_get_multiple(). */
+    PALLOC_TRACE_FREE           /* palloc_free_multiple(). */
+  };
+
+/* Page index recorded for an allocation that failed. */
+#define PALLOC_TRACE_FAILED ((size_t) -1)
+
+extern bool palloc_trace_enabled;
+
+void palloc_trace_record (enum palloc_trace_type, bool user, int policy,
+                          size_t page_idx, size_t page_cnt, void *caller);
+void palloc_trace_dump (char **argv);
+void palloc_trace_save (char **argv);
+
+#endif /* threads/palloc-trace.h */
@@ -1,5 +1,6 @@
 #include "threads/palloc.h"
 #include <bitmap.h>
+#include <buddy.h>
 #include <debug.h>
 #include <inttypes.h>
 #include <round.h>
@@ -7,9 +8,15 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
+#include "threads/palloc-trace.h"
+#include "threads/smp.h"
+#include "threads/spinlock.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
 
 /* Page allocator.  Hands out memory in page-size (or
    page-multiple) chunks.  See malloc.h for an allocator that
@@ -23,25 +30,154 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool has a spin lock of its own, so CPUs allocating from
+   different pools, or from their own page caches, do not wait for
+   each other, and palloc works without the kernel lock.  Nothing
+   that might sleep is called with a pool's lock held. */
+
+/* Free-extent index.
+
+   Alongside its bitmap, each pool indexes its maximal runs of
+   free pages ("extents") in an AVL tree ordered by length, with
+   ties broken by address.  That turns best fit and worst fit into
+   a walk down the tree instead of a sweep over the bitmap.
+
+   The tree lives in an array with one struct extent per page of
+   the pool, so it never allocates memory.  A free extent is
+   described by the entries for its first and last pages: both
+   record its length, and the first page's entry also holds its
+   tree links.  Entries for other pages are unused.  The index is
+   updated incrementally as pages are allocated and freed. */
+struct extent
+  {
+    size_t len;                         /* Length, at first and last page. */
+    size_t left;                        /* Shorter extents in tree. */
+    size_t right;                       /* Longer extents in tree. */
+    int height;                         /* Height of subtree. */
+  };
+
+/* Null link in the extent tree. */
+#define EXTENT_NONE SIZE_MAX
+
+struct pool;
+
+/* Placement policy.
+
+   Each pool places its allocations with one of these strategies.
+   SCAN picks where CNT pages go and returns the first, or
+   BITMAP_ERROR if they do not fit.  ALLOC takes the CNT pages at
+   PAGE_IDX that SCAN picked, and FREE gives back the CNT pages
+   allocated at PAGE_IDX; both return how many pages they
+   actually marked used or free.  STAT, if nonnull, prints the
+   policy's own state.  All of them but STAT are called with the
+   pool's lock held. */
+struct pool_policy
+  {
+    const char *name;
+    size_t (*scan) (struct pool *, size_t cnt);
+    size_t (*alloc) (struct pool *, size_t page_idx, size_t cnt);
+    size_t (*free) (struct pool *, size_t page_idx, size_t cnt);
+    void (*stat) (struct pool *);
+  };
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
+    struct spinlock lock;               /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+    struct extent *extents;             /* Free-extent index, per page. */
+    size_t extent_root;                 /* Root of extent tree. */
+    struct buddy *buddy;                /* Buddy allocator state. */
+    const struct pool_policy *policy;   /* Placement policy. */
+    const struct pool_policy *next_policy; /* Policy once drained. */
+    size_t used_cnt;                    /* Pages marked used. */
+    size_t cached_cnt;                  /* Pages in thread caches. */
+    void *clean;                        /* Zeroed free pages. */
+    size_t clean_cnt;                   /* Number of zeroed free pages. */
+    long long clean_hits;               /* PAL_ZERO pages taken zeroed. */
+    long long clean_misses;             /* PAL_ZERO pages zeroed inline. */
+    bool clean_wanted;                  /* Zeroer should refill. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* Pre-zeroed pages.
+
+   A low-priority "zeroer" workqueue takes free single pages from
+   each pool, zeroes them, and keeps up to CLEAN_TARGET of them
+   on the pool's clean list, linked through their first words.
+   Single-page PAL_ZERO allocations take from the clean list
+   first, so that, say, thread_create() and setup_stack() do not
+   pay for the memset themselves.  Clean pages stay marked used
+   in the pool; they go back to it if an allocation would
+   otherwise fail.  A pool's list is only filled once PAL_ZERO
+   allocations start drawing on it. */
+#define CLEAN_TARGET 16         /* Clean pages to keep per pool. */
+#define CLEAN_LOW (CLEAN_TARGET / 2)    /* Refill below this many. */
+
+static struct workqueue zero_wq;        /* Runs zero_work. */
+static struct work zero_work;           /* Refills the clean lists. */
+
+static work_func zero_pages;
+static void zeroer_wake (void);
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
+static enum intr_level pool_lock (struct pool *);
+static void pool_unlock (struct pool *, enum intr_level);
 static bool page_from_pool (const struct pool *, void *page);
+static void *cache_get (struct pool *);
+static void cache_put (struct pool *, void *page);
+static size_t cache_drain (struct pool *, bool batch);
+static void pool_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void *clean_get (struct pool *);
+static size_t clean_drain (struct pool *);
+static size_t reclaim (struct pool *);
+static size_t scan_first_fit (struct pool *, size_t cnt);
+static size_t scan_next_fit (struct pool *, size_t cnt);
+static size_t scan_best_fit (struct pool *, size_t cnt);
+static size_t scan_worst_fit (struct pool *, size_t cnt);
+static size_t scan_buddy (struct pool *, size_t cnt);
+static size_t mark_used (struct pool *, size_t page_idx, size_t cnt);
+static size_t alloc_buddy (struct pool *, size_t page_idx, size_t cnt);
+static size_t mark_free (struct pool *, size_t page_idx, size_t cnt);
+static size_t free_buddy (struct pool *, size_t page_idx, size_t cnt);
+static void stat_next_fit (struct pool *);
+static void stat_extents (struct pool *);
+static void stat_buddy (struct pool *);
+static const struct pool_policy *policy_for (enum palloc_allocator);
+static void switch_policy (struct pool *);
+static void extent_insert (struct pool *, size_t start, size_t len);
+static void extent_remove (struct pool *, size_t start);
+static size_t extent_best_fit (const struct pool *, size_t cnt);
+static size_t extent_worst_fit (const struct pool *, size_t cnt);
+static size_t extent_largest (const struct pool *);
+static void extent_carve (struct pool *, size_t page_idx, size_t page_cnt);
+static void extent_release (struct pool *, size_t page_idx,
+                            size_t page_cnt);
 
-/* The page allocation algorithm */
+/* The policies, indexed by enum palloc_allocator. */
+static const struct pool_policy policies[] =
+  {
+    [ALLOCATOR_FF] = {"FF", scan_first_fit, mark_used, mark_free, NULL},
+    [ALLOCATOR_NF] = {"NF", scan_next_fit, mark_used, mark_free,
+                      stat_next_fit},
+    [ALLOCATOR_BF] = {"BF", scan_best_fit, mark_used, mark_free,
+                      stat_extents},
+    [ALLOCATOR_BUDDY] = {"BUDDY", scan_buddy, alloc_buddy, free_buddy,
+                         stat_buddy},
+    [ALLOCATOR_WF] = {"WF", scan_worst_fit, mark_used, mark_free,
+                      stat_extents},
+  };
+
+/* The page allocation algorithm, for the kernel pool and for
+   the user pool. */
 enum palloc_allocator pallocator = 0;
+enum palloc_allocator pallocator_user = 0;
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -65,81 +201,101 @@ palloc_init (size_t user_page_limit)
   init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
              user_pages, "user pool");
+  kernel_pool.policy = policy_for (pallocator);
+  user_pool.policy = policy_for (pallocator_user);
+  workqueue_init (&zero_wq, "zeroer");
+  work_init (&zero_work, zero_pages);
+}
+
+/* Starts the worker that keeps the pools' clean lists filled.
+   Must be called after thread_start(). */
+void
+palloc_zero_start (void)
+{
+  workqueue_start (&zero_wq, 1, PRI_MIN);
 }
 
 
 //jjeong
-/* int pool there is pallocator which decides the method of memory allocation
- * 0 is for first fit
- * 1 is for next fit
- * 2 is for best fit
- * 3 is for buddy system
+/* int pool there is policy which decides the method of memory allocation
+ * it finds the page index for the allocation first
+ * and then marks the pages used in the pool.
+ * POOL's lock must be held.
  * */
-size_t select_memory_allocate(struct bitmap *b, size_t start, size_t cnt, bool value){
-  size_t page_idx;
-  if(pallocator==ALLOCATOR_FF)
- 	goto PALLOC;	 
-  else if(pallocator==ALLOCATOR_NF){
-	start = bitmap_scan_NF(b, 0, cnt, false);
- 	goto PALLOC;	 
-  }
-	  
-  else if(pallocator==ALLOCATOR_BF){
-  	start = bitmap_scan_BF (b, start, cnt, false);
- 	goto PALLOC;	 
-  }
-  else if(pallocator==ALLOCATOR_BUDDY){
-  	start= bitmap_scan_BUDDY (b, start, cnt, false);
- 	goto PALLOC;	 
-  }
-  /* if the -ma option is not 0 to 3 we just run first fit*/
-  else 
- 	goto PALLOC;	 
-
- /* after each option we store page index for allocation
-  * run bitmap_scan and flip using this index
-  * */
- PALLOC:
-  	page_idx = bitmap_scan_and_flip (b, start, cnt, false);
- 	
-	/* this is for next fit index updating*/
-	if(page_idx!=BITMAP_ERROR)
-		b = bitmap_modify_idx(b,page_idx+cnt); 
+static size_t
+select_memory_allocate (struct pool *pool, size_t cnt)
+{
+  size_t page_idx = pool->policy->scan (pool, cnt);
 
-  return  page_idx;
- 
+  if(page_idx==BITMAP_ERROR)
+	return BITMAP_ERROR;
+  pool->policy->alloc (pool, page_idx, cnt);
+  return page_idx;
 }
 
-/* Obtains and returns a group of PAGE_CNT contiguous free pages.
-   If PAL_USER is set, the pages are obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
-   then the pages are filled with zeros.  If too few pages are
-   available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
-void *
-palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+/* Takes PAGE_CNT contiguous free pages from POOL and returns
+   the first, or a null pointer if there are not enough.  Single
+   pages come from the current thread's cache, unless it was
+   turned off with -no=page-cache. */
+static void *
+get_pages (struct pool *pool, size_t page_cnt)
 {
-  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-  void *pages;
+  enum intr_level old_level;
   size_t page_idx;
 
-  if (page_cnt == 0)
-    return NULL;
+  if (page_cnt == 1 && feature_enabled (FEATURE_PAGE_CACHE))
+    return cache_get (pool);
 
-  lock_acquire (&pool->lock);
+  old_level = pool_lock (pool);
 
   //jjeong
   /* for memory allocating 
    * 1. find the index fot allocation with allocation method
    * 2. update the bitmap representing allocation status
    * */
-  page_idx = select_memory_allocate (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  page_idx = select_memory_allocate (pool, page_cnt);
+  pool_unlock (pool, old_level);
 
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
+  return page_idx != BITMAP_ERROR ? pool->base + PGSIZE * page_idx : NULL;
+}
+
+/* Obtains and returns a group of PAGE_CNT contiguous free pages,
+   for palloc_get_multiple() or palloc_get_page() called from
+   CALLER. */
+static void *
+get_multiple (enum palloc_flags flags, size_t page_cnt, void *caller)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  void *pages = NULL;
+
+  if (page_cnt == 0)
+    return NULL;
+
+  /* A single zeroed page is best taken already zeroed. */
+  if (page_cnt == 1 && (flags & PAL_ZERO))
+    {
+      pages = clean_get (pool);
+      if (pages != NULL)
+        flags &= ~PAL_ZERO;
+    }
+
+  if (pages == NULL)
+    {
+      pages = get_pages (pool, page_cnt);
+
+      /* Pages sitting in our own cache or on the clean list might
+         be just what is missing, so give them back and try once
+         more. */
+      if (pages == NULL && reclaim (pool) > 0)
+        pages = get_pages (pool, page_cnt);
+    }
+
+  if (palloc_trace_enabled)
+    palloc_trace_record (PALLOC_TRACE_ALLOC, pool == &user_pool,
+                         pool->policy - policies,
+                         pages != NULL ? pg_no (pages) - pg_no (pool->base)
+                                       : PALLOC_TRACE_FAILED,
+                         page_cnt, caller);
 
   if (pages != NULL) 
     {
@@ -156,6 +312,18 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   return pages;
 }
 
+/* Obtains and returns a group of PAGE_CNT contiguous free pages.
+   If PAL_USER is set, the pages are obtained from the user pool,
+   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+   then the pages are filled with zeros.  If too few pages are
+   available, returns a null pointer, unless PAL_ASSERT is set in
+   FLAGS, in which case the kernel panics. */
+void *
+palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+{
+  return get_multiple (flags, page_cnt, __builtin_return_address (0));
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
@@ -166,12 +334,14 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 void *
 palloc_get_page (enum palloc_flags flags) 
 {
-  return palloc_get_multiple (flags, 1);
+  return get_multiple (flags, 1, __builtin_return_address (0));
 }
 
-/* Frees the PAGE_CNT pages starting at PAGES. */
-void
-palloc_free_multiple (void *pages, size_t page_cnt) 
+/* Frees the PAGE_CNT pages starting at PAGES, for
+   palloc_free_multiple() or palloc_free_page() called from
+   CALLER. */
+static void
+free_multiple (void *pages, size_t page_cnt, void *caller)
 {
   struct pool *pool;
   size_t page_idx;
@@ -188,35 +358,167 @@ palloc_free_multiple (void *pages, size_t page_cnt)
     NOT_REACHED ();
 
   page_idx = pg_no (pages) - pg_no (pool->base);
+  if (palloc_trace_enabled)
+    palloc_trace_record (PALLOC_TRACE_FREE, pool == &user_pool,
+                         pool->policy - policies, page_idx, page_cnt,
+                         caller);
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  //jjeong
-  /* This is for BUDDY system */
-  if(pallocator ==ALLOCATOR_BUDDY)
- 	 bitmap_merge_buddy(page_idx,page_cnt);
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  if (page_cnt == 1 && feature_enabled (FEATURE_PAGE_CACHE))
+    cache_put (pool, pages);
+  else
+    {
+      enum intr_level old_level = pool_lock (pool);
+      pool_free (pool, page_idx, page_cnt);
+      pool_unlock (pool, old_level);
+    }
+}
+
+/* Frees the PAGE_CNT pages starting at PAGES. */
+void
+palloc_free_multiple (void *pages, size_t page_cnt) 
+{
+  free_multiple (pages, page_cnt, __builtin_return_address (0));
 }
 
 /* Frees the page at PAGE. */
 void
 palloc_free_page (void *page) 
 {
-  palloc_free_multiple (page, 1);
+  free_multiple (page, 1, __builtin_return_address (0));
 }
 
-/* Obtains a status of the page pool */
+/* Switches the pool selected by FLAGS to placement POLICY.
+   This can only happen once every page of the pool has been
+   freed, so pages the current thread caches and pages on the
+   clean list are given back first.  Returns true if the pool
+   switched right away.  Otherwise, returns false, and the pool
+   will switch when its last allocated page is freed. */
+bool
+palloc_set_policy (enum palloc_flags flags, enum palloc_allocator policy)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
+  bool switched;
+
+  cache_drain (pool, false);
+  old_level = pool_lock (pool);
+  pool->next_policy = policy_for (policy);
+  clean_drain (pool);
+  if (pool->next_policy != NULL && pool->used_cnt == 0)
+    switch_policy (pool);
+  switched = pool->next_policy == NULL;
+  pool_unlock (pool, old_level);
+  return switched;
+}
+
+/* Returns the name of the placement policy of the pool selected
+   by FLAGS. */
+const char *
+palloc_policy_name (enum palloc_flags flags)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+
+  return pool->policy->name;
+}
+
+/* Returns the number of pages in the pool selected by FLAGS,
+   not counting those that hold its own bookkeeping. */
+size_t
+palloc_pool_size (enum palloc_flags flags)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+
+  return bitmap_size (pool->used_map);
+}
+
+/* Stores the number of free pages in the pool selected by FLAGS
+   in *FREE_CNT and the length of its longest run of free pages
+   in *LARGEST.  Pages in thread caches and on the clean list
+   count as allocated. */
+void
+palloc_free_stats (enum palloc_flags flags, size_t *free_cnt,
+                   size_t *largest)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
+
+  old_level = pool_lock (pool);
+  *free_cnt = bitmap_size (pool->used_map) - pool->used_cnt;
+  *largest = extent_largest (pool);
+  pool_unlock (pool, old_level);
+}
+
+/* Prints statistics about the pre-zeroed pages.  Called at
+   shutdown, when nothing else is allocating. */
+void
+palloc_print_stats (void)
+{
+  printf ("Palloc: %lld zeroed-page hits, %lld misses\n",
+          kernel_pool.clean_hits + user_pool.clean_hits,
+          kernel_pool.clean_misses + user_pool.clean_misses);
+}
+
+/* Returns every page in the current thread's caches to its
+   pool.  A thread must do this before it exits. */
+void
+palloc_cache_flush (void)
+{
+  cache_drain (&kernel_pool, false);
+  cache_drain (&user_pool, false);
+}
+
+/* Adds the pages cached by thread T from the pool AUX points to
+   into that pool's cached-page count.  Used via
+   thread_foreach(), with the pool's lock held. */
+static void
+count_cached (struct thread *t, void *aux)
+{
+  struct pool *pool = aux;
+
+  pool->cached_cnt += t->page_caches[pool == &user_pool].cnt;
+}
+
+/* Obtains a status of the page pool.
+
+   Printing may sleep, which a spin lock does not allow, so only
+   the counts are taken under the pool's lock.  The bitmap and
+   the policy's state are printed without it, and may be caught
+   halfway through a change if another CPU is allocating. */
 void
 palloc_get_status (enum palloc_flags flags)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
+  size_t cached_cnt, clean_cnt;
+  long long hits, misses;
 
-  lock_acquire (&pool->lock);
   bitmap_dump2 (pool->used_map);
-  lock_release (&pool->lock);
+  printf ("placement policy %s", pool->policy->name);
+  if (pool->next_policy != NULL)
+    printf (", switching to %s once drained", pool->next_policy->name);
+  printf ("\n");
+  if (pool->policy->stat != NULL)
+    pool->policy->stat (pool);
+
+  /* Cached pages show up as used above, so say how many of
+     them are really free. */
+  old_level = pool_lock (pool);
+  pool->cached_cnt = 0;
+  thread_foreach (count_cached, pool);
+  cached_cnt = pool->cached_cnt;
+  clean_cnt = pool->clean_cnt;
+  hits = pool->clean_hits;
+  misses = pool->clean_misses;
+  pool_unlock (pool, old_level);
+  printf ("%zu of the used pages are cached by threads\n", cached_cnt);
+  printf ("%zu of the used pages are zeroed and free, "
+          "%lld zeroed-page hits, %lld misses\n",
+          clean_cnt, hits, misses);
 }
 
 /* Initializes pool P as starting at START and ending at END,
@@ -224,29 +526,297 @@ palloc_get_status (enum palloc_flags flags)
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
+  /* We'll put the pool's used_map at its base, followed by its
+     free-extent index and its buddy allocator.  Calculate the
+     space needed for them and subtract it from the pool's size. */
+  size_t bm_bytes = ROUND_UP (bitmap_buf_size (page_cnt), sizeof (size_t));
+  size_t ext_bytes = page_cnt * sizeof *p->extents;
+  size_t bm_pages = DIV_ROUND_UP (bm_bytes + ext_bytes
+                                  + buddy_buf_size (page_cnt), PGSIZE);
 
 	//jjeong-print
-	printf("init pool first %lu \n",page_cnt);
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+	printf("init pool first %zu \n",page_cnt);
 	//jjeong-print
-	printf("init pool second %lu \n",bm_pages);
+	printf("init pool second %zu \n",bm_pages);
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
 //jjeong
 /*
- * bitmap is used in 1 pagr so 513 - 1 = 512
- * so free kenerl page is 512 
+ * the bitmap, the extent index and the buddy allocator take
+ * the first pages, 4 of the kernel pool's 513,
+ * so free kernel page is 509
  * */
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  /* Initialize the pool.  At first the whole pool is one free
+     extent. */
+  spinlock_init (&p->lock);
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_bytes);
   p->base = base + bm_pages * PGSIZE;
+  p->extents = (struct extent *) ((uint8_t *) base + bm_bytes);
+  p->extent_root = EXTENT_NONE;
+  if (page_cnt > 0)
+    extent_insert (p, 0, page_cnt);
+  p->policy = &policies[ALLOCATOR_FF];
+  p->next_policy = NULL;
+  p->used_cnt = 0;
+  p->buddy = buddy_create_in_buf (page_cnt,
+                                  (uint8_t *) base + bm_bytes + ext_bytes,
+                                  buddy_buf_size (page_cnt));
+}
+
+/* Locks POOL, with interrupts off as its spin lock requires,
+   and returns the interrupt level to restore with
+   pool_unlock(). */
+static enum intr_level
+pool_lock (struct pool *pool)
+{
+  enum intr_level old_level = intr_disable ();
+
+  spinlock_acquire (&pool->lock);
+  return old_level;
+}
+
+/* Unlocks POOL and restores interrupt level OLD_LEVEL. */
+static void
+pool_unlock (struct pool *pool, enum intr_level old_level)
+{
+  spinlock_release (&pool->lock);
+  intr_set_level (old_level);
+}
+
+/* Returns the current thread's page cache for POOL. */
+static struct page_cache *
+thread_cache (struct pool *pool)
+{
+  return &thread_current ()->page_caches[pool == &user_pool];
+}
+
+/* Takes a page from the current thread's cache for POOL, first
+   refilling the cache from POOL if it is empty.  Returns a null
+   pointer if POOL has no free page either.
+
+   Only the current thread touches its own cache, so no lock is
+   needed except around the refill. */
+static void *
+cache_get (struct pool *pool)
+{
+  struct page_cache *c = thread_cache (pool);
+
+  if (c->cnt == 0)
+    {
+      enum intr_level old_level = pool_lock (pool);
+      while (c->cnt < PAGE_CACHE_BATCH)
+        {
+          size_t page_idx = select_memory_allocate (pool, 1);
+          if (page_idx == BITMAP_ERROR)
+            break;
+          c->pages[c->cnt++] = pool->base + PGSIZE * page_idx;
+        }
+      pool_unlock (pool, old_level);
+      if (c->cnt == 0)
+        return NULL;
+    }
+  return c->pages[--c->cnt];
+}
+
+/* Puts PAGE, which came from POOL, into the current thread's
+   cache for POOL, first draining part of the cache back to POOL
+   if it is full. */
+static void
+cache_put (struct pool *pool, void *page)
+{
+  struct page_cache *c = thread_cache (pool);
+
+  if (c->cnt == PAGE_CACHE_SIZE)
+    cache_drain (pool, true);
+  c->pages[c->cnt++] = page;
+}
+
+/* Returns pages from the current thread's cache for POOL to
+   POOL: PAGE_CACHE_BATCH of them if BATCH is true, otherwise all
+   of them.  Returns the number of pages returned. */
+static size_t
+cache_drain (struct pool *pool, bool batch)
+{
+  struct page_cache *c = thread_cache (pool);
+  size_t cnt = batch && c->cnt > PAGE_CACHE_BATCH ? PAGE_CACHE_BATCH : c->cnt;
+  enum intr_level old_level;
+  size_t i;
+
+  if (cnt == 0)
+    return 0;
+
+  old_level = pool_lock (pool);
+  for (i = 0; i < cnt; i++)
+    {
+      void *page = c->pages[--c->cnt];
+      pool_free (pool, pg_no (page) - pg_no (pool->base), 1);
+    }
+  pool_unlock (pool, old_level);
+  return cnt;
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, then
+   switches POOL to its next policy if that was the last
+   allocation.  POOL's lock must be held. */
+static void
+pool_free (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  ASSERT (spinlock_held_by_current_cpu (&pool->lock));
+
+  pool->policy->free (pool, page_idx, page_cnt);
+  if (pool->next_policy != NULL && pool->used_cnt == 0)
+    switch_policy (pool);
+}
+
+/* Takes a page from POOL's clean list and returns it, or
+   returns a null pointer if the list is empty.  Wakes the zeroer
+   if the list is running low.
+
+   An empty list is noticed without taking POOL's lock for the
+   list itself; a miss only takes the lock for as long as it
+   takes to count it and, the first time after the zeroer has
+   run, to ask it to run again. */
+static void *
+clean_get (struct pool *pool)
+{
+  void **page = NULL;
+  enum intr_level old_level;
+  bool wake = false;
+
+  if (pool->clean_cnt > 0)
+    {
+      old_level = pool_lock (pool);
+      page = pool->clean;
+      if (page != NULL)
+        {
+          pool->clean = *page;
+          pool->clean_cnt--;
+          pool->clean_hits++;
+        }
+      if (pool->clean_cnt < CLEAN_LOW && !pool->clean_wanted)
+        wake = pool->clean_wanted = true;
+      pool_unlock (pool, old_level);
+    }
+
+  if (page == NULL)
+    {
+      old_level = pool_lock (pool);
+      pool->clean_misses++;
+      if (!pool->clean_wanted)
+        wake = pool->clean_wanted = true;
+      pool_unlock (pool, old_level);
+    }
+
+  if (wake)
+    zeroer_wake ();
+  if (page != NULL)
+    *page = NULL;
+  return page;
+}
+
+/* If POOL's clean list has run low, zeroes free pages from POOL
+   and adds them to the list until it holds CLEAN_TARGET pages or
+   POOL runs out. */
+static void
+clean_fill (struct pool *pool)
+{
+  enum intr_level old_level;
+  bool wanted;
+
+  old_level = pool_lock (pool);
+  wanted = pool->clean_wanted && pool->next_policy == NULL;
+  if (wanted)
+    pool->clean_wanted = false;
+  pool_unlock (pool, old_level);
+  if (!wanted)
+    return;
+
+  while (pool->clean_cnt < CLEAN_TARGET)
+    {
+      size_t page_idx;
+      void **page;
+
+      old_level = pool_lock (pool);
+      page_idx = select_memory_allocate (pool, 1);
+      pool_unlock (pool, old_level);
+      if (page_idx == BITMAP_ERROR)
+        break;
+
+      page = (void **) (pool->base + PGSIZE * page_idx);
+      memset (page, 0, PGSIZE);
+
+      old_level = pool_lock (pool);
+      *page = pool->clean;
+      pool->clean = page;
+      pool->clean_cnt++;
+      pool_unlock (pool, old_level);
+    }
+}
+
+/* Zeroer work.  Refills the clean lists that have run low. */
+static void
+zero_pages (struct work *w UNUSED)
+{
+  clean_fill (&kernel_pool);
+  clean_fill (&user_pool);
+}
+
+/* Wakes the zeroer, unless it has been woken already.  The
+   workqueue still relies on the kernel lock, which a thread
+   allocating without it takes for just this. */
+static void
+zeroer_wake (void)
+{
+  bool acquired = kernel_lock_enter ();
+
+  work_queue (&zero_wq, &zero_work);
+  kernel_lock_exit (acquired);
+}
+
+/* Gives the pages on POOL's clean list back to POOL and returns
+   how many there were.  POOL's lock must be held. */
+static size_t
+clean_drain (struct pool *pool)
+{
+  size_t cnt = 0;
+
+  ASSERT (spinlock_held_by_current_cpu (&pool->lock));
+
+  while (pool->clean != NULL)
+    {
+      void **page = pool->clean;
+      pool->clean = *page;
+      pool->clean_cnt--;
+      pool_free (pool, pg_no (page) - pg_no (pool->base), 1);
+      cnt++;
+    }
+  return cnt;
+}
+
+/* Gives the pages on POOL's clean list and in the current
+   thread's cache for POOL back to POOL, along with the dead
+   threads' pages that thread_create() keeps for reuse, which
+   come from the kernel pool.  Returns the number of pages given
+   back. */
+static size_t
+reclaim (struct pool *pool)
+{
+  enum intr_level old_level;
+  size_t cnt = 0;
+
+  /* Dead threads' pages freed here land in our own page cache,
+     so free them before draining it. */
+  if (pool == &kernel_pool)
+    cnt += thread_reap_cached ();
+  cnt += cache_drain (pool, false);
+
+  old_level = pool_lock (pool);
+  cnt += clean_drain (pool);
+  pool_unlock (pool, old_level);
+  return cnt;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -261,3 +831,395 @@ page_from_pool (const struct pool *pool, void *page)
   return page_no >= start_page && page_no < end_page;
 }
 
+
+/* Placement policies. */
+
+/* First fit: the lowest free run that fits. */
+static size_t
+scan_first_fit (struct pool *pool, size_t cnt)
+{
+  return bitmap_scan (pool->used_map, 0, cnt, false);
+}
+
+/* Next fit: like first fit, but starting where the last
+   allocation ended. */
+static size_t
+scan_next_fit (struct pool *pool, size_t cnt)
+{
+  return bitmap_scan_NF (pool->used_map, 0, cnt, false);
+}
+
+/* Best fit: the shortest free extent that fits, from the
+   free-extent index. */
+static size_t
+scan_best_fit (struct pool *pool, size_t cnt)
+{
+  return extent_best_fit (pool, cnt);
+}
+
+/* Worst fit: the longest free extent, from the free-extent
+   index. */
+static size_t
+scan_worst_fit (struct pool *pool, size_t cnt)
+{
+  return extent_worst_fit (pool, cnt);
+}
+
+/* Buddy system: the buddy allocator picks and takes a block at
+   once. */
+static size_t
+scan_buddy (struct pool *pool, size_t cnt)
+{
+  size_t page_idx = buddy_alloc (pool->buddy, cnt);
+  return page_idx != BUDDY_ERROR ? page_idx : BITMAP_ERROR;
+}
+
+/* Marks the CNT free pages at PAGE_IDX in POOL used in the
+   free-extent index and the bitmap, and returns CNT. */
+static size_t
+mark_used (struct pool *pool, size_t page_idx, size_t cnt)
+{
+  extent_carve (pool, page_idx, cnt);
+  bitmap_set_multiple (pool->used_map, page_idx, cnt, true);
+
+  /* this is for next fit index updating*/
+  bitmap_modify_idx (pool->used_map, page_idx + cnt);
+  pool->used_cnt += cnt;
+  return cnt;
+}
+
+/* The buddy system hands out whole blocks, so it marks the CNT
+   pages rounded up to a power of 2 as used. */
+static size_t
+alloc_buddy (struct pool *pool, size_t page_idx, size_t cnt)
+{
+  return mark_used (pool, page_idx, buddy_round (cnt));
+}
+
+/* Marks the CNT used pages at PAGE_IDX in POOL free in the
+   free-extent index and the bitmap, and returns CNT. */
+static size_t
+mark_free (struct pool *pool, size_t page_idx, size_t cnt)
+{
+  extent_release (pool, page_idx, cnt);
+  bitmap_set_multiple (pool->used_map, page_idx, cnt, false);
+  pool->used_cnt -= cnt;
+  return cnt;
+}
+
+/* Under the buddy system the whole block goes back, merged with
+   its free buddies. */
+static size_t
+free_buddy (struct pool *pool, size_t page_idx, size_t cnt)
+{
+  size_t block_cnt = buddy_free (pool->buddy, page_idx);
+
+  ASSERT (block_cnt >= cnt);
+  return mark_free (pool, page_idx, block_cnt);
+}
+
+static void
+stat_next_fit (struct pool *pool)
+{
+  printf ("next fit resumes at page %zu\n",
+          bitmap_lastest_idx (pool->used_map));
+}
+
+static void
+stat_extents (struct pool *pool)
+{
+  printf ("largest free extent %zu pages\n", extent_largest (pool));
+}
+
+static void
+stat_buddy (struct pool *pool)
+{
+  buddy_dump (pool->buddy);
+}
+
+/* Returns the policy numbered ALLOCATOR.  if the -ma option is
+   not 0 to 4 we just run first fit. */
+static const struct pool_policy *
+policy_for (enum palloc_allocator allocator)
+{
+  if ((unsigned) allocator >= sizeof policies / sizeof *policies)
+    allocator = ALLOCATOR_FF;
+  return &policies[allocator];
+}
+
+/* Switches POOL, which must have no pages allocated, to its next
+   policy.  POOL's lock must be held. */
+static void
+switch_policy (struct pool *pool)
+{
+  ASSERT (pool->used_cnt == 0);
+
+  pool->policy = pool->next_policy;
+  pool->next_policy = NULL;
+  bitmap_modify_idx (pool->used_map, 0);
+  buddy_reset (pool->buddy);
+}
+
+/* Free-extent index. */
+
+/* Returns true if the extent starting at page A sorts before the
+   one starting at page B in POOL's extent tree: shorter extents
+   first, then lower addresses. */
+static bool
+extent_less (const struct pool *pool, size_t a, size_t b)
+{
+  size_t a_len = pool->extents[a].len;
+  size_t b_len = pool->extents[b].len;
+  return a_len < b_len || (a_len == b_len && a < b);
+}
+
+/* Returns the height of the extent subtree rooted at N. */
+static int
+extent_height (const struct pool *pool, size_t n)
+{
+  return n != EXTENT_NONE ? pool->extents[n].height : 0;
+}
+
+/* Recomputes the height of extent tree node N from its
+   children. */
+static void
+extent_update (struct pool *pool, size_t n)
+{
+  int left = extent_height (pool, pool->extents[n].left);
+  int right = extent_height (pool, pool->extents[n].right);
+  pool->extents[n].height = (left > right ? left : right) + 1;
+}
+
+/* Rotates the subtree rooted at N to the right and returns its
+   new root. */
+static size_t
+extent_rotate_right (struct pool *pool, size_t n)
+{
+  size_t l = pool->extents[n].left;
+  pool->extents[n].left = pool->extents[l].right;
+  pool->extents[l].right = n;
+  extent_update (pool, n);
+  extent_update (pool, l);
+  return l;
+}
+
+/* Rotates the subtree rooted at N to the left and returns its
+   new root. */
+static size_t
+extent_rotate_left (struct pool *pool, size_t n)
+{
+  size_t r = pool->extents[n].right;
+  pool->extents[n].right = pool->extents[r].left;
+  pool->extents[r].left = n;
+  extent_update (pool, n);
+  extent_update (pool, r);
+  return r;
+}
+
+/* Restores the AVL balance of the subtree rooted at N, whose
+   children are balanced and differ in height by at most 2, and
+   returns its new root. */
+static size_t
+extent_balance (struct pool *pool, size_t n)
+{
+  struct extent *e = &pool->extents[n];
+  int balance = extent_height (pool, e->left) - extent_height (pool, e->right);
+
+  if (balance > 1)
+    {
+      struct extent *l = &pool->extents[e->left];
+      if (extent_height (pool, l->left) < extent_height (pool, l->right))
+        e->left = extent_rotate_left (pool, e->left);
+      return extent_rotate_right (pool, n);
+    }
+  else if (balance < -1)
+    {
+      struct extent *r = &pool->extents[e->right];
+      if (extent_height (pool, r->right) < extent_height (pool, r->left))
+        e->right = extent_rotate_right (pool, e->right);
+      return extent_rotate_left (pool, n);
+    }
+
+  extent_update (pool, n);
+  return n;
+}
+
+/* Inserts node N into the extent subtree rooted at ROOT and
+   returns the subtree's new root. */
+static size_t
+extent_tree_insert (struct pool *pool, size_t root, size_t n)
+{
+  struct extent *r;
+
+  if (root == EXTENT_NONE)
+    return n;
+
+  r = &pool->extents[root];
+  if (extent_less (pool, n, root))
+    r->left = extent_tree_insert (pool, r->left, n);
+  else
+    r->right = extent_tree_insert (pool, r->right, n);
+  return extent_balance (pool, root);
+}
+
+/* Unlinks the leftmost node from the extent subtree rooted at
+   ROOT, stores it into *MIN, and returns the subtree's new
+   root. */
+static size_t
+extent_tree_remove_min (struct pool *pool, size_t root, size_t *min)
+{
+  struct extent *r = &pool->extents[root];
+
+  if (r->left == EXTENT_NONE)
+    {
+      *min = root;
+      return r->right;
+    }
+  r->left = extent_tree_remove_min (pool, r->left, min);
+  return extent_balance (pool, root);
+}
+
+/* Removes node N from the extent subtree rooted at ROOT, which
+   must contain it, and returns the subtree's new root. */
+static size_t
+extent_tree_remove (struct pool *pool, size_t root, size_t n)
+{
+  struct extent *r;
+
+  ASSERT (root != EXTENT_NONE);
+  r = &pool->extents[root];
+  if (root == n)
+    {
+      size_t successor;
+
+      if (r->left == EXTENT_NONE)
+        return r->right;
+      if (r->right == EXTENT_NONE)
+        return r->left;
+
+      /* Replace N by the next node in order. */
+      r->right = extent_tree_remove_min (pool, r->right, &successor);
+      pool->extents[successor].left = r->left;
+      pool->extents[successor].right = r->right;
+      return extent_balance (pool, successor);
+    }
+
+  if (extent_less (pool, n, root))
+    r->left = extent_tree_remove (pool, r->left, n);
+  else
+    r->right = extent_tree_remove (pool, r->right, n);
+  return extent_balance (pool, root);
+}
+
+/* Adds the free extent of LEN pages beginning at page START to
+   POOL's index. */
+static void
+extent_insert (struct pool *pool, size_t start, size_t len)
+{
+  struct extent *e = &pool->extents[start];
+
+  ASSERT (len > 0);
+  e->len = pool->extents[start + len - 1].len = len;
+  e->left = e->right = EXTENT_NONE;
+  e->height = 1;
+  pool->extent_root = extent_tree_insert (pool, pool->extent_root, start);
+}
+
+/* Removes the free extent beginning at page START from POOL's
+   index. */
+static void
+extent_remove (struct pool *pool, size_t start)
+{
+  pool->extent_root = extent_tree_remove (pool, pool->extent_root, start);
+}
+
+/* Returns the first page of the shortest free extent in POOL
+   that holds at least CNT pages, preferring the lowest address
+   among equals, or BITMAP_ERROR if there is none. */
+static size_t
+extent_best_fit (const struct pool *pool, size_t cnt)
+{
+  size_t best = BITMAP_ERROR;
+  size_t n = pool->extent_root;
+
+  while (n != EXTENT_NONE)
+    if (pool->extents[n].len >= cnt)
+      {
+        best = n;
+        n = pool->extents[n].left;
+      }
+    else
+      n = pool->extents[n].right;
+  return best;
+}
+
+/* Returns the first page of the longest free extent in POOL,
+   preferring the lowest address among equals, or BITMAP_ERROR if
+   it is shorter than CNT pages. */
+static size_t
+extent_worst_fit (const struct pool *pool, size_t cnt)
+{
+  size_t len = extent_largest (pool);
+
+  if (len == 0 || len < cnt)
+    return BITMAP_ERROR;
+
+  /* Of the longest extents, take the one at the lowest
+     address. */
+  return extent_best_fit (pool, len);
+}
+
+/* Returns the length of the longest free extent in POOL, or 0
+   if it has none. */
+static size_t
+extent_largest (const struct pool *pool)
+{
+  size_t n = pool->extent_root;
+
+  if (n == EXTENT_NONE)
+    return 0;
+  while (pool->extents[n].right != EXTENT_NONE)
+    n = pool->extents[n].right;
+  return pool->extents[n].len;
+}
+
+/* Updates POOL's index for the allocation of the PAGE_CNT free
+   pages beginning at PAGE_IDX: their extent is removed, and the
+   parts of it before and after them, if any, are put back. */
+static void
+extent_carve (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  size_t start = bitmap_run_start (pool->used_map, page_idx);
+  size_t end = start + pool->extents[start].len;
+
+  ASSERT (page_idx + page_cnt <= end);
+  extent_remove (pool, start);
+  if (start < page_idx)
+    extent_insert (pool, start, page_idx - start);
+  if (page_idx + page_cnt < end)
+    extent_insert (pool, page_idx + page_cnt, end - (page_idx + page_cnt));
+}
+
+/* Updates POOL's index for the freeing of the PAGE_CNT pages
+   beginning at PAGE_IDX, which must still be marked used in the
+   bitmap, merging them with the free extents on either side. */
+static void
+extent_release (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  size_t start = page_idx;
+  size_t end = page_idx + page_cnt;
+
+  if (start > 0 && !bitmap_test (pool->used_map, start - 1))
+    {
+      start -= pool->extents[start - 1].len;
+      extent_remove (pool, start);
+    }
+  if (end < bitmap_size (pool->used_map)
+      && !bitmap_test (pool->used_map, end))
+    {
+      size_t len = pool->extents[end].len;
+      extent_remove (pool, end);
+      end += len;
+    }
+  extent_insert (pool, start, end - start);
+}
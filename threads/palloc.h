@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -17,10 +18,28 @@ enum palloc_allocator
     ALLOCATOR_FF = 0,            /* 0: First Fit (default) */
     ALLOCATOR_NF =1,                /* 1: Next Fit  */
     ALLOCATOR_BF=2,                /* 2: Best Fit  */
-    ALLOCATOR_BUDDY=3              /* 3: Buddy System  */
+    ALLOCATOR_BUDDY=3,             /* 3: Buddy System  */
+    ALLOCATOR_WF=4                 /* 4: Worst Fit  */
   };
 
-extern enum palloc_allocator pallocator;
+extern enum palloc_allocator pallocator, pallocator_user;
+
+/* Per-thread page cache.
+
+   Each thread keeps a small stack of free single pages for each
+   pool, so that palloc_get_page() and palloc_free_page() usually
+   need neither the pool's lock nor a scan.  Cached pages stay
+   marked used in the pool; they move to and from it
+   PAGE_CACHE_BATCH at a time.  -no=page-cache turns the caches
+   off. */
+#define PAGE_CACHE_SIZE 8       /* Most pages a cache holds. */
+#define PAGE_CACHE_BATCH 4      /* Pages moved per refill or drain. */
+
+struct page_cache
+  {
+    size_t cnt;                         /* Number of cached pages. */
+    void *pages[PAGE_CACHE_SIZE];       /* Cached pages, as a stack. */
+  };
 
 void palloc_init (size_t user_page_limit);
 void *palloc_get_page (enum palloc_flags);
@@ -28,5 +47,12 @@ void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
 void palloc_get_status (enum palloc_flags flags);
+void palloc_cache_flush (void);
+size_t palloc_pool_size (enum palloc_flags);
+bool palloc_set_policy (enum palloc_flags, enum palloc_allocator);
+const char *palloc_policy_name (enum palloc_flags);
+void palloc_free_stats (enum palloc_flags, size_t *free_cnt, size_t *largest);
+void palloc_zero_start (void);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
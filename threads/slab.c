@@ -0,0 +1,240 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Object caches.
+
+   Each slab is one page.  A struct slab header at the start of
+   the page is followed by a stack of the indexes of the slab's
+   free objects and then by the objects themselves, packed
+   OBJ_ALIGN bytes apart.  Keeping the free stack out of the
+   objects lets constructed objects keep their state while they
+   are free.
+
+   A cache keeps the slabs that have free objects on a list,
+   partly used slabs at the front and unused ones at the back,
+   and allocates from the front so that unused slabs tend to stay
+   unused.  It holds on to at most one unused slab; any other
+   slab whose last object is freed goes back to the page
+   allocator.  Full slabs are on no list: freeing an object finds
+   its slab by rounding the object's address down to a page
+   boundary. */
+
+/* Alignment of objects. */
+#define OBJ_ALIGN 8
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Slab header. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in cache's slab list. */
+    size_t free_cnt;            /* Number of free objects. */
+    uint16_t free[];            /* Indexes of free objects. */
+  };
+
+/* All the caches, for kmem_cache_print_stats(). */
+static struct list all_caches = LIST_INITIALIZER (all_caches);
+
+static struct slab *slab_create (struct kmem_cache *);
+static void slab_destroy (struct kmem_cache *, struct slab *);
+
+/* Initializes C as a cache of objects of SIZE bytes named NAME.
+   If CTOR is nonnull, it is called on each object when the slab
+   holding it is created; if DTOR is nonnull, it is called on
+   each object when the slab is given back. */
+void
+kmem_cache_init (struct kmem_cache *c, const char *name, size_t size,
+                 void (*ctor) (void *), void (*dtor) (void *))
+{
+  enum intr_level old_level;
+  size_t n;
+
+  ASSERT (c != NULL);
+  ASSERT (size > 0);
+
+  c->name = name;
+  c->obj_size = ROUND_UP (size, OBJ_ALIGN);
+  c->ctor = ctor;
+  c->dtor = dtor;
+
+  /* Fit as many objects as we can after the header and its free
+     stack. */
+  n = (PGSIZE - sizeof (struct slab)) / (c->obj_size + sizeof (uint16_t));
+  while (n > 0 && ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+                            OBJ_ALIGN) + n * c->obj_size > PGSIZE)
+    n--;
+  if (n == 0)
+    PANIC ("kmem_cache %s: %zu-byte objects do not fit in a slab",
+           name, size);
+  c->objs_per_slab = n;
+  c->obj_ofs = ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+                         OBJ_ALIGN);
+
+  lock_init (&c->lock, name);
+  list_init (&c->slabs);
+  c->empty_cnt = 0;
+  c->slab_cnt = c->in_use = 0;
+  c->alloc_cnt = c->grow_cnt = c->shrink_cnt = 0;
+
+  old_level = intr_disable ();
+  list_push_back (&all_caches, &c->elem);
+  intr_set_level (old_level);
+}
+
+/* Returns the object numbered IDX in slab S of cache C. */
+static void *
+slab_obj (struct kmem_cache *c, struct slab *s, size_t idx)
+{
+  return (uint8_t *) s + c->obj_ofs + idx * c->obj_size;
+}
+
+/* Obtains and returns an object from cache C, or a null pointer
+   if no memory is available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&c->lock);
+  if (list_empty (&c->slabs))
+    {
+      s = slab_create (c);
+      if (s == NULL)
+        {
+          lock_release (&c->lock);
+          return NULL;
+        }
+      list_push_back (&c->slabs, &s->elem);
+      c->empty_cnt++;
+    }
+
+  s = list_entry (list_front (&c->slabs), struct slab, elem);
+  if (s->free_cnt == c->objs_per_slab)
+    c->empty_cnt--;
+  obj = slab_obj (c, s, s->free[--s->free_cnt]);
+  if (s->free_cnt == 0)
+    list_remove (&s->elem);
+
+  c->in_use++;
+  c->alloc_cnt++;
+  lock_release (&c->lock);
+  return obj;
+}
+
+/* Returns OBJ, which must have come from cache C, to C.  Does
+   nothing if OBJ is a null pointer. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+  size_t idx;
+
+  if (obj == NULL)
+    return;
+
+  s = pg_round_down (obj);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+  ASSERT (((uint8_t *) obj - (uint8_t *) s - c->obj_ofs) % c->obj_size == 0);
+  idx = ((uint8_t *) obj - (uint8_t *) s - c->obj_ofs) / c->obj_size;
+
+  lock_acquire (&c->lock);
+  ASSERT (s->free_cnt < c->objs_per_slab);
+  s->free[s->free_cnt++] = idx;
+  c->in_use--;
+
+  if (s->free_cnt == 1)
+    {
+      /* The slab was full.  Now it has a free object. */
+      list_push_front (&c->slabs, &s->elem);
+    }
+  if (s->free_cnt == c->objs_per_slab)
+    {
+      /* The slab is unused.  Keep one unused slab around, at the
+         back of the list; give the rest back. */
+      list_remove (&s->elem);
+      if (c->empty_cnt == 0)
+        {
+          list_push_back (&c->slabs, &s->elem);
+          c->empty_cnt++;
+        }
+      else
+        slab_destroy (c, s);
+    }
+  lock_release (&c->lock);
+}
+
+/* Prints statistics for every cache. */
+void
+kmem_cache_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&all_caches); e != list_end (&all_caches);
+       e = list_next (e))
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+
+      printf ("Slab %s: %zu-byte objects, %zu per slab, %zu slabs, "
+              "%zu in use, %lld allocs, %lld grows, %lld shrinks\n",
+              c->name, c->obj_size, c->objs_per_slab, c->slab_cnt,
+              c->in_use, c->alloc_cnt, c->grow_cnt, c->shrink_cnt);
+    }
+}
+
+/* Creates a slab for cache C, with all its objects free and
+   constructed, and returns it, or a null pointer if no page is
+   available.  C's lock must be held. */
+static struct slab *
+slab_create (struct kmem_cache *c)
+{
+  struct slab *s = palloc_get_page (0);
+  size_t i;
+
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free_cnt = c->objs_per_slab;
+  for (i = 0; i < c->objs_per_slab; i++)
+    {
+      s->free[i] = c->objs_per_slab - 1 - i;
+      if (c->ctor != NULL)
+        c->ctor (slab_obj (c, s, i));
+    }
+
+  c->slab_cnt++;
+  c->grow_cnt++;
+  return s;
+}
+
+/* Destroys slab S of cache C, none of whose objects may be in
+   use, and gives its page back.  C's lock must be held. */
+static void
+slab_destroy (struct kmem_cache *c, struct slab *s)
+{
+  size_t i;
+
+  ASSERT (s->free_cnt == c->objs_per_slab);
+
+  if (c->dtor != NULL)
+    for (i = 0; i < c->objs_per_slab; i++)
+      c->dtor (slab_obj (c, s, i));
+  s->magic = 0;
+  palloc_free_page (s);
+
+  c->slab_cnt--;
+  c->shrink_cnt++;
+}
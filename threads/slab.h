@@ -0,0 +1,44 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Object cache.
+
+   A cache hands out objects of one fixed size, carved from
+   one-page "slabs" obtained from palloc_get_page(), so that an
+   object type whose size is far from a power of 2 does not waste
+   the rest of a malloc() block.  If a constructor is given, it
+   runs on every object when its slab is created, and the
+   destructor runs when the slab is given back; in between, an
+   object keeps whatever state it was freed in. */
+struct kmem_cache
+  {
+    const char *name;                   /* Name, for statistics. */
+    size_t obj_size;                    /* Object size, rounded up. */
+    size_t objs_per_slab;               /* Objects in each slab. */
+    size_t obj_ofs;                     /* Offset of first object. */
+    void (*ctor) (void *);              /* Constructor, or null. */
+    void (*dtor) (void *);              /* Destructor, or null. */
+    struct lock lock;                   /* Protects the rest. */
+    struct list slabs;                  /* Slabs with free objects. */
+    size_t empty_cnt;                   /* Slabs with no objects in use. */
+    struct list_elem elem;              /* Element in list of caches. */
+
+    /* Statistics. */
+    size_t slab_cnt;                    /* Slabs now held. */
+    size_t in_use;                      /* Objects now in use. */
+    long long alloc_cnt;                /* Objects ever allocated. */
+    long long grow_cnt;                 /* Slabs ever created. */
+    long long shrink_cnt;               /* Slabs ever given back. */
+  };
+
+void kmem_cache_init (struct kmem_cache *, const char *name, size_t size,
+                      void (*ctor) (void *), void (*dtor) (void *));
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_cache_print_stats (void);
+
+#endif /* threads/slab.h */
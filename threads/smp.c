@@ -0,0 +1,456 @@
+#include "threads/smp.h"
+#include <debug.h>
+#include <packed.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/lapic.h"
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/pte.h"
+#include "threads/spinlock.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#endif
+
+/* Symmetric multiprocessing.
+
+   With the -smp option, smp_init() finds the other CPUs in the
+   BIOS's MultiProcessor Specification tables [MP] and starts
+   them.  Each CPU has a run queue of its own (see thread.c), and
+   a CPU that makes a thread ready on another CPU's run queue
+   sends it a reschedule IPI if that thread should run there
+   right away.
+
+   Most of the kernel was written for one CPU, and protects its
+   data by turning interrupts off.  Rather than rewrite all of
+   it, the kernel lock serializes it: threads hold the kernel
+   lock whenever they run such code.
+
+   The core that every thread needs runs without it, under spin
+   locks of its own, so CPUs go through it in parallel:
+
+     - the scheduler: each run queue has its own lock, and
+       thread_create(), thread_unblock(), thread_yield() and
+       thread_exit() take only that and a few short-lived locks
+       of thread.c's (see thread.c);
+
+     - semaphores, which have a spin lock each (see synch.c);
+
+     - the page allocator, with a lock per pool on top of the
+       per-thread page caches (see palloc.c).
+
+   A thread may let go of the kernel lock with
+   kernel_lock_release() and use just these, besides its own
+   data, until it calls kernel_lock_acquire().  Locks, condition
+   variables, reader-writer locks, sleeping, and the rest of the
+   kernel, devices and user processes included, still need the
+   kernel lock.  The few places where the core calls into such
+   code take the kernel lock just for that, with
+   kernel_lock_enter() and kernel_lock_exit().
+
+   The kernel lock belongs to a thread, not to a CPU: a thread
+   that is switched out holding it lets go of it, and gets it
+   back when it is switched in again, on whichever CPU.  An
+   interrupt handler takes it on entry if the CPU did not hold it
+   when it was interrupted, and lets go of it again on the way
+   out.  It is only ever taken with no spin lock held. */
+
+/* MP floating pointer structure.  See [MP] 4.1. */
+struct mp_fp
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t config;            /* Physical address of mp_config. */
+    uint8_t length;             /* Length in 16-byte units. */
+    uint8_t spec_rev;           /* Specification revision. */
+    uint8_t checksum;           /* All bytes sum to 0. */
+    uint8_t type;               /* Default configuration, or 0. */
+    uint8_t features[4];        /* Feature bytes. */
+  }
+PACKED;
+
+/* MP configuration table header.  See [MP] 4.2. */
+struct mp_config
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Length of base table. */
+    uint8_t spec_rev;           /* Specification revision. */
+    uint8_t checksum;           /* Base table bytes sum to 0. */
+    char oem_id[8];             /* OEM ID. */
+    char product_id[12];        /* Product ID. */
+    uint32_t oem_table;         /* OEM table pointer. */
+    uint16_t oem_table_size;    /* OEM table size. */
+    uint16_t entry_cnt;         /* Number of entries after header. */
+    uint32_t lapic_addr;        /* Physical address of local APICs. */
+    uint16_t ext_length;        /* Extended table length. */
+    uint8_t ext_checksum;       /* Extended table checksum. */
+    uint8_t reserved;
+  }
+PACKED;
+
+/* MP configuration table processor entry.  See [MP] 4.3.1. */
+struct mp_proc
+  {
+    uint8_t type;               /* MP_PROC. */
+    uint8_t lapic_id;           /* Local APIC ID. */
+    uint8_t lapic_version;      /* Local APIC version. */
+    uint8_t flags;              /* MP_PROC_* flags. */
+    uint32_t signature;         /* CPU signature. */
+    uint32_t features;          /* CPU feature flags. */
+    uint32_t reserved[2];
+  }
+PACKED;
+
+/* MP configuration table entry types and their sizes. */
+#define MP_PROC 0               /* Processor: 20 bytes. */
+#define MP_PROC_ENABLED 0x01    /* Processor is usable. */
+#define MP_PROC_BSP 0x02        /* Processor is the boot CPU. */
+
+/* Where the local APICs are in a default configuration. */
+#define LAPIC_DEFAULT_ADDR 0xfee00000
+
+struct cpu cpus[CPU_MAX] = {{ .started = true, .online = true }};
+int cpu_cnt = 1;
+
+/* -smp: Start the other CPUs? */
+bool smp_enabled;
+
+/* True once more than one CPU may be running. */
+bool smp_active;
+
+/* The kernel lock.  See the comment at the top of the file. */
+static struct spinlock kernel_spinlock = SPINLOCK_INITIALIZER;
+
+/* Local APIC IDs of the CPUs found, boot CPU first. */
+static uint8_t lapic_ids[CPU_MAX];
+
+/* Startup code, in trampoline.S. */
+extern char ap_trampoline[], ap_trampoline_end[], ap_cr3[], ap_esp[];
+
+#ifndef USERPROG
+/* GDTR of the boot CPU, for the application processors. */
+static uint64_t gdtr_operand;
+#endif
+
+static bool find_cpus (uintptr_t *lapic_addr);
+static void start_cpu (struct cpu *);
+static intr_handler_func reschedule_interrupt;
+void ap_main (void) NO_RETURN;
+
+/* Finds the CPUs and, if the -smp option was given, starts all
+   but the one we are running on.  Must be called with interrupts
+   on, after timer_calibrate(), and before any user process
+   starts. */
+void
+smp_init (void)
+{
+  uintptr_t lapic_addr;
+  uint32_t *low_pde;
+  enum intr_level old_level;
+  int online = 1;
+  int i;
+
+  if (!find_cpus (&lapic_addr) || cpu_cnt == 1)
+    {
+      printf ("SMP: 1 CPU.\n");
+      return;
+    }
+  if (!smp_enabled)
+    {
+      printf ("SMP: %d CPUs, using 1 (use -smp for all).\n", cpu_cnt);
+      return;
+    }
+
+  lapic_init (lapic_addr);
+  intr_register_ext (LAPIC_RESCHED_VEC, reschedule_interrupt,
+                     "Reschedule IPI");
+
+  /* The CPU we are running on is cpus[0], whatever the tables say
+     about which CPU booted. */
+  for (i = 1; i < cpu_cnt; i++)
+    if (lapic_ids[i] == lapic_id ())
+      {
+        lapic_ids[i] = lapic_ids[0];
+        lapic_ids[0] = lapic_id ();
+      }
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      cpus[i].id = i;
+      cpus[i].lapic_id = lapic_ids[i];
+    }
+
+  /* Set up the startup code.  It needs physical memory to be
+     mapped at virtual address 0 while it turns on paging. */
+  memcpy (ptov (AP_TRAMPOLINE), ap_trampoline,
+          ap_trampoline_end - ap_trampoline);
+  *(uint32_t *) ptov (AP_TRAMPOLINE + (ap_cr3 - ap_trampoline))
+    = vtop (init_page_dir);
+  low_pde = &init_page_dir[pd_no (0)];
+  *low_pde = init_page_dir[pd_no (PHYS_BASE)];
+#ifndef USERPROG
+  asm volatile ("sgdt %0" : "=m" (gdtr_operand));
+#endif
+
+  /* From here on, we must hold the kernel lock. */
+  old_level = intr_disable ();
+  smp_active = true;
+  kernel_lock_acquire ();
+  intr_set_level (old_level);
+
+  for (i = 1; i < cpu_cnt; i++)
+    {
+      start_cpu (&cpus[i]);
+      if (cpus[i].started)
+        online++;
+      else
+        printf ("SMP: CPU %d (APIC ID %d) did not start.\n",
+                i, cpus[i].lapic_id);
+    }
+
+  /* The CPUs that started are off the startup code, and wait for
+     the kernel lock before they flush their TLBs. */
+  *low_pde = 0;
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)) : "memory");
+
+  printf ("SMP: %d of %d CPUs online.\n", online, cpu_cnt);
+}
+
+/* Returns true if the SIZE bytes at P sum to 0. */
+static bool
+checksum_ok (const void *p, size_t size)
+{
+  const uint8_t *q = p;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *q++;
+  return sum == 0;
+}
+
+/* Searches the SIZE bytes at physical address PADDR for an MP
+   floating pointer structure and returns it, or a null pointer
+   if there is none. */
+static struct mp_fp *
+search_fp (uintptr_t paddr, size_t size)
+{
+  uint8_t *p = ptov (paddr);
+  uint8_t *end = p + size;
+
+  for (; p + sizeof (struct mp_fp) <= end; p += 16)
+    if (!memcmp (p, "_MP_", 4) && checksum_ok (p, sizeof (struct mp_fp)))
+      return (struct mp_fp *) p;
+  return NULL;
+}
+
+/* Finds the MP floating pointer structure in the first kilobyte
+   of the extended BIOS data area, in the last kilobyte of base
+   memory, or in the BIOS ROM, as [MP] 4 says. */
+static struct mp_fp *
+find_fp (void)
+{
+  uint8_t *bda = ptov (0x400);
+  uintptr_t ebda = (bda[0x0f] << 8 | bda[0x0e]) << 4;
+  uintptr_t base_end = (bda[0x14] << 8 | bda[0x13]) * 1024;
+  struct mp_fp *fp = NULL;
+
+  if (ebda != 0)
+    fp = search_fp (ebda, 1024);
+  if (fp == NULL && base_end >= 1024)
+    fp = search_fp (base_end - 1024, 1024);
+  if (fp == NULL)
+    fp = search_fp (0xf0000, 0x10000);
+  return fp;
+}
+
+/* Fills in lapic_ids[] and cpu_cnt from the MP tables, and sets
+   *LAPIC_ADDR to the physical address of the local APICs.
+   Returns false if there are no MP tables. */
+static bool
+find_cpus (uintptr_t *lapic_addr)
+{
+  struct mp_fp *fp = find_fp ();
+  struct mp_config *config;
+  uint8_t *p, *end;
+  int i;
+
+  if (fp == NULL)
+    return false;
+
+  if (fp->config == 0)
+    {
+      /* A default configuration has two CPUs, with local APIC IDs
+         0 and 1.  See [MP] 5. */
+      *lapic_addr = LAPIC_DEFAULT_ADDR;
+      lapic_ids[0] = 0;
+      lapic_ids[1] = 1;
+      cpu_cnt = 2;
+      return true;
+    }
+
+  if (fp->config >= init_ram_pages * PGSIZE)
+    return false;
+  config = ptov (fp->config);
+  if (memcmp (config->signature, "PCMP", 4)
+      || !checksum_ok (config, config->length))
+    return false;
+
+  *lapic_addr = config->lapic_addr;
+  cpu_cnt = 0;
+  p = (uint8_t *) (config + 1);
+  end = (uint8_t *) config + config->length;
+  for (i = 0; i < config->entry_cnt && p < end; i++)
+    if (*p == MP_PROC)
+      {
+        struct mp_proc *proc = (struct mp_proc *) p;
+
+        if ((proc->flags & MP_PROC_ENABLED) && cpu_cnt < CPU_MAX)
+          {
+            /* Keep the boot CPU first. */
+            if (proc->flags & MP_PROC_BSP)
+              {
+                lapic_ids[cpu_cnt] = lapic_ids[0];
+                lapic_ids[0] = proc->lapic_id;
+              }
+            else
+              lapic_ids[cpu_cnt] = proc->lapic_id;
+            cpu_cnt++;
+          }
+        p += sizeof *proc;
+      }
+    else
+      {
+        /* All the other entry types are 8 bytes long. */
+        p += 8;
+      }
+
+  if (cpu_cnt == 0)
+    cpu_cnt = 1;
+  return true;
+}
+
+/* Starts CPU C and waits up to 100 ms for it to come up. */
+static void
+start_cpu (struct cpu *c)
+{
+  struct thread *idle = thread_prepare_cpu (c);
+  int ms;
+
+  *(uint32_t *) ptov (AP_TRAMPOLINE + (ap_esp - ap_trampoline))
+    = (uint32_t) idle + PGSIZE;
+  lapic_start_ap (c->lapic_id, AP_TRAMPOLINE);
+  for (ms = 0; ms < 100 && !c->started; ms++)
+    timer_mdelay (1);
+}
+
+/* Main program of an application processor, called by the
+   startup code on the stack of the CPU's idle thread. */
+void
+ap_main (void)
+{
+  struct cpu *c = cpu_current ();
+
+  /* Load the boot CPU's GDT and our own TSS, if any, and the
+     IDT. */
+#ifdef USERPROG
+  gdt_init_ap (c->id);
+#else
+  asm volatile ("lgdt %0" : : "m" (gdtr_operand));
+#endif
+  asm volatile ("ljmp %0, $1f; 1:" : : "i" (SEL_KCSEG));
+  intr_init_ap ();
+  lapic_init_ap ();
+  c->started = true;
+
+  kernel_lock_acquire ();
+
+  /* The boot CPU has unmapped the startup code by now. */
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)) : "memory");
+
+  thread_start_ap ();
+}
+
+/* Asks CPU C to look at its run queue. */
+void
+smp_send_reschedule (struct cpu *c)
+{
+  ASSERT (smp_active);
+
+  if (c != cpu_current ())
+    lapic_send_ipi (c->lapic_id, LAPIC_RESCHED_VEC);
+}
+
+/* Reschedule IPI handler. */
+static void
+reschedule_interrupt (struct intr_frame *args UNUSED)
+{
+  thread_check_preempt ();
+}
+
+/* Kernel lock. */
+
+/* Acquires the kernel lock, spinning until the CPU holding it
+   lets go.  This CPU must not hold it already.  Does nothing
+   while there is only one CPU. */
+void
+kernel_lock_acquire (void)
+{
+  enum intr_level old_level;
+
+  if (!smp_active)
+    return;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&kernel_spinlock);
+  intr_set_level (old_level);
+}
+
+/* Releases the kernel lock, which this CPU must hold.  Until it
+   is acquired again, the running thread may only touch its own
+   data and call the parts of the kernel that work without the
+   kernel lock; see the comment at the top of this file. */
+void
+kernel_lock_release (void)
+{
+  enum intr_level old_level;
+
+  if (!smp_active)
+    return;
+
+  old_level = intr_disable ();
+  spinlock_release (&kernel_spinlock);
+  intr_set_level (old_level);
+}
+
+/* Returns true if this CPU holds the kernel lock, which is always
+   the case while there is only one CPU. */
+bool
+kernel_lock_held (void)
+{
+  return !smp_active || spinlock_held_by_current_cpu (&kernel_spinlock);
+}
+
+/* Acquires the kernel lock on entry to an interrupt handler, or
+   to code that needs it but may be called without it, unless
+   this CPU holds it already.  Returns true if it did acquire it,
+   in which case the caller must call kernel_lock_exit(true) on
+   its way out. */
+bool
+kernel_lock_enter (void)
+{
+  if (kernel_lock_held ())
+    return false;
+  kernel_lock_acquire ();
+  return true;
+}
+
+/* Releases the kernel lock on the way out of code that called
+   kernel_lock_enter(), if that returned ACQUIRED as true. */
+void
+kernel_lock_exit (bool acquired)
+{
+  if (acquired)
+    kernel_lock_release ();
+}
@@ -0,0 +1,53 @@
+#ifndef THREADS_SMP_H
+#define THREADS_SMP_H
+
+/* Most CPUs that we use. */
+#define CPU_MAX 8
+
+/* Physical address to which the application processors' startup
+   code is copied.  Must be page-aligned and below 1 MB, since
+   the processors start out in real mode there. */
+#define AP_TRAMPOLINE 0x3000
+
+#ifndef __ASSEMBLER__
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A processor. */
+struct cpu
+  {
+    int id;                     /* Index in cpus[]; 0 is the boot CPU. */
+    uint8_t lapic_id;           /* Local APIC ID. */
+    volatile bool started;      /* Set by the CPU once it has come up. */
+    bool online;                /* Running threads? */
+
+    /* Owned by interrupt.c. */
+    bool in_external_intr;      /* Processing an external interrupt? */
+    bool yield_on_return;       /* Should we yield on interrupt return? */
+  };
+
+/* CPUs found at boot, online or not.  There is always at least
+   the boot CPU. */
+extern struct cpu cpus[CPU_MAX];
+extern int cpu_cnt;
+
+/* If false (default), run on the boot CPU only.
+   If true, start the other CPUs too.
+   Controlled by kernel command-line option "-smp". */
+extern bool smp_enabled;
+
+/* True once more than one CPU may be running. */
+extern bool smp_active;
+
+void smp_init (void);
+struct cpu *cpu_current (void);
+void smp_send_reschedule (struct cpu *);
+
+void kernel_lock_acquire (void);
+void kernel_lock_release (void);
+bool kernel_lock_held (void);
+bool kernel_lock_enter (void);
+void kernel_lock_exit (bool);
+#endif
+
+#endif /* threads/smp.h */
@@ -0,0 +1,85 @@
+#include "threads/spinlock.h"
+#include <debug.h>
+#include <stddef.h>
+#include "threads/interrupt.h"
+#include "threads/smp.h"
+
+/* Atomically stores VALUE in *P and returns the old value.
+   See [IA32-v2b] "XCHG": with a memory operand, XCHG locks the
+   bus by itself. */
+static inline uint32_t
+xchg (volatile uint32_t *p, uint32_t value)
+{
+  asm volatile ("xchgl %0, %1" : "+m" (*p), "+r" (value) : : "memory");
+  return value;
+}
+
+/* Initializes LOCK as free. */
+void
+spinlock_init (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+
+  lock->locked = 0;
+  lock->cpu = NULL;
+}
+
+/* Acquires LOCK, spinning until it is free.  Interrupts must be
+   off, and LOCK must not already be held by this CPU. */
+void
+spinlock_acquire (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!spinlock_held_by_current_cpu (lock));
+
+  /* Spin on a plain read, so that waiting CPUs share the cache
+     line until it is released, and only then try the XCHG.  See
+     [IA32-v2b] "PAUSE". */
+  while (xchg (&lock->locked, 1) != 0)
+    while (lock->locked != 0)
+      asm volatile ("pause" : : : "memory");
+  lock->cpu = cpu_current ();
+}
+
+/* Tries to acquire LOCK and returns true if successful or false
+   if it is held.  Interrupts must be off. */
+bool
+spinlock_try_acquire (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (lock->locked != 0 || xchg (&lock->locked, 1) != 0)
+    return false;
+  lock->cpu = cpu_current ();
+  return true;
+}
+
+/* Releases LOCK, which this CPU must hold.  Interrupts must be
+   off. */
+void
+spinlock_release (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (spinlock_held_by_current_cpu (lock));
+
+  lock->cpu = NULL;
+
+  /* x86 does not reorder a store with earlier loads or stores,
+     so a plain store releases the lock once the compiler is kept
+     from moving the critical section past it. */
+  asm volatile ("movl $0, %0" : "=m" (lock->locked) : : "memory");
+}
+
+/* Returns true if this CPU holds LOCK, false otherwise.  (Note
+   that testing whether some other CPU holds a lock would be
+   racy.) */
+bool
+spinlock_held_by_current_cpu (const struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+
+  return lock->locked != 0 && lock->cpu == cpu_current ();
+}
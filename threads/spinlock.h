@@ -0,0 +1,31 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct cpu;
+
+/* Spin lock.
+
+   Mutual exclusion between CPUs, for code that cannot sleep.  A
+   spin lock must be acquired and released with interrupts off,
+   so that an interrupt handler on the holding CPU can never spin
+   on the lock it interrupted.  Use a struct lock for anything
+   that may block. */
+struct spinlock
+  {
+    volatile uint32_t locked;   /* 1 if held, 0 if free. */
+    struct cpu *cpu;            /* CPU holding it (for debugging). */
+  };
+
+/* Initializer for a static spin lock. */
+#define SPINLOCK_INITIALIZER { 0, NULL }
+
+void spinlock_init (struct spinlock *);
+void spinlock_acquire (struct spinlock *);
+bool spinlock_try_acquire (struct spinlock *);
+void spinlock_release (struct spinlock *);
+bool spinlock_held_by_current_cpu (const struct spinlock *);
+
+#endif /* threads/spinlock.h */
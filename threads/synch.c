@@ -29,8 +29,32 @@
 #include "threads/synch.h"
 #include <stdio.h>
 #include <string.h>
+#include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/lockstat.h"
+#include "threads/smp.h"
+#include "threads/spinlock.h"
 #include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Longest chain of lock holders that a donation follows: a
+   thread waiting for a lock held by a thread waiting for a lock,
+   and so on. */
+#define DONATION_DEPTH 8
+
+/* Longest that lock_acquire() spins, in TSC cycles, waiting for
+   a holder running on another CPU, before it goes to sleep.
+   About what it costs to sleep and be woken up. */
+#define LOCK_SPIN_CYCLES 20000
+
+static bool thread_priority_less (const struct list_elem *,
+                                  const struct list_elem *, void *aux);
+
+/* Called by down() each time the current thread is about to
+   block, with interrupts off and the semaphore's spin lock
+   held. */
+typedef void block_func (void *aux);
+static void down (struct semaphore *, block_func *, void *aux);
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -40,14 +64,22 @@
      decrement it.
 
    - up or "V": increment the value (and wake up one waiting
-     thread, if any). */
+     thread, if any).
+
+   A semaphore has a spin lock of its own, so semaphores work
+   without the kernel lock, and threads on different CPUs can
+   hand one back and forth without waiting for each other. */
 void
 sema_init (struct semaphore *sema, unsigned value) 
 {
   ASSERT (sema != NULL);
 
+  spinlock_init (&sema->lock);
   sema->value = value;
   list_init (&sema->waiters);
+#ifdef LOCKSTAT
+  sema->class = NULL;
+#endif
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -56,22 +88,52 @@ sema_init (struct semaphore *sema, unsigned value)
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but if it sleeps then the next scheduled
-   thread will probably turn interrupts back on. */
+   thread will probably turn interrupts back on.
+
+   If SEMA belongs to a lock, the wait is charged to the lock's
+   statistics. */
 void
 sema_down (struct semaphore *sema) 
+{
+  down (sema, NULL, NULL);
+}
+
+/* Does the work of sema_down(), calling BEFORE_BLOCK, if it is
+   nonnull, with AUX each time before the current thread blocks,
+   including when it has been woken up only to find that another
+   thread got to SEMA first. */
+static void
+down (struct semaphore *sema, block_func *before_block, void *aux)
 {
   enum intr_level old_level;
+#ifdef LOCKSTAT
+  bool contended;
+  uint64_t start;
+#endif
 
   ASSERT (sema != NULL);
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
+  spinlock_acquire (&sema->lock);
+#ifdef LOCKSTAT
+  contended = sema->value == 0;
+  start = rdtsc ();
+#endif
   while (sema->value == 0) 
     {
+      if (before_block != NULL)
+        before_block (aux);
       list_push_back (&sema->waiters, &thread_current ()->elem);
-      thread_block ();
+      thread_block_unlock (&sema->lock);
+      spinlock_acquire (&sema->lock);
     }
   sema->value--;
+  spinlock_release (&sema->lock);
+#ifdef LOCKSTAT
+  if (sema->class != NULL)
+    lockstat_acquired (sema->class, contended, rdtsc () - start);
+#endif
   intr_set_level (old_level);
 }
 
@@ -89,6 +151,7 @@ sema_try_down (struct semaphore *sema)
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
+  spinlock_acquire (&sema->lock);
   if (sema->value > 0) 
     {
       sema->value--;
@@ -96,28 +159,49 @@ sema_try_down (struct semaphore *sema)
     }
   else
     success = false;
+  spinlock_release (&sema->lock);
   intr_set_level (old_level);
 
   return success;
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any, the one that has waited longest among equals.
+   If that thread has a higher priority than the running thread,
+   and interrupts were on, yields to it.
+
+   The thread is unblocked after SEMA's spin lock is released, so
+   that the run queue's lock is never taken inside it.
 
    This function may be called from an interrupt handler. */
 void
 sema_up (struct semaphore *sema) 
 {
   enum intr_level old_level;
+  struct thread *t = NULL;
 
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
+  spinlock_acquire (&sema->lock);
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      /* Waiters' priorities can change while they wait, through
+         donation, so pick the highest now. */
+      struct list_elem *e = list_max (&sema->waiters,
+                                      thread_priority_less, NULL);
+      list_remove (e);
+      t = list_entry (e, struct thread, elem);
+    }
   sema->value++;
+  spinlock_release (&sema->lock);
+  if (t != NULL)
+    thread_unblock (t);
   intr_set_level (old_level);
+
+  if (old_level == INTR_ON)
+    thread_preempt ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -171,20 +255,143 @@ sema_test_helper (void *sema_)
    another one "up" it, but with a lock the same thread must both
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   instead of a lock.
+
+   NAME identifies the lock in lock statistics; see lockstat.c.
+   Locks with the same name are counted together. */
 void
-lock_init (struct lock *lock)
+lock_init (struct lock *lock, const char *name)
 {
   ASSERT (lock != NULL);
+  ASSERT (name != NULL);
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+  lock->priority = PRI_MIN - 1;
+#ifdef LOCKSTAT
+  lock->semaphore.class = lockstat_class (name);
+#endif
+}
+
+/* Makes the current thread the holder of LOCK, which it has just
+   downed, taking on the donations of LOCK's remaining waiters.
+   Interrupts must be off. */
+static void
+lock_take (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+  struct list *waiters = &lock->semaphore.waiters;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock->holder = cur;
+  lock->priority = PRI_MIN - 1;
+  if (!thread_mlfqs && !list_empty (waiters))
+    lock->priority = list_entry (list_max (waiters, thread_priority_less,
+                                           NULL),
+                                 struct thread, elem)->priority;
+  list_push_back (&cur->locks_held, &lock->elem);
+  if (lock->priority > cur->priority)
+    thread_donate_priority (cur, lock->priority);
+#ifdef LOCKSTAT
+  lock->acquire_tsc = rdtsc ();
+#endif
+}
+
+/* Returns true if LOCK's holder is running on another CPU.
+   Called without the kernel lock, so the answer may be stale by
+   the time it is returned, which only costs a wasted spin or an
+   early sleep. */
+static bool
+holder_running (const struct lock *lock)
+{
+  struct thread *holder = lock->holder;
+
+  return (holder != NULL && holder != thread_current ()
+          && holder->status == THREAD_RUNNING);
+}
+
+/* If LOCK is held by a thread running on another CPU, waits for
+   it to be released, for up to LOCK_SPIN_CYCLES.  A short
+   critical section is usually over before a sleep and a wakeup
+   could have been, and a holder that is not running will not
+   release the lock any time soon.
+
+   The holder may need the kernel lock to finish its critical
+   section, so the kernel lock is released while spinning.  A
+   caller with interrupts off may be relying on the kernel lock
+   for atomicity up to the point where it sleeps, so it never
+   spins.  -no=lock-spin turns spinning off altogether. */
+static void
+lock_spin (struct lock *lock)
+{
+  uint64_t start, deadline;
+
+  if (!smp_active || !feature_enabled (FEATURE_LOCK_SPIN)
+      || intr_get_level () == INTR_OFF || !holder_running (lock))
+    return;
+
+  kernel_lock_release ();
+  start = rdtsc ();
+  deadline = start + LOCK_SPIN_CYCLES;
+  while (holder_running (lock) && rdtsc () < deadline)
+    asm volatile ("pause" : : : "memory");
+  kernel_lock_acquire ();
+
+#ifdef LOCKSTAT
+  lockstat_spun (lock->semaphore.class, rdtsc () - start);
+#endif
+}
+
+/* Called by lock_acquire() each time the current thread is about
+   to block on LOCK_, with interrupts off.  Records that it waits
+   for the lock and donates its priority along the chain of
+   holders.  A thread woken by lock_release() can lose the lock to
+   another thread before it runs, and then blocks again; its
+   donation has to be made again then, because the new holder
+   did not inherit it. */
+static void
+lock_donate (void *lock_)
+{
+  struct lock *lock = lock_;
+  struct thread *cur = thread_current ();
+  struct lock *l = lock;
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_mlfqs)
+    return;
+
+  cur->waiting_lock = lock;
+  for (depth = 0; depth < DONATION_DEPTH && l != NULL
+         && l->holder != NULL && l->priority < cur->priority; depth++)
+    {
+      l->priority = cur->priority;
+      thread_donate_priority (l->holder, cur->priority);
+      l = l->holder->waiting_lock;
+    }
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   Unlike a semaphore, a lock relies on the kernel lock to keep
+   its holder and donations consistent, so the caller must hold
+   the kernel lock.
+
+   With more than one CPU, if the holder is running on another
+   CPU, the current thread first spins for a while in the hope
+   that the holder lets go soon; see lock_spin().
+
+   While it waits, the current thread donates its priority to the
+   lock's holder, if that is lower, and onward along the chain of
+   locks that the holder is itself waiting for, up to
+   DONATION_DEPTH holders deep, so that no lower-priority thread
+   holds it up.  (With the 4.4BSD scheduler, there is no
+   donation.)
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +399,21 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
+  ASSERT (kernel_lock_held ());
+
+  lock_spin (lock);
 
-  sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  old_level = intr_disable ();
+  down (&lock->semaphore, lock_donate, lock);
+  cur->waiting_lock = NULL;
+  lock_take (lock);
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -209,18 +425,29 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+#ifdef LOCKSTAT
+      lockstat_acquired (lock->semaphore.class, false, 0);
+#endif
+      lock_take (lock);
+    }
+  intr_set_level (old_level);
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   The current thread gives up the priority donated to it through
+   LOCK, and yields if that leaves a thread of higher priority
+   ready.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,11 +455,24 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+#ifdef LOCKSTAT
+  lockstat_released (lock->semaphore.class, rdtsc () - lock->acquire_tsc);
+#endif
   lock->holder = NULL;
+  list_remove (&lock->elem);
+  if (!thread_mlfqs)
+    thread_update_priority (thread_current ());
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
+
+  if (old_level == INTR_ON)
+    thread_preempt ();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -251,8 +491,23 @@ struct semaphore_elem
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
+/* Returns true if the thread waiting on semaphore_elem A has a
+   lower priority than the one waiting on B. */
+static bool
+waiter_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct semaphore_elem *a
+    = list_entry (a_, struct semaphore_elem, elem);
+  const struct semaphore_elem *b
+    = list_entry (b_, struct semaphore_elem, elem);
+
+  return a->thread->priority < b->thread->priority;
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -294,7 +549,11 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
   
+#ifdef LOCKSTAT
+  lockstat_cond_wait (lock->semaphore.class);
+#endif
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
@@ -302,8 +561,9 @@ cond_wait (struct condition *cond, struct lock *lock)
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
-   LOCK must be held before calling this function.
+   this function signals the one of highest priority to wake up
+   from its wait.  LOCK must be held before calling this
+   function.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
@@ -317,8 +577,24 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct list_elem *e = list_max (&cond->waiters,
+                                      waiter_priority_less, NULL);
+      list_remove (e);
+      sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+    }
+}
+
+/* Returns true if the thread with list element A has a lower
+   priority than the one with list element B. */
+static bool
+thread_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->priority < b->priority;
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -336,3 +612,246 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RW as a reader-writer lock held by no one.
+
+   Any number of readers may hold a reader-writer lock at once,
+   or a single writer.  The lock prefers writers: a thread that
+   wants to read waits while any thread of its own priority or
+   higher waits to write, so that a steady stream of readers
+   cannot starve the writers.  When the lock comes free, it goes
+   to every waiting reader that outranks all of the waiting
+   writers, or else to the highest-priority waiting writer.
+
+   The lock is handed over directly: a thread woken from its
+   wait already holds it.  Unlike struct lock, a reader-writer
+   lock does not donate priority.  Like struct lock, it relies on
+   the kernel lock and must only be used with it held. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  rw->readers = 0;
+  rw->writer = NULL;
+  list_init (&rw->read_waiters);
+  list_init (&rw->write_waiters);
+}
+
+/* Returns the highest priority of the threads on WAITERS, or
+   PRI_MIN - 1 if there are none. */
+static int
+max_waiter_priority (struct list *waiters)
+{
+  if (list_empty (waiters))
+    return PRI_MIN - 1;
+  return list_entry (list_max (waiters, thread_priority_less, NULL),
+                     struct thread, elem)->priority;
+}
+
+/* Hands RW, which no one holds, to the threads waiting for it
+   that should have it next, as described at rwlock_init().
+   Interrupts must be off. */
+static void
+rwlock_hand_over (struct rwlock *rw)
+{
+  int writer_priority = max_waiter_priority (&rw->write_waiters);
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (rw->readers == 0 && rw->writer == NULL);
+
+  for (e = list_begin (&rw->read_waiters); e != list_end (&rw->read_waiters); )
+    {
+      struct thread *t = list_entry (e, struct thread, elem);
+      e = list_next (e);
+      if (t->priority > writer_priority)
+        {
+          list_remove (&t->elem);
+          rw->readers++;
+          thread_unblock (t);
+        }
+    }
+
+  if (rw->readers == 0 && !list_empty (&rw->write_waiters))
+    {
+      struct list_elem *max = list_max (&rw->write_waiters,
+                                        thread_priority_less, NULL);
+      list_remove (max);
+      rw->writer = list_entry (max, struct thread, elem);
+      thread_unblock (rw->writer);
+    }
+}
+
+/* Acquires RW for reading, sleeping until it is available if
+   necessary.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rw->writer != cur);
+
+  old_level = intr_disable ();
+  if (rw->writer == NULL
+      && cur->priority > max_waiter_priority (&rw->write_waiters))
+    rw->readers++;
+  else
+    {
+      list_push_back (&rw->read_waiters, &cur->elem);
+      thread_block ();
+    }
+  intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread must hold for reading. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (rw->readers > 0);
+
+  old_level = intr_disable ();
+  if (--rw->readers == 0)
+    rwlock_hand_over (rw);
+  intr_set_level (old_level);
+
+  if (old_level == INTR_ON)
+    thread_preempt ();
+}
+
+/* Acquires RW for writing, sleeping until it is available if
+   necessary.  The current thread must not hold RW already.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rw->writer != cur);
+
+  old_level = intr_disable ();
+  if (rw->writer == NULL && rw->readers == 0)
+    rw->writer = cur;
+  else
+    {
+      list_push_back (&rw->write_waiters, &cur->elem);
+      thread_block ();
+    }
+  intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread must hold for
+   writing. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (rw->writer == thread_current ());
+
+  old_level = intr_disable ();
+  rw->writer = NULL;
+  rwlock_hand_over (rw);
+  intr_set_level (old_level);
+
+  if (old_level == INTR_ON)
+    thread_preempt ();
+}
+
+/* Initializes SEQ as a sequence lock.
+
+   A sequence lock protects a few words of data, such as a set of
+   counters, that are written often and read now and then.
+   Writers never wait for readers.  Readers never write anything
+   and never block; instead, a reader reads the data between
+   seqlock_read_begin() and seqlock_read_retry() and, if a write
+   happened in between, reads it again:
+
+        unsigned seq;
+        do
+          {
+            seq = seqlock_read_begin (&stats_seq);
+            hits = stats.hits;
+            misses = stats.misses;
+          }
+        while (seqlock_read_retry (&stats_seq, seq));
+
+   The sequence number is odd while a write is in progress.
+   Writes turn off interrupts, so that a reader on the same CPU
+   never sees a write half done, and must not run at the same
+   time as each other: on one CPU that follows from the
+   interrupts being off, and across CPUs from the kernel lock.
+   No memory fences are needed beyond compiler barriers, since
+   x86 keeps loads in order with loads and stores with
+   stores. */
+void
+seqlock_init (struct seqlock *seq)
+{
+  ASSERT (seq != NULL);
+
+  seq->seq = 0;
+}
+
+/* Begins a read of the data protected by SEQ and returns the
+   value to pass to seqlock_read_retry() at the end. */
+unsigned
+seqlock_read_begin (const struct seqlock *seq)
+{
+  unsigned start;
+
+  while ((start = seq->seq) & 1)
+    asm volatile ("pause");
+  barrier ();
+  return start;
+}
+
+/* Returns true if the data protected by SEQ changed since the
+   seqlock_read_begin() call that returned START, meaning that
+   the read must be retried. */
+bool
+seqlock_read_retry (const struct seqlock *seq, unsigned start)
+{
+  barrier ();
+  return seq->seq != start;
+}
+
+/* Begins a write of the data protected by SEQ.  Turns off
+   interrupts and returns the previous interrupt level, to pass
+   to seqlock_write_end().
+
+   This function may be called from an interrupt handler. */
+enum intr_level
+seqlock_write_begin (struct seqlock *seq)
+{
+  enum intr_level old_level = intr_disable ();
+
+  ASSERT (!(seq->seq & 1));
+  seq->seq++;
+  barrier ();
+  return old_level;
+}
+
+/* Ends a write of the data protected by SEQ, and restores the
+   interrupt level OLD_LEVEL. */
+void
+seqlock_write_end (struct seqlock *seq, enum intr_level old_level)
+{
+  barrier ();
+  seq->seq++;
+  intr_set_level (old_level);
+}
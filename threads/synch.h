@@ -3,12 +3,19 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/spinlock.h"
 
 /* A counting semaphore. */
 struct semaphore 
   {
+    struct spinlock lock;       /* Protects the members below. */
     unsigned value;             /* Current value. */
     struct list waiters;        /* List of waiting threads. */
+#ifdef LOCKSTAT
+    struct lock_class *class;   /* Lock statistics, or null. */
+#endif
   };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -22,9 +29,14 @@ struct lock
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's locks_held. */
+    int priority;               /* Highest priority donated through it. */
+#ifdef LOCKSTAT
+    uint64_t acquire_tsc;       /* Time stamp counter when acquired. */
+#endif
   };
 
-void lock_init (struct lock *);
+void lock_init (struct lock *, const char *name);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
@@ -41,6 +53,39 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Reader-writer lock. */
+struct rwlock
+  {
+    unsigned readers;           /* Number of readers holding it. */
+    struct thread *writer;      /* Writer holding it, or null. */
+    struct list read_waiters;   /* Threads waiting to read. */
+    struct list write_waiters;  /* Threads waiting to write. */
+  };
+
+/* Initializer for a reader-writer lock named NAME that is held
+   by no one, for use in static initialization. */
+#define RWLOCK_INITIALIZER(NAME)                                \
+        { 0, NULL, LIST_INITIALIZER ((NAME).read_waiters),      \
+          LIST_INITIALIZER ((NAME).write_waiters) }
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+
+/* Sequence lock. */
+struct seqlock
+  {
+    volatile unsigned seq;      /* Odd while a write is in progress. */
+  };
+
+void seqlock_init (struct seqlock *);
+unsigned seqlock_read_begin (const struct seqlock *);
+bool seqlock_read_retry (const struct seqlock *, unsigned start);
+enum intr_level seqlock_write_begin (struct seqlock *);
+void seqlock_write_end (struct seqlock *, enum intr_level);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -4,10 +4,14 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/flags.h"
+#include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/smp.h"
+#include "threads/spinlock.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -20,26 +24,84 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queue: processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   Each CPU has its own, along with the rest of its scheduler
+   state.  There is one FIFO list per priority, and bit P of
+   `mask' is set if and only if lists[P] is nonempty, so that
+   finding the highest-priority ready thread takes a single bit
+   scan.  A ready thread is on the run queue of the CPU that its
+   `cpu' member points to, in the list for its `rq_priority'.
+
+   Each run queue has a spin lock of its own, which protects its
+   lists, counts and `curr', along with the `cpu' and `status'
+   members of the threads on it.  Code that needs two run queues'
+   locks at once takes the one of the lower-numbered CPU first.
+   The rest of a CPU's scheduler state is only touched by that
+   CPU, with interrupts off. */
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1)
+struct runqueue
+  {
+    struct spinlock lock;               /* Protects the members below. */
+    struct list lists[PRI_CNT];         /* Ready threads by priority. */
+    uint64_t mask;                      /* Nonempty lists. */
+    size_t cnt;                         /* Number of ready threads. */
+    int load;                           /* Total weight of ready threads. */
+    struct thread *curr;                /* Running thread. */
+    struct thread *idle_thread;         /* Idle thread. */
+    unsigned thread_ticks;              /* # of timer ticks since last yield. */
+
+    /* Set when a thread of higher priority than the running
+       thread became ready while the running thread could not
+       yield at once.  The running thread yields at the next
+       chance it gets. */
+    bool preempt_pending;
+  };
+static struct runqueue runqueues[CPU_MAX];
 
 /* List of all processes.  Processes are added to this list
-   when they are first scheduled and removed when they exit. */
+   when they are first scheduled and removed when they exit.
+   Protected by all_lock. */
 static struct list all_list;
-
-/* List of process in sleep */
-static struct list sleep_list;
+static struct spinlock all_lock;
+
+/* Threads that have died but whose pages have not yet been
+   returned to the page allocator, most recently died last.
+   thread_create() reuses up to THREAD_CACHE_MAX of these pages
+   as they are, instead of allocating and zeroing a fresh page,
+   since init_thread() resets the struct thread header and its
+   magic canary anyway and the stack needs no zeroing.
+   -no=thread-cache turns this off.
+   thread_reap() frees the rest.  When the page allocator runs
+   short, thread_reap_cached() frees the kept pages too.
+   Protected by dying_lock. */
+#define THREAD_CACHE_MAX 16
+static struct list dying_list;
+static size_t dying_cnt;
+static struct spinlock dying_lock;
+
+/* Sleeping processes, ordered by wakeup_tick, so that the timer
+   interrupt only has to look at the ones whose time has come. */
+static struct heap sleep_queue;
 static int64_t next_tick_to_wakeup = INT64_MAX;
 
-/* Idle thread. */
-static struct thread *idle_thread;
+/* Threads in high-resolution sleeps, ordered by wakeup_tsc. */
+static struct heap tsc_sleep_queue;
+
+/* If false (default), use round-robin scheduler.
+   If true, use multi-level feedback queue scheduler.
+   Controlled by kernel command-line option "-mlfqs". */
+bool thread_mlfqs;
+
+/* 4.4BSD scheduler state. */
+static fixed_t load_avg;        /* System load average. */
+static int64_t mlfqs_seconds;   /* Seconds since boot. */
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
 /* Lock used by allocate_tid(). */
-static struct lock tid_lock;
+static struct spinlock tid_lock;
 
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
@@ -56,11 +118,12 @@ static long long user_ticks;    /* # of timer ticks in user programs. */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+#define BALANCE_INTERVAL 8      /* # of timer ticks between rebalancing. */
 
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
+static void idle_loop (void) NO_RETURN;
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
@@ -69,13 +132,35 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void thread_reap (void);
+static size_t free_dying (size_t keep);
+static struct thread *recycle_thread (void);
+static struct runqueue *this_rq (void);
+static struct runqueue *cpu_rq (struct cpu *);
+static struct runqueue *lock_thread_rq (struct thread *);
+static bool rq_idle (struct runqueue *);
+static struct cpu *select_cpu (struct thread *);
+static void set_priority (struct thread *, int priority);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static int ready_max_priority (struct runqueue *);
+static int running_priority (struct runqueue *);
+static bool rq_preempted (struct runqueue *);
+static int priority_weight (int priority);
+static bool steal_threads (void);
+static void balance (void);
+static heap_less_func wakeup_less;
+static heap_less_func wakeup_tsc_less;
+static void mlfqs_tick (struct thread *, int64_t tick);
+static void mlfqs_decay (struct thread *);
+static int mlfqs_priority (const struct thread *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
    general and it is possible in this case only because loader.S
    was careful to put the bottom of the stack at a page boundary.
 
-   Also initializes the run queue and the tid lock.
+   Also initializes the run queues and the scheduler's locks.
 
    After calling this function, be sure to initialize the page
    allocator before trying to create any threads with
@@ -86,18 +171,33 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int cpu, pri;
+
   ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_CNT <= 64);
 
-  lock_init (&tid_lock);
-  list_init (&ready_list);
+  spinlock_init (&tid_lock);
+  for (cpu = 0; cpu < CPU_MAX; cpu++)
+    {
+      spinlock_init (&runqueues[cpu].lock);
+      for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+        list_init (&runqueues[cpu].lists[pri]);
+    }
   list_init (&all_list);
-  list_init (&sleep_list);
+  spinlock_init (&all_lock);
+  heap_init (&sleep_queue, wakeup_less, NULL);
+  heap_init (&tsc_sleep_queue, wakeup_tsc_less, NULL);
+  list_init (&dying_list);
+  spinlock_init (&dying_lock);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
+  initial_thread->cpu = &cpus[0];
   initial_thread->status = THREAD_RUNNING;
+  initial_thread->on_cpu = true;
   initial_thread->tid = allocate_tid ();
+  runqueues[0].curr = initial_thread;
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -117,15 +217,17 @@ thread_start (void)
   sema_down (&idle_started);
 }
 
-/* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
+/* Called by the timer interrupt handler at each timer tick,
+   numbered TICK.  Thus, this function runs in an external
+   interrupt context. */
 void
-thread_tick (void) 
+thread_tick (int64_t tick) 
 {
   struct thread *t = thread_current ();
+  struct runqueue *rq = this_rq ();
 
   /* Update statistics. */
-  if (t == idle_thread)
+  if (t == rq->idle_thread)
     idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
@@ -134,11 +236,54 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    mlfqs_tick (t, tick);
+
+  /* Spread the load over the CPUs. */
+  if (smp_active && feature_enabled (FEATURE_BALANCE))
+    {
+      if (t == rq->idle_thread)
+        steal_threads ();
+      else if (tick % BALANCE_INTERVAL == 0)
+        balance ();
+    }
+
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (++rq->thread_ticks >= TIME_SLICE || rq->preempt_pending
+      || rq_preempted (rq))
     intr_yield_on_return ();
 }
 
+/* Called in an external interrupt context when another CPU has
+   made a thread ready on this CPU's run queue.  Yields on return
+   from the interrupt if that thread outranks the running one. */
+void
+thread_check_preempt (void)
+{
+  ASSERT (intr_context ());
+
+  if (rq_preempted (this_rq ()))
+    intr_yield_on_return ();
+}
+
+/* Returns true if the running thread's time slice may need to
+   end at the next timer tick, that is, if any thread is waiting
+   to run.  The timer calls this to decide whether it can skip
+   ticks.  Interrupts must be off. */
+bool
+thread_tick_needed (void) 
+{
+  struct runqueue *rq = this_rq ();
+  bool needed;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  spinlock_acquire (&rq->lock);
+  needed = rq->mask != 0;
+  spinlock_release (&rq->lock);
+  return needed;
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
@@ -159,9 +304,17 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread has a higher priority than the running
+   thread, and interrupts are on, the new thread runs before
+   thread_create() returns.
+
+   With the 4.4BSD scheduler, PRIORITY is ignored: the new thread
+   inherits the running thread's niceness and recent CPU time and
+   gets the priority that follows from them.
+
+   This function may be called without the kernel lock.  The new
+   thread starts out holding the kernel lock if and only if the
+   running thread holds it. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -174,14 +327,22 @@ thread_create (const char *name, int priority,
 
   ASSERT (function != NULL);
 
-  /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  /* Allocate thread, preferably in a dead thread's page, or else
+     after handing back the pages of threads that have died so
+     that we can reuse them. */
+  t = recycle_thread ();
   if (t == NULL)
-    return TID_ERROR;
+    {
+      thread_reap ();
+      t = palloc_get_page (PAL_ZERO);
+      if (t == NULL)
+        return TID_ERROR;
+    }
 
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  t->kernel_locked = kernel_lock_held ();
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -207,7 +368,9 @@ thread_create (const char *name, int priority,
 /* Puts the current thread to sleep.  It will not be scheduled
    again until awoken by thread_unblock().
 
-   This function must be called with interrupts turned off.  It
+   This function must be called with interrupts turned off and
+   the kernel lock held, which keeps whoever is to wake the
+   thread up from doing so before it is on its way to sleep.  It
    is usually a better idea to use one of the synchronization
    primitives in synch.h. */
 void
@@ -215,47 +378,139 @@ thread_block (void)
 {
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (kernel_lock_held ());
 
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
 }
 
+/* Puts the current thread to sleep, like thread_block(), and
+   releases LOCK, which must be held, once it is marked blocked.
+   Whoever wakes the thread up takes LOCK first, so it does not
+   miss the wakeup, without the kernel lock.  LOCK is not held on
+   return.
+
+   This function must be called with interrupts turned off. */
+void
+thread_block_unlock (struct spinlock *lock)
+{
+  ASSERT (!intr_context ());
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  thread_current ()->status = THREAD_BLOCKED;
+  spinlock_release (lock);
+  schedule ();
+}
+
 /* Transitions a blocked thread T to the ready-to-run state.
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
 
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
-   it may expect that it can atomically unblock a thread and
-   update other data. */
+   T goes on the run queue of the CPU that select_cpu() picks.
+   If that is another CPU, and T outranks the thread running
+   there, that CPU is sent a reschedule IPI.  If it is this CPU,
+   and T has a higher priority than the running thread, the
+   running thread is preempted: at once if interrupts are on, on
+   return from the interrupt if called from an interrupt handler.
+   If the caller had disabled interrupts itself, it may expect
+   that it can atomically unblock a thread and update other data,
+   so then preemption is only marked pending; the caller should
+   call thread_preempt() once interrupts are back on, and failing
+   that the next timer tick preempts.
+
+   This function may be called without the kernel lock, but then
+   not with any spin lock held. */
 void
 thread_unblock (struct thread *t) 
 {
   enum intr_level old_level;
+  struct runqueue *rq;
+  struct cpu *c;
+  bool preempt;
 
   ASSERT (is_thread (t));
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+
+  /* T may have blocked on another CPU that has not yet switched
+     away from it.  Wait until it has, so that T is not run in two
+     places at once. */
+  while (t->on_cpu)
+    asm volatile ("pause" : : : "memory");
+
+  if (thread_mlfqs)
+    {
+      mlfqs_decay (t);
+      t->priority = mlfqs_priority (t);
+    }
+  c = t->cpu = select_cpu (t);
+  rq = cpu_rq (c);
+  spinlock_acquire (&rq->lock);
+  ready_push (t);
   t->status = THREAD_READY;
+  preempt = t->priority > running_priority (rq);
+  spinlock_release (&rq->lock);
+
+  /* Only a tickless timer can have stopped ticking for T's time
+     slice, and its state relies on the kernel lock. */
+  if (timer_tickless && c == &cpus[0])
+    {
+      bool acquired = kernel_lock_enter ();
+      timer_wake_by (0);
+      kernel_lock_exit (acquired);
+    }
+
+  if (preempt)
+    {
+      if (c != cpu_current ())
+        smp_send_reschedule (c);
+      else if (intr_context ())
+        intr_yield_on_return ();
+      else
+        this_rq ()->preempt_pending = true;
+    }
   intr_set_level (old_level);
+
+  if (old_level == INTR_ON)
+    thread_preempt ();
+}
+
+/* Returns true if thread A's wakeup tick is earlier than thread
+   B's. */
+static bool
+wakeup_less (const struct heap_elem *a_, const struct heap_elem *b_,
+             void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, sleep_elem);
+  const struct thread *b = heap_entry (b_, struct thread, sleep_elem);
+
+  return a->wakeup_tick < b->wakeup_tick;
 }
 
+/* Sets next_tick_to_wakeup to the wakeup tick of the first
+   thread in the sleep queue, or INT64_MAX if it is empty. */
 static void
-update_next_tick_to_wakeup (int64_t tick)
+update_next_tick_to_wakeup (void)
 {
-  next_tick_to_wakeup = 
-    (next_tick_to_wakeup > tick) ? tick : next_tick_to_wakeup;
+  struct heap_elem *min = heap_min (&sleep_queue);
+
+  next_tick_to_wakeup = (min != NULL
+                         ? heap_entry (min, struct thread,
+                                       sleep_elem)->wakeup_tick
+                         : INT64_MAX);
 }
 
+/* Returns the earliest tick at which a sleeping thread is to
+   wake up, or INT64_MAX if none is sleeping. */
 int64_t
 get_next_tick_to_wakeup (void)
 {
   return next_tick_to_wakeup;
 }
 
-/* Wakes up this thread after ticks */
+/* Puts the running thread to sleep until timer tick TICK.
+   Takes O(1) time. */
 void
 thread_sleep (int64_t tick)
 {
@@ -265,38 +520,88 @@ thread_sleep (int64_t tick)
   old_level = intr_disable ();
   cur = thread_current ();
 
-  ASSERT (cur != idle_thread);
+  ASSERT (cur != this_rq ()->idle_thread);
 
-  update_next_tick_to_wakeup (cur->wakeup_tick = tick);
-  list_push_back (&sleep_list, &cur->elem);
+  cur->wakeup_tick = tick;
+  heap_insert (&sleep_queue, &cur->sleep_elem);
+  update_next_tick_to_wakeup ();
+  timer_wake_by (tick);
 
   thread_block ();
 
   intr_set_level (old_level);
 }
 
+/* Wakes up every thread whose wakeup tick is CURRENT_TICK or
+   earlier.  Takes O(log n) amortized time per thread woken, for
+   n sleeping threads, and looks at no other thread. */
 void
 thread_wakeup (int64_t current_tick)
 {
-  struct list_elem *e;
+  struct heap_elem *min;
 
-  next_tick_to_wakeup = INT64_MAX;
+  ASSERT (intr_get_level () == INTR_OFF);
 
-  e = list_begin (&sleep_list);
-  while (e != list_end (&sleep_list))
+  while ((min = heap_min (&sleep_queue)) != NULL
+         && heap_entry (min, struct thread,
+                        sleep_elem)->wakeup_tick <= current_tick)
+    thread_unblock (heap_entry (heap_pop_min (&sleep_queue),
+                                struct thread, sleep_elem));
+  update_next_tick_to_wakeup ();
+}
+
+/* Returns true if thread A's wakeup TSC value is earlier than
+   thread B's. */
+static bool
+wakeup_tsc_less (const struct heap_elem *a_, const struct heap_elem *b_,
+                 void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, sleep_elem);
+  const struct thread *b = heap_entry (b_, struct thread, sleep_elem);
+
+  return a->wakeup_tsc < b->wakeup_tsc;
+}
+
+/* Puts the running thread to sleep until the TSC reaches TSC. */
+void
+thread_sleep_tsc (uint64_t tsc)
+{
+  struct thread *cur;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  cur = thread_current ();
+
+  ASSERT (cur != this_rq ()->idle_thread);
+
+  cur->wakeup_tsc = tsc;
+  heap_insert (&tsc_sleep_queue, &cur->sleep_elem);
+  timer_wake_at_tsc (tsc);
+
+  thread_block ();
+
+  intr_set_level (old_level);
+}
+
+/* Wakes up every thread in a high-resolution sleep whose wakeup
+   TSC value is NOW or earlier.  Returns the earliest wakeup TSC
+   value of those still asleep, or UINT64_MAX if none is. */
+uint64_t
+thread_wakeup_tsc (uint64_t now)
+{
+  struct heap_elem *min;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while ((min = heap_min (&tsc_sleep_queue)) != NULL)
     {
-      struct thread *t = list_entry (e, struct thread, elem);
-      if (current_tick >= t->wakeup_tick)
-        {
-          e = list_remove (&t->elem);
-          thread_unblock (t);
-        }
-      else
-        {
-          e = list_next (e);
-          update_next_tick_to_wakeup (t->wakeup_tick);
-        }
+      struct thread *t = heap_entry (min, struct thread, sleep_elem);
+      if (t->wakeup_tsc > now)
+        return t->wakeup_tsc;
+      heap_pop_min (&tsc_sleep_queue);
+      thread_unblock (t);
     }
+  return UINT64_MAX;
 }
 
 /* Returns the name of the running thread. */
@@ -342,12 +647,17 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  thread_reap ();
+  malloc_cache_flush ();
+  palloc_cache_flush ();
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
+  spinlock_acquire (&all_lock);
   list_remove (&thread_current()->allelem);
+  spinlock_release (&all_lock);
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -360,19 +670,45 @@ thread_yield (void)
 {
   struct thread *cur = thread_current ();
   enum intr_level old_level;
+  struct runqueue *rq;
   
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+  rq = this_rq ();
+  spinlock_acquire (&rq->lock);
+  if (cur != rq->idle_thread) 
+    ready_push (cur);
   cur->status = THREAD_READY;
+  spinlock_release (&rq->lock);
   schedule ();
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if a thread of higher priority than the running
+   thread is ready, as happens when thread_unblock() readies one
+   while interrupts are off or when the running thread gives up a
+   priority donation.  Interrupts must be on. */
+void
+thread_preempt (void)
+{
+  bool yield;
+
+  ASSERT (!intr_context ());
+  ASSERT (intr_get_level () == INTR_ON);
+
+  intr_disable ();
+  yield = this_rq ()->preempt_pending || rq_preempted (this_rq ());
+  intr_enable ();
+
+  if (yield)
+    thread_yield ();
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
-   This function must be called with interrupts off. */
+   This function must be called with interrupts off.  It holds
+   all_lock, a spin lock, while it runs, so 'func' must not
+   sleep. */
 void
 thread_foreach (thread_action_func *func, void *aux)
 {
@@ -380,19 +716,76 @@ thread_foreach (thread_action_func *func, void *aux)
 
   ASSERT (intr_get_level () == INTR_OFF);
 
+  spinlock_acquire (&all_lock);
   for (e = list_begin (&all_list); e != list_end (&all_list);
        e = list_next (e))
     {
       struct thread *t = list_entry (e, struct thread, allelem);
       func (t, aux);
     }
+  spinlock_release (&all_lock);
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's priority to NEW_PRIORITY, and
+   yields if a thread of higher priority is then ready.  Does
+   nothing with the 4.4BSD scheduler, which sets priorities
+   itself. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  enum intr_level old_level;
+  bool yield;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  thread_current ()->base_priority = new_priority;
+  thread_update_priority (thread_current ());
+  yield = rq_preempted (this_rq ());
+  intr_set_level (old_level);
+
+  if (yield)
+    thread_yield ();
+}
+
+/* Sets thread T's priority to T's base priority or the highest
+   priority donated to it through a lock it holds, whichever is
+   higher.  Interrupts must be off. */
+void
+thread_update_priority (struct thread *t)
+{
+  int priority = t->base_priority;
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&t->locks_held); e != list_end (&t->locks_held);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      if (lock->priority > priority)
+        priority = lock->priority;
+    }
+
+  set_priority (t, priority);
+}
+
+/* Raises thread T's priority to PRIORITY, if it is lower, on
+   behalf of a thread waiting for a lock that T holds.
+   Interrupts must be off. */
+void
+thread_donate_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->priority >= priority)
+    return;
+
+  set_priority (t, priority);
 }
 
 /* Returns the current thread's priority. */
@@ -402,35 +795,209 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE.  With the
+   4.4BSD scheduler, also recomputes its priority, and yields if
+   a thread of higher priority is then ready. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool yield = false;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    {
+      cur->priority = mlfqs_priority (cur);
+      yield = rq_preempted (this_rq ());
+    }
+  intr_set_level (old_level);
+
+  if (yield)
+    thread_yield ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load = fp_round (load_avg * 100);
+  intr_set_level (old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu = fp_round (thread_current ()->recent_cpu * 100);
+  intr_set_level (old_level);
+  return recent_cpu;
+}
+
+/* The 4.4BSD scheduler.
+
+   Each thread's priority follows from its niceness and its
+   recent_cpu, an exponentially decaying count of the ticks it
+   has run.  At every tick, the running thread's recent_cpu goes
+   up by one; every four ticks, its priority is recomputed, since
+   nobody else's recent_cpu has changed in between.  Once a
+   second, the load average is updated and every recent_cpu
+   decays.
+
+   The once-a-second decay is incremental, after 4.4BSD's
+   schedcpu() and updatepri(): only the running thread and the
+   threads in the run queue are decayed and requeued at their new
+   priorities then.  A blocked thread's recent_cpu cannot change
+   while it sleeps, so it is brought up to date in one step, for
+   all the seconds it missed, when it is unblocked.
+
+   With more than one CPU, each CPU charges its own running
+   thread at its own ticks, and the boot CPU does the
+   once-a-second work for all of them. */
+
+/* Does the 4.4BSD scheduler's work for timer tick TICK, with T
+   running.  Interrupts must be off. */
+static void
+mlfqs_tick (struct thread *t, int64_t tick)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t != this_rq ()->idle_thread)
+    t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+
+  if (tick % TIMER_FREQ == 0 && cpu_current () == &cpus[0])
+    {
+      int ready_threads = 0;
+      int cpu;
+
+      for (cpu = 0; cpu < cpu_cnt; cpu++)
+        {
+          struct runqueue *rq = &runqueues[cpu];
+          spinlock_acquire (&rq->lock);
+          ready_threads += rq->cnt;
+          if (rq->curr != NULL && rq->curr != rq->idle_thread)
+            ready_threads++;
+          spinlock_release (&rq->lock);
+        }
+      load_avg = (fp_mul (fp_div (fp_from_int (59), fp_from_int (60)),
+                          load_avg)
+                  + fp_from_int (ready_threads) / 60);
+      mlfqs_seconds++;
+
+      for (cpu = 0; cpu < cpu_cnt; cpu++)
+        {
+          struct runqueue *rq = &runqueues[cpu];
+          struct list ready;
+
+          /* Take every thread off the run queue, decay it, and
+             put it back at its new priority. */
+          spinlock_acquire (&rq->lock);
+          list_init (&ready);
+          while (rq->mask != 0)
+            {
+              int pri = ready_max_priority (rq);
+              list_splice (list_end (&ready), list_begin (&rq->lists[pri]),
+                           list_end (&rq->lists[pri]));
+              rq->mask &= ~((uint64_t) 1 << pri);
+            }
+          rq->cnt = 0;
+          rq->load = 0;
+          while (!list_empty (&ready))
+            {
+              struct thread *r = list_entry (list_pop_front (&ready),
+                                             struct thread, elem);
+              mlfqs_decay (r);
+              r->priority = mlfqs_priority (r);
+              ready_push (r);
+            }
+
+          if (rq->curr != NULL && rq->curr != rq->idle_thread)
+            {
+              mlfqs_decay (rq->curr);
+              rq->curr->priority = mlfqs_priority (rq->curr);
+            }
+          spinlock_release (&rq->lock);
+        }
+    }
+  else if (tick % 4 == 0 && t != this_rq ()->idle_thread)
+    t->priority = mlfqs_priority (t);
+}
+
+/* Returns X raised to the power N, for N >= 0. */
+static fixed_t
+fp_pow (fixed_t x, int64_t n)
+{
+  fixed_t result = FP_ONE;
+
+  for (; n > 0; n >>= 1)
+    {
+      if (n & 1)
+        result = fp_mul (result, x);
+      x = fp_mul (x, x);
+    }
+  return result;
+}
+
+/* Brings T's recent_cpu up to date with the seconds that have
+   gone by since it was last decayed, at the current load.
+   Interrupts must be off. */
+static void
+mlfqs_decay (struct thread *t)
+{
+  int64_t n = mlfqs_seconds - t->cpu_second;
+  fixed_t twice_load = 2 * load_avg;
+  fixed_t coeff, coeff_n;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (n <= 0)
+    return;
+  t->cpu_second = mlfqs_seconds;
+
+  /* One second multiplies recent_cpu by COEFF and adds nice. */
+  coeff = fp_div (twice_load, twice_load + FP_ONE);
+  if (n == 1)
+    {
+      t->recent_cpu = fp_mul (coeff, t->recent_cpu) + fp_from_int (t->nice);
+      return;
+    }
+
+  /* N seconds multiply it by COEFF**N and add
+     nice * (1 - COEFF**N) / (1 - COEFF), where
+     1 / (1 - COEFF) = 2 * load_avg + 1. */
+  coeff_n = fp_pow (coeff, n);
+  t->recent_cpu = (fp_mul (coeff_n, t->recent_cpu)
+                   + fp_mul (fp_from_int (t->nice),
+                             fp_mul (FP_ONE - coeff_n,
+                                     twice_load + FP_ONE)));
+}
+
+/* Returns the priority that T's niceness and recent_cpu give
+   it. */
+static int
+mlfqs_priority (const struct thread *t)
+{
+  int priority = PRI_MAX - fp_trunc (t->recent_cpu / 4) - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  else if (priority > PRI_MAX)
+    return PRI_MAX;
+  else
+    return priority;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -441,20 +1008,35 @@ thread_get_recent_cpu (void)
    to it to enable thread_start() to continue, and immediately
    blocks.  After that, the idle thread never appears in the
    ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   special case when the ready list is empty.
+
+   Each of the other CPUs has an idle thread of its own, set up
+   by thread_prepare_cpu(), which the CPU starts out running. */
 static void
 idle (void *idle_started_ UNUSED) 
 {
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
+  this_rq ()->idle_thread = thread_current ();
   sema_up (idle_started);
 
+  idle_loop ();
+}
+
+/* The idle threads' main loop. */
+static void
+idle_loop (void)
+{
   for (;;) 
     {
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
 
+      /* Let the other CPUs have the kernel while we wait.  The
+         interrupt that wakes us up takes the kernel lock for
+         itself. */
+      kernel_lock_release ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -468,9 +1050,50 @@ idle (void *idle_started_ UNUSED)
          See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
          7.11.1 "HLT Instruction". */
       asm volatile ("sti; hlt" : : : "memory");
+
+      kernel_lock_acquire ();
     }
 }
 
+/* Sets up the idle thread of CPU C, which is about to be started,
+   and returns it.  C starts out running on the idle thread's
+   stack, the way the boot CPU starts out running on the initial
+   thread's, and calls thread_start_ap(). */
+struct thread *
+thread_prepare_cpu (struct cpu *c)
+{
+  struct runqueue *rq = cpu_rq (c);
+  struct thread *t;
+  char name[16];
+
+  ASSERT (c != &cpus[0]);
+
+  t = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  snprintf (name, sizeof name, "idle%d", c->id);
+  init_thread (t, name, PRI_MIN);
+  t->tid = allocate_tid ();
+  t->cpu = c;
+  t->status = THREAD_RUNNING;
+  t->on_cpu = true;
+  rq->idle_thread = rq->curr = t;
+  return t;
+}
+
+/* Starts scheduling threads on the CPU we are running on, an
+   application processor that has just come up and taken the
+   kernel lock, by running its idle thread's loop. */
+void
+thread_start_ap (void)
+{
+  struct runqueue *rq = this_rq ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (running_thread () == rq->idle_thread);
+
+  cpu_current ()->online = true;
+  idle_loop ();
+}
+
 /* Function used as the basis for a kernel thread. */
 static void
 kernel_thread (thread_func *function, void *aux) 
@@ -496,6 +1119,15 @@ running_thread (void)
   return pg_round_down (esp);
 }
 
+/* Returns the CPU we are running on: the one the running thread
+   is on.  Before there is more than one, that is always the boot
+   CPU, even before the running thread is set up. */
+struct cpu *
+cpu_current (void)
+{
+  return smp_active ? running_thread ()->cpu : &cpus[0];
+}
+
 /* Returns true if T appears to point to a valid thread. */
 static bool
 is_thread (struct thread *t)
@@ -518,11 +1150,31 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  list_init (&t->locks_held);
   t->magic = THREAD_MAGIC;
 
+  /* A new thread starts out where its creator is. */
+  if (t != running_thread ())
+    t->cpu = running_thread ()->cpu;
+
+  if (thread_mlfqs)
+    {
+      /* A new thread inherits its creator's niceness and recent
+         CPU time.  The initial thread starts at zero. */
+      if (t != running_thread ())
+        {
+          t->nice = running_thread ()->nice;
+          t->recent_cpu = running_thread ()->recent_cpu;
+        }
+      t->cpu_second = mlfqs_seconds;
+      t->priority = mlfqs_priority (t);
+    }
+
   old_level = intr_disable ();
+  spinlock_acquire (&all_lock);
   list_push_back (&all_list, &t->allelem);
+  spinlock_release (&all_lock);
   intr_set_level (old_level);
 }
 
@@ -539,18 +1191,383 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Returns this CPU's run queue. */
+static struct runqueue *
+this_rq (void)
+{
+  return &runqueues[cpu_current ()->id];
+}
+
+/* Returns CPU C's run queue. */
+static struct runqueue *
+cpu_rq (struct cpu *c)
+{
+  return &runqueues[c->id];
+}
+
+/* Locks the run queue of thread T's CPU and returns it.  Unless
+   T is running, it may be moved to another CPU until its run
+   queue is locked, so this checks that it was not.  Interrupts
+   must be off. */
+static struct runqueue *
+lock_thread_rq (struct thread *t)
+{
+  for (;;)
+    {
+      struct runqueue *rq = cpu_rq (t->cpu);
+
+      spinlock_acquire (&rq->lock);
+      if (rq == cpu_rq (t->cpu))
+        return rq;
+      spinlock_release (&rq->lock);
+    }
+}
+
+/* Returns true if RQ's CPU is idle: running its idle thread with
+   no thread ready.  Reads RQ without its lock, so the answer is
+   only a hint. */
+static bool
+rq_idle (struct runqueue *rq)
+{
+  return rq->curr == rq->idle_thread && rq->cnt == 0;
+}
+
+/* Returns the CPU on whose run queue T, which is about to become
+   ready, should go.  That is the CPU T last ran on, or was
+   created on, unless that one is busy and another CPU is idle.
+   Interrupts must be off. */
+static struct cpu *
+select_cpu (struct thread *t)
+{
+  int cpu;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!smp_active || rq_idle (cpu_rq (t->cpu)))
+    return t->cpu;
+
+  for (cpu = 0; cpu < cpu_cnt; cpu++)
+    if (cpus[cpu].online && rq_idle (&runqueues[cpu]))
+      return &cpus[cpu];
+  return t->cpu;
+}
+
+/* Sets thread T's priority to PRIORITY, moving T to the list for
+   PRIORITY if it is ready.  The priority is set before T's run
+   queue is locked, so if T is being made ready on another CPU
+   meanwhile, either that CPU queues T at the new priority or T
+   is found ready here and moved.  Interrupts must be off. */
+static void
+set_priority (struct thread *t, int priority)
+{
+  struct runqueue *rq;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  t->priority = priority;
+  rq = lock_thread_rq (t);
+  if (t->status == THREAD_READY && t->rq_priority != priority)
+    {
+      ready_remove (t);
+      ready_push (t);
+    }
+  spinlock_release (&rq->lock);
+}
+
+/* Adds T to the back of the run queue for its priority, on its
+   CPU's run queue, whose lock must be held. */
+static void
+ready_push (struct thread *t)
+{
+  struct runqueue *rq = cpu_rq (t->cpu);
+
+  ASSERT (spinlock_held_by_current_cpu (&rq->lock));
+
+  t->rq_priority = t->priority;
+  list_push_back (&rq->lists[t->rq_priority], &t->elem);
+  rq->mask |= (uint64_t) 1 << t->rq_priority;
+  rq->cnt++;
+  rq->load += priority_weight (t->rq_priority);
+}
+
+/* Takes T, which must be ready, off its run queue, whose lock
+   must be held. */
+static void
+ready_remove (struct thread *t)
+{
+  struct runqueue *rq = cpu_rq (t->cpu);
+
+  ASSERT (spinlock_held_by_current_cpu (&rq->lock));
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  if (list_empty (&rq->lists[t->rq_priority]))
+    rq->mask &= ~((uint64_t) 1 << t->rq_priority);
+  rq->cnt--;
+  rq->load -= priority_weight (t->rq_priority);
+}
+
+/* Returns the highest priority of any thread ready on RQ, or
+   PRI_MIN - 1 if no thread is ready there.  RQ's lock must be
+   held. */
+static int
+ready_max_priority (struct runqueue *rq)
+{
+  uint32_t high = rq->mask >> 32;
+  uint32_t low = rq->mask;
+
+  ASSERT (spinlock_held_by_current_cpu (&rq->lock));
+
+  if (high != 0)
+    return 63 - __builtin_clz (high);
+  else if (low != 0)
+    return 31 - __builtin_clz (low);
+  else
+    return PRI_MIN - 1;
+}
+
+/* Returns the priority of the thread running on RQ's CPU, or
+   PRI_MIN - 1 if it is idle, so that any ready thread outranks
+   the idle thread.  RQ's lock must be held. */
+static int
+running_priority (struct runqueue *rq)
+{
+  return rq->curr == rq->idle_thread ? PRI_MIN - 1 : rq->curr->priority;
+}
+
+/* Returns true if a thread ready on RQ outranks the thread
+   running on RQ's CPU.  Interrupts must be off. */
+static bool
+rq_preempted (struct runqueue *rq)
+{
+  bool preempted;
+
+  spinlock_acquire (&rq->lock);
+  preempted = ready_max_priority (rq) > running_priority (rq);
+  spinlock_release (&rq->lock);
+  return preempted;
+}
+
+/* Load balancing.
+
+   Every CPU's run queue carries a load: the sum of the weights
+   of its ready threads, plus that of its running thread.  A
+   thread weighs more the higher its priority, so that the
+   balancer spreads out important threads before unimportant
+   ones.
+
+   A CPU that runs out of threads steals half of the ready
+   threads of the busiest other CPU, both when it would
+   otherwise switch to its idle thread and at each timer tick
+   while it is idle.  In addition, every BALANCE_INTERVAL ticks,
+   each busy CPU pulls over from the busiest other CPU threads
+   worth up to half the difference in their loads.
+
+   Either way, threads are chosen with their caches in mind:
+   first those that last ran on the pulling CPU, then those that
+   last ran on neither CPU, and last those that last ran on the
+   CPU they are taken from.
+
+   -no=balance turns the balancer off.
+
+   The balancer picks the busiest CPU from loads read without
+   locks, which may be stale by the time it pulls; it only locks
+   the two run queues while it moves threads between them.  A
+   thread that is still switching off its CPU stays there. */
+
+/* Returns the load weight of a thread at PRIORITY. */
+static int
+priority_weight (int priority)
+{
+  return priority - PRI_MIN + 1;
+}
+
+/* Returns the load on RQ.  Interrupts must be off. */
+static int
+rq_load (struct runqueue *rq)
+{
+  int load;
+
+  spinlock_acquire (&rq->lock);
+  load = rq->load;
+  if (running_priority (rq) >= PRI_MIN)
+    load += priority_weight (rq->curr->priority);
+  spinlock_release (&rq->lock);
+  return load;
+}
+
+/* Returns the run queue of the online CPU, other than the one we
+   are running on, with the greatest load among those with any
+   ready thread, or a null pointer if there is none. */
+static struct runqueue *
+busiest_rq (void)
+{
+  struct runqueue *self = this_rq ();
+  struct runqueue *busiest = NULL;
+  int busiest_load = 0;
+  int cpu;
+
+  for (cpu = 0; cpu < cpu_cnt; cpu++)
+    {
+      struct runqueue *rq = &runqueues[cpu];
+      if (rq != self && cpus[cpu].online && rq->cnt > 0)
+        {
+          int load = rq_load (rq);
+          if (busiest == NULL || load > busiest_load)
+            {
+              busiest = rq;
+              busiest_load = load;
+            }
+        }
+    }
+  return busiest;
+}
+
+/* Moves up to MAX_CNT ready threads, of total weight no more
+   than MAX_LOAD, from SRC to the run queue of the CPU we are
+   running on, in the order described above.  Within each group,
+   takes higher-priority threads first, and takes each priority's
+   threads from the back of its list, where they would wait
+   longest.  Returns the number of threads moved.  Both run
+   queues' locks must be held. */
+static int
+move_threads (struct runqueue *src, int max_cnt, int max_load)
+{
+  struct cpu *src_cpu = &cpus[src - runqueues];
+  struct cpu *dst_cpu = cpu_current ();
+  int moved = 0;
+  int group;
+
+  ASSERT (src_cpu != dst_cpu);
+
+  for (group = 0; group < 3; group++)
+    {
+      int pri;
+
+      for (pri = PRI_MAX; pri >= PRI_MIN; pri--)
+        {
+          struct list *list = &src->lists[pri];
+          struct list_elem *e;
+
+          if (!(src->mask & ((uint64_t) 1 << pri))
+              || priority_weight (pri) > max_load)
+            continue;
+
+          for (e = list_rbegin (list); e != list_rend (list); )
+            {
+              struct thread *t = list_entry (e, struct thread, elem);
+              int t_group = (t->last_cpu == dst_cpu ? 0
+                             : t->last_cpu != src_cpu ? 1 : 2);
+
+              e = list_prev (e);
+              if (t_group != group || t->on_cpu)
+                continue;
+              if (moved >= max_cnt)
+                return moved;
+              if (priority_weight (pri) > max_load)
+                break;
+
+              ready_remove (t);
+              t->cpu = dst_cpu;
+              ready_push (t);
+              max_load -= priority_weight (pri);
+              moved++;
+            }
+        }
+    }
+  return moved;
+}
+
+/* Locks SRC and the run queue of the CPU we are running on, in
+   order, and moves threads between them with move_threads().
+   Returns the number of threads moved. */
+static int
+pull_threads (struct runqueue *src, int max_cnt, int max_load)
+{
+  struct runqueue *dst = this_rq ();
+  struct runqueue *first = src < dst ? src : dst;
+  struct runqueue *second = src < dst ? dst : src;
+  int moved;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  spinlock_acquire (&first->lock);
+  spinlock_acquire (&second->lock);
+  moved = move_threads (src, max_cnt, max_load);
+  spinlock_release (&second->lock);
+  spinlock_release (&first->lock);
+  return moved;
+}
+
+/* Steals half of the ready threads, rounding up, of the busiest
+   other CPU for the CPU we are running on, which has run out of
+   threads.  Returns true if any thread was stolen. */
+static bool
+steal_threads (void)
+{
+  struct runqueue *src;
+
+  if (!smp_active || !feature_enabled (FEATURE_BALANCE))
+    return false;
+
+  src = busiest_rq ();
+  return (src != NULL
+          && pull_threads (src, (src->cnt + 1) / 2, src->load) > 0);
+}
+
+/* Evens out the load between the CPU we are running on and the
+   busiest other CPU. */
+static void
+balance (void)
+{
+  struct runqueue *src = busiest_rq ();
+
+  if (src != NULL)
+    {
+      int imbalance = rq_load (src) - rq_load (this_rq ());
+      if (imbalance > 0)
+        pull_threads (src, src->cnt, imbalance / 2);
+    }
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   the CPU's idle thread.  The thread returned is the one that has
+   waited longest among those of the highest priority.
+
+   The thread returned is marked running right away, under the
+   run queue's lock, so that nothing takes it for a ready thread
+   once it is off the run queue. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
+  struct runqueue *rq = this_rq ();
+  struct thread *t;
+  int pri;
+
+  /* Stealing locks our run queue itself, so look at whether it
+     is empty without the lock. */
+  if (rq->cnt == 0)
+    steal_threads ();
+
+  spinlock_acquire (&rq->lock);
+  pri = ready_max_priority (rq);
+  if (pri < PRI_MIN)
+    t = rq->idle_thread;
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    {
+      t = list_entry (list_pop_front (&rq->lists[pri]), struct thread,
+                      elem);
+      if (list_empty (&rq->lists[pri]))
+        rq->mask &= ~((uint64_t) 1 << pri);
+      rq->cnt--;
+      rq->load -= priority_weight (pri);
+      t->status = THREAD_RUNNING;
+    }
+  spinlock_release (&rq->lock);
+  return t;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -567,36 +1584,142 @@ next_thread_to_run (void)
    complete.  In practice that means that printf()s should be
    added at the end of the function.
 
+   Last, this CPU takes or lets go of the kernel lock, according
+   to whether the new thread held it when it was switched out.
+
    After this function and its caller returns, the thread switch
    is complete. */
 void
 thread_schedule_tail (struct thread *prev)
 {
   struct thread *cur = running_thread ();
+  struct runqueue *rq = this_rq ();
+  bool prev_dying;
   
   ASSERT (intr_get_level () == INTR_OFF);
 
   /* Mark us as running. */
   cur->status = THREAD_RUNNING;
+  cur->last_cpu = cur->cpu;
+  spinlock_acquire (&rq->lock);
+  rq->curr = cur;
+  spinlock_release (&rq->lock);
 
   /* Start new time slice. */
-  thread_ticks = 0;
+  rq->thread_ticks = 0;
+  rq->preempt_pending = false;
 
 #ifdef USERPROG
   /* Activate the new address space. */
   process_activate ();
 #endif
 
-  /* If the thread we switched from is dying, destroy its struct
-     thread.  This must happen late so that thread_exit() doesn't
-     pull out the rug under itself.  (We don't free
+  /* The thread we switched from is off this CPU now, and another
+     CPU may run it as soon as we say so.  From then on, it may
+     even die and be reused, so check whether it is dying first.
+
+     If it is, queue its struct thread for destruction.  This
+     must happen late so that thread_exit() doesn't pull out the
+     rug under itself.  We don't free the page here, to keep the
+     switch short, so thread_reap() does it later.  (We don't free
      initial_thread because its memory was not obtained via
      palloc().) */
-  if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
+  if (prev != NULL)
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      prev_dying = prev->status == THREAD_DYING;
+      barrier ();
+      prev->on_cpu = false;
+      if (prev_dying && prev != initial_thread)
+        {
+          spinlock_acquire (&dying_lock);
+          list_push_back (&dying_list, &prev->elem);
+          dying_cnt++;
+          spinlock_release (&dying_lock);
+        }
     }
+
+  if (cur->kernel_locked && !kernel_lock_held ())
+    kernel_lock_acquire ();
+  else if (!cur->kernel_locked && kernel_lock_held ())
+    kernel_lock_release ();
+}
+
+/* Takes the page of the thread that died most recently off
+   dying_list and returns it, or returns a null pointer if there
+   is none or reusing them is turned off. */
+static struct thread *
+recycle_thread (void)
+{
+  struct thread *t = NULL;
+  enum intr_level old_level;
+
+  if (!feature_enabled (FEATURE_THREAD_CACHE))
+    return NULL;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&dying_lock);
+  if (!list_empty (&dying_list))
+    {
+      t = list_entry (list_pop_back (&dying_list), struct thread, elem);
+      dying_cnt--;
+      ASSERT (is_thread (t));
+    }
+  spinlock_release (&dying_lock);
+  intr_set_level (old_level);
+
+  return t;
+}
+
+/* Frees the pages of the threads on dying_list, except for the
+   THREAD_CACHE_MAX that died most recently if they are reused.
+   Must be called with interrupts on, from a thread that
+   may sleep. */
+static void
+thread_reap (void)
+{
+  free_dying (feature_enabled (FEATURE_THREAD_CACHE)
+              ? THREAD_CACHE_MAX : 0);
+}
+
+/* Frees the pages of all the threads on dying_list, including
+   the ones kept for thread_create() to reuse, and returns how
+   many it freed.  Called by the page allocator when it is out of
+   pages.  Must be called with interrupts on, from a thread that
+   may sleep. */
+size_t
+thread_reap_cached (void)
+{
+  return free_dying (0);
+}
+
+/* Frees the pages of the threads on dying_list, oldest first,
+   until at most KEEP are left.  Returns the number freed. */
+static size_t
+free_dying (size_t keep)
+{
+  enum intr_level old_level;
+  size_t cnt = 0;
+
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  spinlock_acquire (&dying_lock);
+  while (dying_cnt > keep)
+    {
+      struct thread *t = list_entry (list_pop_front (&dying_list),
+                                     struct thread, elem);
+      dying_cnt--;
+      spinlock_release (&dying_lock);
+      intr_set_level (old_level);
+      palloc_free_page (t);
+      cnt++;
+      intr_disable ();
+      spinlock_acquire (&dying_lock);
+    }
+  spinlock_release (&dying_lock);
+  intr_set_level (old_level);
+  return cnt;
 }
 
 /* Schedules a new process.  At entry, interrupts must be off and
@@ -604,21 +1727,35 @@ thread_schedule_tail (struct thread *prev)
    running to some other state.  This function finds another
    thread to run and switches to it.
 
+   Whether the running thread holds the kernel lock is saved
+   along with the rest of its state, and restored when it is
+   switched back in, so the kernel lock belongs to a thread, not
+   to a CPU.
+
    It's not safe to call printf() until thread_schedule_tail()
    has completed. */
 static void
 schedule (void) 
 {
   struct thread *cur = running_thread ();
-  struct thread *next = next_thread_to_run ();
+  struct thread *next;
   struct thread *prev = NULL;
 
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (cur->status != THREAD_RUNNING);
+
+  cur->kernel_locked = kernel_lock_held ();
+  next = next_thread_to_run ();
   ASSERT (is_thread (next));
+  ASSERT (next == cur || !next->on_cpu);
 
+  /* NEXT runs here now. */
+  next->cpu = cur->cpu;
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      next->on_cpu = true;
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
@@ -627,11 +1764,14 @@ static tid_t
 allocate_tid (void) 
 {
   static tid_t next_tid = 1;
+  enum intr_level old_level;
   tid_t tid;
 
-  lock_acquire (&tid_lock);
+  old_level = intr_disable ();
+  spinlock_acquire (&tid_lock);
   tid = next_tid++;
-  lock_release (&tid_lock);
+  spinlock_release (&tid_lock);
+  intr_set_level (old_level);
 
   return tid;
 }
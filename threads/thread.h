@@ -2,8 +2,16 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <heap.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/fixed-point.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+
+struct cpu;
+struct lock;
+struct spinlock;
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -21,8 +29,13 @@ typedef int tid_t;
 
 /* Thread priorities. */
 #define PRI_MIN 0                       /* Lowest priority. */
-#define PRI_DEFAULT 2                   /* Default priority. */
-#define PRI_MAX 4                       /* Highest priority. */
+#define PRI_DEFAULT 31                  /* Default priority. */
+#define PRI_MAX 63                      /* Highest priority. */
+
+/* Thread niceness, for the 4.4BSD scheduler. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
 
 /* A kernel thread or user process.
 
@@ -89,6 +102,22 @@ struct thread
     uint8_t *stack;                     /* Saved stack pointer. */
     int priority;                       /* Priority. */
     struct list_elem allelem;           /* List element for all threads list. */
+    struct cpu *cpu;                    /* CPU running it, whose run queue
+                                           it is on, or it last ran on. */
+    struct cpu *last_cpu;               /* CPU it last ran on, if any. */
+    int rq_priority;                    /* Priority it is queued at. */
+    bool on_cpu;                        /* Still running on `cpu'. */
+    bool kernel_locked;                 /* Holds the kernel lock. */
+
+    /* Priority donation.  Shared between thread.c and synch.c. */
+    int base_priority;                  /* Priority without donations. */
+    struct list locks_held;             /* Locks held, with donations. */
+    struct lock *waiting_lock;          /* Lock being waited for, or null. */
+
+    /* For the 4.4BSD scheduler (thread_mlfqs). */
+    int nice;                           /* Niceness. */
+    fixed_t recent_cpu;                 /* Recent CPU time, in ticks. */
+    int64_t cpu_second;                 /* Second recent_cpu is as of. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
@@ -99,27 +128,47 @@ struct thread
 #endif
 
     /* For timer_sleep() */
-    int64_t wakeup_tick;
+    int64_t wakeup_tick;                /* Tick to wake up at. */
+    uint64_t wakeup_tsc;                /* Or TSC value to wake up at. */
+    struct heap_elem sleep_elem;        /* Element in a sleep queue. */
+
+    /* Owned by palloc.c. */
+    struct page_cache page_caches[2];   /* Kernel and user page caches. */
+
+    /* Owned by malloc.c. */
+    struct malloc_cache malloc_cache;   /* Free small malloc() blocks. */
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
 
+/* If false (default), use round-robin scheduler.
+   If true, use multi-level feedback queue scheduler.
+   Controlled by kernel command-line option "-mlfqs". */
+extern bool thread_mlfqs;
+
 void thread_init (void);
 void thread_start (void);
+struct thread *thread_prepare_cpu (struct cpu *);
+void thread_start_ap (void) NO_RETURN;
 
-void thread_tick (void);
+void thread_tick (int64_t tick);
+bool thread_tick_needed (void);
+void thread_check_preempt (void);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
 void thread_block (void);
+void thread_block_unlock (struct spinlock *);
 void thread_unblock (struct thread *);
 
 int64_t get_next_tick_to_wakeup (void);
 void thread_sleep (int64_t);
 void thread_wakeup (int64_t);
+void thread_sleep_tsc (uint64_t);
+uint64_t thread_wakeup_tsc (uint64_t);
 
 struct thread *thread_current (void);
 tid_t thread_tid (void);
@@ -127,6 +176,8 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
+size_t thread_reap_cached (void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -134,6 +185,8 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_donate_priority (struct thread *, int priority);
+void thread_update_priority (struct thread *);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
@@ -0,0 +1,445 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Workqueues.
+
+   A workqueue is a fixed pool of worker threads that run work
+   items, in the order they were queued, without the cost of
+   creating a thread for each one.  Queueing an item takes
+   constant time and never sleeps, so interrupt handlers may do
+   it too.
+
+   Workers take items off the queue WORK_BATCH at a time, and an
+   idle worker is woken only when the queue holds more than a
+   batch for each busy worker, so that a burst of small items is
+   run by as few workers, with as few context switches, as
+   possible.
+
+   Delayed items wait in a heap ordered by the timer tick they
+   are due at, and the timer interrupt moves them to their queue
+   when that tick comes, the same way it wakes sleeping threads.
+
+   Each item is numbered in the order it reaches its queue, so
+   that "everything queued before now has finished" comes down to
+   comparing numbers: the oldest item that has not finished is
+   either at the head of the queue or the one that some worker is
+   running or about to run.
+
+   All of this state is protected by turning off interrupts. */
+
+/* Most items a worker takes off the queue at once. */
+#define WORK_BATCH 8
+
+/* A worker thread, on its own stack. */
+struct worker
+  {
+    struct list_elem elem;      /* In workqueue's workers list. */
+    uint64_t seq;               /* Oldest item taken, or UINT64_MAX. */
+  };
+
+/* A thread waiting in wait_for_seq(). */
+struct flusher
+  {
+    struct list_elem elem;      /* In workqueue's flushers list. */
+    uint64_t seq;               /* Waiting for items up to this one. */
+    struct semaphore done;      /* Upped when they have finished. */
+  };
+
+/* Delayed items of all workqueues, by due_tick. */
+static struct heap delayed;
+static int64_t next_due_tick = INT64_MAX;
+
+static thread_func worker_thread;
+static heap_less_func due_less;
+static void enqueue (struct workqueue *, struct work *);
+static uint64_t oldest_unfinished (struct workqueue *);
+static void wake_flushers (struct workqueue *);
+static void wait_for_seq (struct workqueue *, uint64_t seq);
+
+/* Initializes WQ, named NAME, with no workers yet.  Work may be
+   queued on it at once, but none runs until workqueue_start(). */
+void
+workqueue_init (struct workqueue *wq, const char *name)
+{
+  ASSERT (wq != NULL);
+  ASSERT (name != NULL);
+
+  if (delayed.less == NULL)
+    heap_init (&delayed, due_less, NULL);
+
+  wq->name = name;
+  list_init (&wq->queue);
+  wq->queued_cnt = 0;
+  wq->next_seq = 1;
+  wq->worker_cnt = 0;
+  wq->idle_cnt = 0;
+  sema_init (&wq->wakeup, 0);
+  list_init (&wq->workers);
+  list_init (&wq->flushers);
+  wq->run_cnt = 0;
+  wq->batch_cnt = 0;
+}
+
+/* Starts WORKER_CNT worker threads for WQ, at the given
+   PRIORITY.  Must be called after thread_start(). */
+void
+workqueue_start (struct workqueue *wq, int worker_cnt, int priority)
+{
+  int i;
+
+  ASSERT (worker_cnt > 0);
+
+  for (i = 0; i < worker_cnt; i++)
+    {
+      wq->worker_cnt++;
+      thread_create (wq->name, priority, worker_thread, wq);
+    }
+}
+
+/* Waits until every item queued on WQ before the call has
+   finished running.  Delayed items count as queued only once
+   they are due. */
+void
+workqueue_flush (struct workqueue *wq)
+{
+  enum intr_level old_level = intr_disable ();
+  wait_for_seq (wq, wq->next_seq - 1);
+  intr_set_level (old_level);
+}
+
+/* Prints statistics about WQ. */
+void
+workqueue_print_stats (const struct workqueue *wq)
+{
+  printf ("Workqueue %s: %d workers, %lld items in %lld batches\n",
+          wq->name, wq->worker_cnt, wq->run_cnt, wq->batch_cnt);
+}
+
+/* Initializes W to run FUNC. */
+void
+work_init (struct work *w, work_func *func)
+{
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+
+  w->func = func;
+  w->state = WORK_IDLE;
+  w->wq = NULL;
+  w->seq = 0;
+}
+
+/* Queues W on WQ, unless it is already pending.  Returns true
+   if W was queued, false if it was pending already.  May be
+   called from an interrupt handler. */
+bool
+work_queue (struct workqueue *wq, struct work *w)
+{
+  enum intr_level old_level;
+  bool queued = false;
+
+  ASSERT (wq != NULL);
+  ASSERT (w != NULL);
+
+  old_level = intr_disable ();
+  if (!work_pending (w))
+    {
+      w->wq = wq;
+      enqueue (wq, w);
+      queued = true;
+    }
+  intr_set_level (old_level);
+
+  return queued;
+}
+
+/* Queues W on WQ once TICKS timer ticks have passed, unless it
+   is already pending.  Returns true if W was queued, false if it
+   was pending already.  May be called from an interrupt
+   handler. */
+bool
+work_queue_delayed (struct workqueue *wq, struct work *w, int64_t ticks)
+{
+  enum intr_level old_level;
+  bool queued = false;
+
+  ASSERT (wq != NULL);
+  ASSERT (w != NULL);
+
+  if (ticks <= 0)
+    return work_queue (wq, w);
+
+  old_level = intr_disable ();
+  if (!work_pending (w))
+    {
+      w->wq = wq;
+      w->state = WORK_DELAYED;
+      w->due_tick = timer_ticks () + ticks;
+      heap_insert (&delayed, &w->timer_elem);
+      if (w->due_tick < next_due_tick)
+        {
+          next_due_tick = w->due_tick;
+          timer_wake_by (next_due_tick);
+        }
+      queued = true;
+    }
+  intr_set_level (old_level);
+
+  return queued;
+}
+
+/* Returns true if W is delayed, queued, or about to run. */
+bool
+work_pending (const struct work *w)
+{
+  return (w->state == WORK_DELAYED || w->state == WORK_QUEUED
+          || w->state == WORK_BATCHED);
+}
+
+/* Takes W off its queue or timer if it has not started running.
+   Returns true if it was taken off, false if it was not
+   pending or a worker had already taken it.  Does not wait for a
+   running W to finish.  May be called from an interrupt
+   handler. */
+bool
+work_cancel (struct work *w)
+{
+  enum intr_level old_level;
+  bool canceled = true;
+
+  ASSERT (w != NULL);
+
+  old_level = intr_disable ();
+  if (w->state == WORK_DELAYED)
+    {
+      heap_remove (&delayed, &w->timer_elem);
+      next_due_tick = (heap_empty (&delayed) ? INT64_MAX
+                       : heap_entry (heap_min (&delayed), struct work,
+                                     timer_elem)->due_tick);
+    }
+  else if (w->state == WORK_QUEUED)
+    {
+      list_remove (&w->elem);
+      w->wq->queued_cnt--;
+      wake_flushers (w->wq);
+    }
+  else
+    canceled = false;
+  if (canceled)
+    w->state = WORK_IDLE;
+  intr_set_level (old_level);
+
+  return canceled;
+}
+
+/* Like work_cancel(), but if a worker had already taken W, waits
+   for it to finish running.  W's function must not free W in
+   that case.  If W is queued again meanwhile, that later run is
+   not waited for. */
+bool
+work_cancel_sync (struct work *w)
+{
+  enum intr_level old_level;
+  bool canceled;
+
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  canceled = work_cancel (w);
+  if (w->state == WORK_BATCHED || w->state == WORK_RUNNING)
+    {
+      struct workqueue *wq = w->wq;
+      uint64_t seq = w->seq;
+      wait_for_seq (wq, seq);
+    }
+  intr_set_level (old_level);
+
+  return canceled;
+}
+
+/* Returns the timer tick at which the next delayed item is due,
+   or INT64_MAX if there is none. */
+int64_t
+workqueue_next_tick (void)
+{
+  return next_due_tick;
+}
+
+/* Queues the delayed items that are due by timer tick TICK.
+   Called by the timer interrupt handler. */
+void
+workqueue_timer (int64_t tick)
+{
+  struct heap_elem *min;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while ((min = heap_min (&delayed)) != NULL
+         && heap_entry (min, struct work, timer_elem)->due_tick <= tick)
+    {
+      struct work *w = heap_entry (heap_pop_min (&delayed),
+                                   struct work, timer_elem);
+      enqueue (w->wq, w);
+    }
+  next_due_tick = (min != NULL
+                   ? heap_entry (min, struct work, timer_elem)->due_tick
+                   : INT64_MAX);
+}
+
+/* Appends W to WQ's queue and wakes a worker if the busy ones
+   already have a batch each to get through.  Interrupts must be
+   off. */
+static void
+enqueue (struct workqueue *wq, struct work *w)
+{
+  int busy_cnt;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  w->state = WORK_QUEUED;
+  w->seq = wq->next_seq++;
+  list_push_back (&wq->queue, &w->elem);
+  wq->queued_cnt++;
+
+  busy_cnt = wq->worker_cnt - wq->idle_cnt;
+  if (wq->idle_cnt > 0 && wq->queued_cnt > (size_t) busy_cnt * WORK_BATCH)
+    {
+      wq->idle_cnt--;
+      sema_up (&wq->wakeup);
+    }
+}
+
+/* A worker thread of workqueue WQ_.  Takes batches of items off
+   the queue and runs them, until the end of time. */
+static void
+worker_thread (void *wq_)
+{
+  struct workqueue *wq = wq_;
+  struct worker self;
+  struct list batch;
+
+  list_init (&batch);
+  intr_disable ();
+  self.seq = UINT64_MAX;
+  list_push_back (&wq->workers, &self.elem);
+
+  for (;;)
+    {
+      size_t i;
+
+      /* Wait for work. */
+      while (list_empty (&wq->queue))
+        {
+          wq->idle_cnt++;
+          sema_down (&wq->wakeup);
+        }
+
+      /* Take a batch. */
+      for (i = 0; i < WORK_BATCH && !list_empty (&wq->queue); i++)
+        {
+          struct work *w = list_entry (list_pop_front (&wq->queue),
+                                       struct work, elem);
+          w->state = WORK_BATCHED;
+          list_push_back (&batch, &w->elem);
+        }
+      wq->queued_cnt -= i;
+      wq->batch_cnt++;
+      self.seq = list_entry (list_front (&batch), struct work, elem)->seq;
+
+      /* Run it.  Each item's function may requeue or free it, so
+         it must not be touched afterward. */
+      while (!list_empty (&batch))
+        {
+          struct work *w = list_entry (list_pop_front (&batch),
+                                       struct work, elem);
+          w->state = WORK_RUNNING;
+          intr_enable ();
+          w->func (w);
+          intr_disable ();
+
+          wq->run_cnt++;
+          self.seq = (list_empty (&batch) ? UINT64_MAX
+                      : list_entry (list_front (&batch),
+                                    struct work, elem)->seq);
+          wake_flushers (wq);
+        }
+    }
+}
+
+/* Returns true if work item A is due before B. */
+static bool
+due_less (const struct heap_elem *a_, const struct heap_elem *b_,
+          void *aux UNUSED)
+{
+  const struct work *a = heap_entry (a_, struct work, timer_elem);
+  const struct work *b = heap_entry (b_, struct work, timer_elem);
+
+  return a->due_tick < b->due_tick;
+}
+
+/* Returns the sequence number of WQ's oldest unfinished item, or
+   UINT64_MAX if every item has finished.  Interrupts must be
+   off. */
+static uint64_t
+oldest_unfinished (struct workqueue *wq)
+{
+  uint64_t oldest = UINT64_MAX;
+  struct list_elem *e;
+
+  if (!list_empty (&wq->queue))
+    oldest = list_entry (list_front (&wq->queue), struct work, elem)->seq;
+  for (e = list_begin (&wq->workers); e != list_end (&wq->workers);
+       e = list_next (e))
+    {
+      struct worker *worker = list_entry (e, struct worker, elem);
+      if (worker->seq < oldest)
+        oldest = worker->seq;
+    }
+  return oldest;
+}
+
+/* Wakes the threads waiting in wait_for_seq() whose items have
+   all finished.  Interrupts must be off. */
+static void
+wake_flushers (struct workqueue *wq)
+{
+  uint64_t oldest;
+  struct list_elem *e;
+
+  if (list_empty (&wq->flushers))
+    return;
+
+  oldest = oldest_unfinished (wq);
+  for (e = list_begin (&wq->flushers); e != list_end (&wq->flushers); )
+    {
+      struct flusher *f = list_entry (e, struct flusher, elem);
+      e = list_next (e);
+      if (f->seq < oldest)
+        {
+          list_remove (&f->elem);
+          sema_up (&f->done);
+        }
+    }
+}
+
+/* Waits until every item of WQ numbered SEQ or lower has
+   finished.  Interrupts must be off. */
+static void
+wait_for_seq (struct workqueue *wq, uint64_t seq)
+{
+  struct flusher f;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!intr_context ());
+
+  if (oldest_unfinished (wq) > seq)
+    return;
+
+  f.seq = seq;
+  sema_init (&f.done, 0);
+  list_push_back (&wq->flushers, &f.elem);
+  sema_down (&f.done);
+}
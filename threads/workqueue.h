@@ -0,0 +1,68 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <heap.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/synch.h"
+
+struct work;
+typedef void work_func (struct work *);
+
+/* States of a work item. */
+enum work_state
+  {
+    WORK_IDLE,                  /* Not queued. */
+    WORK_DELAYED,               /* Waiting for its timer tick. */
+    WORK_QUEUED,                /* On its workqueue's queue. */
+    WORK_BATCHED,               /* Taken by a worker, about to run. */
+    WORK_RUNNING                /* Handed to its function. */
+  };
+
+/* A work item.  Usually embedded in a larger structure, which
+   FUNC recovers with list_entry()-style pointer arithmetic.
+   FUNC may requeue or free the item. */
+struct work
+  {
+    work_func *func;            /* Function to run. */
+    enum work_state state;      /* State. */
+    struct workqueue *wq;       /* Workqueue it was last queued on. */
+    uint64_t seq;               /* Order in which it reached the queue. */
+    int64_t due_tick;           /* Tick to queue it at, if delayed. */
+    struct list_elem elem;      /* In queue or a worker's batch. */
+    struct heap_elem timer_elem; /* In the delayed work heap. */
+  };
+
+/* A pool of worker threads running work items in FIFO order. */
+struct workqueue
+  {
+    const char *name;           /* Name for the worker threads. */
+    struct list queue;          /* Queued work items. */
+    size_t queued_cnt;          /* Length of queue. */
+    uint64_t next_seq;          /* Sequence number for the next item. */
+    int worker_cnt;             /* Number of worker threads. */
+    int idle_cnt;               /* Workers waiting for work. */
+    struct semaphore wakeup;    /* Upped to wake an idle worker. */
+    struct list workers;        /* Worker threads. */
+    struct list flushers;       /* Threads waiting for items to finish. */
+    long long run_cnt;          /* Items run. */
+    long long batch_cnt;        /* Batches taken from the queue. */
+  };
+
+void workqueue_init (struct workqueue *, const char *name);
+void workqueue_start (struct workqueue *, int worker_cnt, int priority);
+void workqueue_flush (struct workqueue *);
+void workqueue_print_stats (const struct workqueue *);
+
+void work_init (struct work *, work_func *);
+bool work_queue (struct workqueue *, struct work *);
+bool work_queue_delayed (struct workqueue *, struct work *, int64_t ticks);
+bool work_pending (const struct work *);
+bool work_cancel (struct work *);
+bool work_cancel_sync (struct work *);
+
+int64_t workqueue_next_tick (void);
+void workqueue_timer (int64_t tick);
+
+#endif /* threads/workqueue.h */
@@ -0,0 +1,150 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+
+/* Fast user-space mutexes.
+
+   A user program keeps the state of a mutex or condition
+   variable in an int of its own memory, and changes it with
+   atomic instructions, without entering the kernel at all as
+   long as no one has to wait.  Only a thread that has to sleep
+   calls futex_wait(), and only a thread that may have to wake one
+   calls futex_wake().  See lib/user/synch.c.
+
+   Waiters sleep in a hash table of FUTEX_BUCKETS wait lists,
+   keyed by the physical address of the int they wait on, so that
+   every process that maps the same page would find the same
+   waiters, whatever the int's virtual address in each.
+
+   A futex_wake() must not slip in between futex_wait()'s check
+   of the int's value and its waiter going to sleep, or the
+   wakeup would be lost.  Turning interrupts off only keeps this
+   CPU's interrupt handlers out; a waker on another CPU is kept
+   out by the kernel lock (see threads/smp.c), which futex_wait()
+   holds from the check until the waiter is on its wait list and
+   asleep, and which futex_wake() holds while it scans the list.
+   Code that stops holding the kernel lock here must protect the
+   wait lists with a lock of their own, held across the check
+   and the block. */
+
+#define FUTEX_BUCKETS 64                /* Number of wait lists. */
+
+/* A thread waiting in futex_wait(). */
+struct futex_waiter
+  {
+    struct list_elem elem;              /* In a bucket. */
+    uintptr_t key;                      /* Physical address waited on. */
+    struct semaphore wakeup;            /* Upped by futex_wake(). */
+  };
+
+static struct list buckets[FUTEX_BUCKETS];
+
+/* Initializes the futex wait table. */
+void
+futex_init (void)
+{
+  size_t i;
+
+  for (i = 0; i < FUTEX_BUCKETS; i++)
+    list_init (&buckets[i]);
+}
+
+/* Translates UADDR, the address of an int in the current
+   process's memory, into the kernel virtual address of the same
+   int, and returns it, or returns a null pointer if UADDR is
+   not a mapped, aligned user address. */
+static int *
+translate (const int *uaddr)
+{
+  struct thread *cur = thread_current ();
+
+  if (!is_user_vaddr (uaddr) || (uintptr_t) uaddr % sizeof *uaddr != 0
+      || cur->pagedir == NULL)
+    return NULL;
+  return pagedir_get_page (cur->pagedir, uaddr);
+}
+
+/* Returns the wait list for physical address KEY. */
+static struct list *
+bucket (uintptr_t key)
+{
+  return &buckets[hash_int (key) % FUTEX_BUCKETS];
+}
+
+/* If the int at user address UADDR still holds VAL, sleeps until
+   futex_wake() is called on it, and returns true.  Returns false
+   right away if it holds something else, or if UADDR is not a
+   valid address. */
+bool
+futex_wait (const int *uaddr, int val)
+{
+  struct futex_waiter w;
+  enum intr_level old_level;
+  int *kaddr;
+
+  old_level = intr_disable ();
+  kaddr = translate (uaddr);
+  if (kaddr == NULL || *kaddr != val)
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+
+  /* The kernel lock, not just interrupts being off, keeps a
+     futex_wake() on another CPU from running between the check
+     above and this waiter being on its list. */
+  w.key = vtop (kaddr);
+  sema_init (&w.wakeup, 0);
+  list_push_back (bucket (w.key), &w.elem);
+  sema_down (&w.wakeup);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Wakes up to CNT threads sleeping in futex_wait() on the int at
+   user address UADDR, longest-waiting first, and returns the
+   number woken.  Returns -1 if UADDR is not a valid address. */
+int
+futex_wake (const int *uaddr, int cnt)
+{
+  enum intr_level old_level;
+  struct list *list;
+  struct list_elem *e;
+  uintptr_t key;
+  int *kaddr;
+  int woken = 0;
+
+  old_level = intr_disable ();
+  kaddr = translate (uaddr);
+  if (kaddr == NULL)
+    {
+      intr_set_level (old_level);
+      return -1;
+    }
+
+  key = vtop (kaddr);
+  list = bucket (key);
+  for (e = list_begin (list); e != list_end (list) && woken < cnt; )
+    {
+      struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+      e = list_next (e);
+      if (w->key == key)
+        {
+          list_remove (&w->elem);
+          sema_up (&w->wakeup);
+          woken++;
+        }
+    }
+  intr_set_level (old_level);
+
+  if (woken > 0 && old_level == INTR_ON)
+    thread_preempt ();
+  return woken;
+}
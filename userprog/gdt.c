@@ -29,13 +29,14 @@ static uint64_t make_code_desc (int dpl);
 static uint64_t make_data_desc (int dpl);
 static uint64_t make_tss_desc (void *laddr);
 static uint64_t make_gdtr_operand (uint16_t limit, void *base);
+static void gdt_load (int cpu);
 
 /* Sets up a proper GDT.  The bootstrap loader's GDT didn't
    include user-mode selectors or a TSS, but we need both now. */
 void
 gdt_init (void)
 {
-  uint64_t gdtr_operand;
+  int cpu;
 
   /* Initialize GDT. */
   gdt[SEL_NULL / sizeof *gdt] = 0;
@@ -43,14 +44,30 @@ gdt_init (void)
   gdt[SEL_KDSEG / sizeof *gdt] = make_data_desc (0);
   gdt[SEL_UCSEG / sizeof *gdt] = make_code_desc (3);
   gdt[SEL_UDSEG / sizeof *gdt] = make_data_desc (3);
-  gdt[SEL_TSS / sizeof *gdt] = make_tss_desc (tss_get ());
+  for (cpu = 0; cpu < CPU_MAX; cpu++)
+    gdt[SEL_TSS_CPU (cpu) / sizeof *gdt] = make_tss_desc (tss_get (cpu));
 
-  /* Load GDTR, TR.  See [IA32-v3a] 2.4.1 "Global Descriptor
-     Table Register (GDTR)", 2.4.4 "Task Register (TR)", and
-     6.2.4 "Task Register".  */
-  gdtr_operand = make_gdtr_operand (sizeof gdt - 1, gdt);
+  gdt_load (0);
+}
+
+/* Loads the GDT set up by gdt_init() on an application
+   processor, the one we are running on, which is CPU number
+   CPU, along with that CPU's TSS. */
+void
+gdt_init_ap (int cpu)
+{
+  gdt_load (cpu);
+}
+
+/* Loads GDTR, and TR with CPU number CPU's TSS.  See [IA32-v3a]
+   2.4.1 "Global Descriptor Table Register (GDTR)", 2.4.4 "Task
+   Register (TR)", and 6.2.4 "Task Register". */
+static void
+gdt_load (int cpu)
+{
+  uint64_t gdtr_operand = make_gdtr_operand (sizeof gdt - 1, gdt);
   asm volatile ("lgdt %0" : : "m" (gdtr_operand));
-  asm volatile ("ltr %w0" : : "q" (SEL_TSS));
+  asm volatile ("ltr %w0" : : "q" (SEL_TSS_CPU (cpu)));
 }
 
 /* System segment or code/data segment? */
@@ -2,14 +2,20 @@
 #define USERPROG_GDT_H
 
 #include "threads/loader.h"
+#include "threads/smp.h"
 
 /* Segment selectors.
    More selectors are defined by the loader in loader.h. */
 #define SEL_UCSEG       0x1B    /* User code selector. */
 #define SEL_UDSEG       0x23    /* User data selector. */
-#define SEL_TSS         0x28    /* Task-state segment. */
-#define SEL_CNT         6       /* Number of segments. */
+#define SEL_TSS         0x28    /* Boot CPU's task-state segment. */
+#define SEL_CNT         (5 + CPU_MAX) /* Number of segments. */
+
+/* Task-state segment selector for CPU number CPU.  Each CPU needs
+   its own, because loading a TSS marks its descriptor busy. */
+#define SEL_TSS_CPU(CPU) (SEL_TSS + 8 * (CPU))
 
 void gdt_init (void);
+void gdt_init_ap (int cpu);
 
 #endif /* userprog/gdt.h */
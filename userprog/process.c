@@ -15,6 +15,7 @@
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
+#include "threads/smp.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 
@@ -71,7 +72,10 @@ start_process (void *file_name_)
      threads/intr-stubs.S).  Because intr_exit takes all of its
      arguments on the stack in the form of a `struct intr_frame',
      we just point the stack pointer (%esp) to our stack frame
-     and jump to it. */
+     and jump to it.  User code runs without the kernel lock,
+     which the next interrupt from user mode takes back. */
+  intr_disable ();
+  kernel_lock_release ();
   asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
   NOT_REACHED ();
 }
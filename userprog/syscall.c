@@ -3,18 +3,62 @@
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/futex.h"
+#include "userprog/pagedir.h"
 
 static void syscall_handler (struct intr_frame *);
 
 void
 syscall_init (void) 
 {
+  futex_init ();
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
+/* Reads word IDX of the user stack in F, which is the system
+   call number for IDX 0 and its arguments after that, into
+   *VALUE.  Returns false if the word is not in mapped user
+   memory. */
+static bool
+get_arg (const struct intr_frame *f, int idx, int *value)
+{
+  const uint8_t *uaddr = (const uint8_t *) f->esp + idx * sizeof *value;
+  uint8_t *dst = (uint8_t *) value;
+  size_t i;
+
+  for (i = 0; i < sizeof *value; i++)
+    {
+      const uint8_t *kaddr;
+
+      if (!is_user_vaddr (uaddr + i))
+        return false;
+      kaddr = pagedir_get_page (thread_current ()->pagedir, uaddr + i);
+      if (kaddr == NULL)
+        return false;
+      dst[i] = *kaddr;
+    }
+  return true;
+}
+
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+syscall_handler (struct intr_frame *f) 
 {
+  int number, arg0, arg1;
+
+  if (get_arg (f, 0, &number) && get_arg (f, 1, &arg0)
+      && get_arg (f, 2, &arg1))
+    switch (number)
+      {
+      case SYS_FUTEX_WAIT:
+        f->eax = futex_wait ((const int *) arg0, arg1) ? 0 : -1;
+        return;
+
+      case SYS_FUTEX_WAKE:
+        f->eax = futex_wake ((const int *) arg0, arg1);
+        return;
+      }
+
   printf ("system call!\n");
   thread_exit ();
 }
@@ -0,0 +1,345 @@
+/* Replays a page allocator trace, as printed by the kernel's
+   "ptdump" action or written by "ptsave", against every
+   placement policy.  The policies are the kernel's own code from
+   lib/kernel/bitmap.c and lib/kernel/buddy.c, compiled for the
+   host, so a captured allocation stream can be compared under
+   all of them in seconds.
+
+   Usage: palloc-replay [FILE]
+
+   Reads the trace from FILE, or from stdin if none is given.
+   Lines that do not hold trace events, such as the rest of a
+   console log, are ignored, and so are null bytes from the
+   scratch device. */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bitmap.h"
+#include "buddy.h"
+#include "palloc-replay.h"
+
+/* Placement policies, numbered as enum palloc_allocator. */
+enum policy
+  {
+    POLICY_FF,                  /* First fit. */
+    POLICY_NF,                  /* Next fit. */
+    POLICY_BF,                  /* Best fit. */
+    POLICY_BUDDY,               /* Buddy system. */
+    POLICY_WF,                  /* Worst fit. */
+    POLICY_CNT
+  };
+
+static const char *policy_names[POLICY_CNT] = {"FF", "NF", "BF", "BUDDY", "WF"};
+
+/* One traced event. */
+struct event
+  {
+    bool alloc;                 /* Allocation or free? */
+    bool user;                  /* User pool or kernel pool? */
+    bool failed;                /* Allocation failed in the kernel? */
+    size_t page_idx;            /* First page in the kernel. */
+    size_t page_cnt;            /* Number of pages. */
+  };
+
+static struct event *events;
+static size_t event_cnt, event_cap;
+static size_t pool_pages[2];    /* Kernel and user pool sizes. */
+static size_t pool_events[2];   /* Kernel and user pool events. */
+
+/* Where the replay put an allocation. */
+struct placement
+  {
+    size_t page_idx;            /* First page, or SIZE_MAX if none. */
+    size_t page_cnt;            /* Pages marked used. */
+  };
+
+/* Called by the kernel code on a failed assertion or panic. */
+void
+debug_panic (const char *file, int line, const char *function,
+             const char *message, ...)
+{
+  va_list args;
+
+  fprintf (stderr, "palloc-replay: %s:%d in %s(): ", file, line, function);
+  va_start (args, message);
+  vfprintf (stderr, message, args);
+  va_end (args);
+  putc ('\n', stderr);
+  abort ();
+}
+
+/* Called by bitmap_dump(), which we never use. */
+void
+hex_dump (uintptr_t ofs, const void *buf, size_t size, bool ascii)
+{
+  (void) ofs;
+  (void) buf;
+  (void) size;
+  (void) ascii;
+}
+
+/* Parses the trace line LINE, if it is one, adding its event to
+   EVENTS or its pool sizes to POOL_PAGES. */
+static void
+parse_line (const char *line)
+{
+  const char *p = strstr (line, "palloc-trace: ");
+  unsigned long long tsc;
+  unsigned long kept, lost, kernel, user, cnt;
+  char type, pool, idx[32];
+  int policy;
+  struct event *e;
+
+  if (p == NULL)
+    return;
+  p += strlen ("palloc-trace: ");
+
+  if (sscanf (p, "begin %lu %lu %lu %lu", &kept, &lost, &kernel, &user) == 4)
+    {
+      pool_pages[0] = kernel;
+      pool_pages[1] = user;
+      if (lost > 0)
+        printf ("trace lost its first %lu events; frees of pages "
+                "allocated then are skipped\n", lost);
+      return;
+    }
+  if (sscanf (p, "%llu %c %c %d %31s %lu", &tsc, &type, &pool, &policy,
+              idx, &cnt) != 6
+      || (type != 'a' && type != 'f') || (pool != 'k' && pool != 'u'))
+    return;
+
+  if (event_cnt == event_cap)
+    {
+      event_cap = event_cap > 0 ? event_cap * 2 : 1024;
+      events = realloc (events, event_cap * sizeof *events);
+      if (events == NULL)
+        {
+          fprintf (stderr, "palloc-replay: out of memory\n");
+          exit (EXIT_FAILURE);
+        }
+    }
+  e = &events[event_cnt++];
+  e->alloc = type == 'a';
+  e->user = pool == 'u';
+  e->failed = !strcmp (idx, "-");
+  e->page_idx = e->failed ? 0 : strtoul (idx, NULL, 10);
+  e->page_cnt = cnt;
+  pool_events[e->user]++;
+}
+
+/* Returns the first page of the longest run of CNT or more free
+   pages in B, the lowest such if there are several, or
+   BITMAP_ERROR if there is none. */
+static size_t
+scan_worst_fit (const struct bitmap *b, size_t cnt)
+{
+  size_t best = BITMAP_ERROR, best_cnt = 0;
+  size_t start = 0, run_cnt;
+
+  while ((start = bitmap_next_run (b, start, false, &run_cnt))
+         != BITMAP_ERROR)
+    {
+      if (run_cnt > best_cnt)
+        {
+          best = start;
+          best_cnt = run_cnt;
+        }
+      start += run_cnt;
+    }
+  return best_cnt >= cnt ? best : BITMAP_ERROR;
+}
+
+/* Returns the length of the longest run of free pages in B. */
+static size_t
+largest_free (const struct bitmap *b)
+{
+  size_t largest = 0;
+  size_t start = 0, run_cnt;
+
+  while ((start = bitmap_next_run (b, start, false, &run_cnt))
+         != BITMAP_ERROR)
+    {
+      if (run_cnt > largest)
+        largest = run_cnt;
+      start += run_cnt;
+    }
+  return largest;
+}
+
+/* Replays the events for the user pool if USER is true,
+   otherwise for the kernel pool, under POLICY, and prints the
+   results. */
+static void
+replay (bool user, enum policy policy)
+{
+  size_t page_cnt = pool_pages[user];
+  struct bitmap *b = bitmap_create (page_cnt);
+  struct placement *placed = malloc (page_cnt * sizeof *placed);
+  size_t buddy_bytes = buddy_buf_size (page_cnt);
+  void *buddy_buf = malloc (buddy_bytes);
+  struct buddy *buddy;
+  size_t allocs = 0, failures = 0, retried = 0, unknown = 0;
+  size_t used = 0, peak = 0;
+  size_t free_cnt, largest;
+  struct timespec start, end;
+  double ns;
+  size_t i;
+
+  if (b == NULL || placed == NULL || buddy_buf == NULL)
+    {
+      fprintf (stderr, "palloc-replay: out of memory\n");
+      exit (EXIT_FAILURE);
+    }
+  buddy = buddy_create_in_buf (page_cnt, buddy_buf, buddy_bytes);
+  for (i = 0; i < page_cnt; i++)
+    placed[i].page_idx = SIZE_MAX;
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  for (i = 0; i < event_cnt; i++)
+    {
+      const struct event *e = &events[i];
+      size_t idx, cnt = e->page_cnt;
+
+      if (e->user != user)
+        continue;
+
+      if (!e->alloc)
+        {
+          struct placement *p;
+
+          if (e->page_idx >= page_cnt
+              || (p = &placed[e->page_idx])->page_idx == SIZE_MAX)
+            {
+              unknown++;
+              continue;
+            }
+          if (policy == POLICY_BUDDY)
+            buddy_free (buddy, p->page_idx);
+          bitmap_set_multiple (b, p->page_idx, p->page_cnt, false);
+          used -= p->page_cnt;
+          p->page_idx = SIZE_MAX;
+          continue;
+        }
+
+      allocs++;
+      switch (policy)
+        {
+        case POLICY_NF:
+          idx = bitmap_scan_NF (b, 0, cnt, false);
+          break;
+        case POLICY_BF:
+          idx = bitmap_scan_BF (b, 0, cnt, false);
+          break;
+        case POLICY_BUDDY:
+          idx = buddy_alloc (buddy, cnt);
+          if (idx == BUDDY_ERROR)
+            idx = BITMAP_ERROR;
+          else
+            cnt = buddy_round (cnt);
+          break;
+        case POLICY_WF:
+          idx = scan_worst_fit (b, cnt);
+          break;
+        default:
+          idx = bitmap_scan (b, 0, cnt, false);
+          break;
+        }
+      if (idx == BITMAP_ERROR)
+        {
+          failures++;
+          if (!e->failed && e->page_idx < page_cnt)
+            placed[e->page_idx].page_idx = SIZE_MAX;
+          continue;
+        }
+
+      bitmap_set_multiple (b, idx, cnt, true);
+      bitmap_modify_idx (b, idx + cnt);
+      used += cnt;
+      if (used > peak)
+        peak = used;
+
+      if (e->failed)
+        {
+          /* The kernel had no pages for this request, so there
+             will be no free for it.  Give them straight back. */
+          retried++;
+          if (policy == POLICY_BUDDY)
+            buddy_free (buddy, idx);
+          bitmap_set_multiple (b, idx, cnt, false);
+          used -= cnt;
+        }
+      else if (e->page_idx < page_cnt)
+        {
+          placed[e->page_idx].page_idx = idx;
+          placed[e->page_idx].page_cnt = cnt;
+        }
+    }
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+  free_cnt = bitmap_count (b, 0, page_cnt, false);
+  largest = largest_free (b);
+  printf ("%-5s %7zu allocs %6zu failed %5zu retried %6zu unknown frees  "
+          "peak %5zu used  frag %.3f  %6.0f ns/alloc\n",
+          policy_names[policy], allocs, failures, retried, unknown, peak,
+          free_cnt > 0 ? 1.0 - (double) largest / free_cnt : 0.0,
+          allocs > 0 ? ns / allocs : 0.0);
+
+  free (buddy_buf);
+  free (placed);
+  bitmap_destroy (b);
+}
+
+int
+main (int argc, char *argv[])
+{
+  FILE *in = stdin;
+  char line[256];
+  int pool;
+
+  if (argc > 2)
+    {
+      fprintf (stderr, "usage: %s [FILE]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  if (argc == 2)
+    {
+      in = fopen (argv[1], "r");
+      if (in == NULL)
+        {
+          perror (argv[1]);
+          return EXIT_FAILURE;
+        }
+    }
+
+  while (fgets (line, sizeof line, in) != NULL)
+    parse_line (line);
+
+  /* Without a header, size each pool to fit its events. */
+  for (size_t i = 0; i < event_cnt; i++)
+    {
+      const struct event *e = &events[i];
+      if (!e->failed && e->page_idx + e->page_cnt > pool_pages[e->user])
+        pool_pages[e->user] = e->page_idx + e->page_cnt;
+    }
+
+  printf ("%zu events\n", event_cnt);
+  for (pool = 0; pool < 2; pool++)
+    {
+      enum policy policy;
+
+      if (pool_events[pool] == 0)
+        continue;
+      printf ("\n%s pool, %zu pages, %zu events:\n",
+              pool ? "user" : "kernel", pool_pages[pool], pool_events[pool]);
+      for (policy = 0; policy < POLICY_CNT; policy++)
+        replay (pool, policy);
+    }
+  return EXIT_SUCCESS;
+}
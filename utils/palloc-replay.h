@@ -0,0 +1,14 @@
+#ifndef PALLOC_REPLAY_H
+#define PALLOC_REPLAY_H 1
+
+/* Forced into the kernel sources that palloc-replay compiles for
+   the host, to declare what the Pintos C library declares and
+   the host's does not. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+void hex_dump (uintptr_t ofs, const void *, size_t size, bool ascii);
+
+#endif /* palloc-replay.h */